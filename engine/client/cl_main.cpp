@@ -1055,7 +1055,7 @@ static void CL_SendConnectPacket( void )
 	}
 	else
 	{
-		int extensions = NET_EXT_SPLITSIZE;
+		int extensions = NET_EXT_MASK;
 
 		if( cl_dlmax.value > FRAGMENT_MAX_SIZE  || cl_dlmax.value < FRAGMENT_MIN_SIZE )
 			Cvar_SetValue( "cl_dlmax", FRAGMENT_DEFAULT_SIZE );
@@ -1461,8 +1461,19 @@ static void CL_Reconnect( qboolean setup_netchan )
 			{
 				Con_Reportf( "^2NET_EXT_SPLITSIZE enabled^7 (packet size is %d)\n", (int)cl_dlmax.value );
 			}
+
+			if( cls.extensions & NET_EXT_COMPRESS )
+			{
+				cls.netchan.compression = COMPRESS_FAST;
+				Con_Reportf( "^2NET_EXT_COMPRESS enabled^7\n" );
+			}
+
+			if( cls.extensions & NET_EXT_WSUNRELIABLE )
+				Con_Reportf( "^2NET_EXT_WSUNRELIABLE enabled^7\n" );
 		}
 
+		// legacy servers never read "umsg"
+		NET_WebsocketSetUnreliable( NS_CLIENT, net_from, !cls.legacymode && FBitSet( cls.extensions, NET_EXT_WSUNRELIABLE ) ? true : false );
 	}
 	else
 	{
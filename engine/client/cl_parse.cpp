@@ -849,10 +849,16 @@ CL_ParseFileTransferFailed
 */
 void CL_ParseFileTransferFailed( sizebuf_t *msg )
 {
-	const char	*name = MSG_ReadString( msg );
+	string	name;
 
-	if( !cls.demoplayback )
-		CL_ProcessFile( false, name );
+	// MSG_ReadString buffer is reused when matching the fragments
+	Q_strncpy( name, MSG_ReadString( msg ), sizeof( name ));
+
+	if( cls.demoplayback )
+		return;
+
+	Netchan_AbortIncomingFile( &cls.netchan, name );
+	CL_ProcessFile( false, name );
 }
 
 /*
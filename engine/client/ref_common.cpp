@@ -716,3 +716,136 @@ qboolean engine::R_Init( void )
 
 	return true;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+static void Test_ImdrawArrayDraws( void )
+{
+	static const float quad[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 };
+	static const unsigned short quadelems[] = { 0, 1, 2, 0, 2, 3 };
+	static const unsigned short tailelems[] = { 5, 6, 7 };
+	const imdraw::DrawStats *stats = &imdraw::GetDrawStats();
+	float strip[8 * 3] = { 0 };
+	uint draws, arraydraws, verts, elems, cached;
+	GLuint vbo;
+
+	imdraw::ResetDrawStats();
+	imdraw::pglGenBuffersARB( 1, &vbo );
+	imdraw::pglBindBufferARB( GL_ARRAY_BUFFER_ARB, vbo );
+	imdraw::pglBufferDataARB( GL_ARRAY_BUFFER_ARB, sizeof( quad ), quad, GL_STATIC_DRAW_ARB );
+	imdraw::pglEnableClientState( GL_VERTEX_ARRAY );
+	imdraw::pglVertexPointer( 3, GL_FLOAT, 0, NULL );
+	imdraw::pglBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
+
+	// static buffer is converted once, the second draw only uploads its indices
+	imdraw::pglDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, quadelems );
+	imdraw::pglDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, quadelems );
+	draws = stats->draw_calls;
+	verts = stats->vertices;
+	elems = stats->indices;
+	cached = stats->cached_array_draws;
+	TASSERT_EQi( draws, 2 );
+	TASSERT_EQi( verts, 4 );
+	TASSERT_EQi( elems, 12 );
+	TASSERT_EQi( cached, 1 );
+
+	// rewritten store is converted again
+	imdraw::pglBindBufferARB( GL_ARRAY_BUFFER_ARB, vbo );
+	imdraw::pglBufferSubDataARB( GL_ARRAY_BUFFER_ARB, 0, sizeof( float ) * 3, quad );
+	imdraw::pglBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
+	imdraw::pglDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, quadelems );
+	verts = stats->vertices;
+	cached = stats->cached_array_draws;
+	TASSERT_EQi( verts, 8 );
+	TASSERT_EQi( cached, 1 );
+
+	// scaled texcoords can't share the resident copy, the range is converted instead
+	imdraw::pglMatrixMode( GL_TEXTURE );
+	imdraw::pglScalef( 2, 2, 1 );
+	imdraw::pglDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, quadelems );
+	imdraw::pglLoadIdentity();
+	imdraw::pglMatrixMode( GL_MODELVIEW );
+	verts = stats->vertices;
+	cached = stats->cached_array_draws;
+	TASSERT_EQi( verts, 12 );
+	TASSERT_EQi( cached, 1 );
+
+	imdraw::pglDeleteBuffersARB( 1, &vbo );
+
+	// client memory only converts the referenced range
+	imdraw::ResetDrawStats();
+	imdraw::pglVertexPointer( 3, GL_FLOAT, 0, strip );
+	imdraw::pglDrawElements( GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, tailelems );
+	imdraw::pglDrawArrays( GL_TRIANGLE_FAN, 2, 4 );
+	draws = stats->draw_calls;
+	arraydraws = stats->array_draw_calls;
+	verts = stats->vertices;
+	elems = stats->indices;
+	cached = stats->cached_array_draws;
+	TASSERT_EQi( draws, 2 );
+	TASSERT_EQi( arraydraws, 2 );
+	TASSERT_EQi( verts, 7 );
+	TASSERT_EQi( elems, 7 );
+	TASSERT_EQi( cached, 0 );
+
+	imdraw::pglDisableClientState( GL_VERTEX_ARRAY );
+}
+
+static void Test_ImdrawTexturePasses( void )
+{
+	const imdraw::DrawStats *stats = &imdraw::GetDrawStats();
+	uint draws, verts, passes;
+	int i;
+
+	imdraw::ResetDrawStats();
+	imdraw::pglBegin( GL_QUADS );
+	for( i = 0; i < 4; i++ )
+		imdraw::pglVertex3f( i, 0, 0 );
+	imdraw::pglEnd();
+
+	// second unit is drawn as an extra pass over the first one
+	imdraw::pglActiveTextureARB( GL_TEXTURE1_ARB );
+	imdraw::pglBindTexture( GL_TEXTURE_2D, 1 );
+	imdraw::pglEnable( GL_TEXTURE_2D );
+	imdraw::pglTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+	imdraw::pglActiveTextureARB( GL_TEXTURE0_ARB );
+
+	imdraw::pglBegin( GL_TRIANGLES );
+	for( i = 0; i < 3; i++ )
+	{
+		imdraw::pglMultiTexCoord2f( GL_TEXTURE1_ARB, i, 0 );
+		imdraw::pglVertex3f( i, 0, 0 );
+	}
+	imdraw::pglEnd();
+
+	draws = stats->draw_calls;
+	verts = stats->vertices;
+	passes = stats->texture_passes;
+	TASSERT_EQi( draws, 2 );
+	TASSERT_EQi( verts, 7 );
+	TASSERT_EQi( passes, 1 );
+
+	imdraw::pglActiveTextureARB( GL_TEXTURE1_ARB );
+	imdraw::pglDisable( GL_TEXTURE_2D );
+	imdraw::pglActiveTextureARB( GL_TEXTURE0_ARB );
+
+	imdraw::pglBegin( GL_TRIANGLES );
+	for( i = 0; i < 3; i++ )
+		imdraw::pglVertex3f( i, 0, 0 );
+	imdraw::pglEnd();
+
+	passes = stats->texture_passes;
+	TASSERT_EQi( passes, 1 );
+}
+
+void Test_RunImdraw( void )
+{
+	qboolean recording = imdraw::IsRecording();
+
+	imdraw::SetRecording( true );
+	TRUN( Test_ImdrawArrayDraws() );
+	TRUN( Test_ImdrawTexturePasses() );
+	imdraw::SetRecording( recording );
+}
+#endif /* XASH_ENGINE_TESTS */
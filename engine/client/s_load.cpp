@@ -29,6 +29,8 @@ using namespace engine;
 static int	s_numSfx = 0;
 static sfx_t	s_knownSfx[MAX_SFX];
 static sfx_t	*s_sfxHashList[MAX_SFX_HASH];
+static int	s_freeSfx[MAX_SFX];		// released slots below s_numSfx
+static int	s_numFreeSfx = 0;
 static string	s_sentenceImmediateName;	// keep dummy sentence name
 qboolean		s_registering = false;
 
@@ -208,14 +210,15 @@ sfx_t *S_FindName( const char *pname, int *pfInCache )
 	}
 
 	// find a free sfx slot spot
-	for( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++)
-		if( !sfx->name[0] ) break; // free spot
-
-	if( i == s_numSfx )
+	if( s_numFreeSfx > 0 )
+	{
+		i = s_freeSfx[--s_numFreeSfx];
+	}
+	else
 	{
 		if( s_numSfx == MAX_SFX )
 			return NULL;
-		s_numSfx++;
+		i = s_numSfx++;
 	}
 
 	sfx = &s_knownSfx[i];
@@ -264,6 +267,9 @@ void S_FreeSound( sfx_t *sfx )
 	if( sfx->cache )
 		FS_FreeSound( sfx->cache );
 	memset( sfx, 0, sizeof( *sfx ));
+
+	if( sfx >= s_knownSfx && sfx < s_knownSfx + s_numSfx )
+		s_freeSfx[s_numFreeSfx++] = sfx - s_knownSfx;
 }
 
 /*
@@ -412,4 +418,5 @@ void S_FreeSounds( void )
 	memset( s_sfxHashList, 0, sizeof( s_sfxHashList ));
 
 	s_numSfx = 0;
+	s_numFreeSfx = 0;
 }
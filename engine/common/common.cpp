@@ -23,6 +23,8 @@ GNU General Public License for more details.
 #include "client.h"
 #include "library.h"
 #include "malloc.h"
+#define MINIZ_HEADER_FILE_ONLY	// implementation is compiled by imagelib
+#include "miniz.h"
 
 engine::ConversionPtr engine::Mem_Malloc(poolhandle_t pool, size_t size)
 {
@@ -477,6 +479,135 @@ uint LZSS_Decompress( const byte *pInput, byte *pOutput )
 	return totalBytes;
 }
 
+/*
+===============================================================================
+
+	Deflate Compression
+
+	raw deflate stream behind LZSS-like header, used only
+	with peers that announced NET_EXT_COMPRESS
+
+===============================================================================
+*/
+#define DEFLATE_ID		(('L'<<24)|('F'<<16)|('D'<<8)|('Z'))
+
+static uint DEFLATE_GetActualSize( const byte *source )
+{
+	lzss_header_t	*phdr = (lzss_header_t *)source;
+
+	if( phdr && phdr->id == DEFLATE_ID )
+		return phdr->size;
+	return 0;
+}
+
+static byte *DEFLATE_Compress( byte *pInput, int inputLength, uint *pOutputSize, int level )
+{
+	byte		*pStart;
+	lzss_header_t	*header;
+	mz_uint		flags;
+	size_t		size;
+
+	if( inputLength <= (int)sizeof( lzss_header_t ))
+		return NULL;
+
+	// result must be smaller than input, like LZSS
+	pStart = (byte *)malloc( inputLength );
+	flags = tdefl_create_comp_flags_from_zip_params( level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY );
+	size = tdefl_compress_mem_to_mem( pStart + sizeof( lzss_header_t ), inputLength - sizeof( lzss_header_t ), pInput, inputLength, flags );
+
+	if( !size )
+	{
+		free( pStart );
+		return NULL;
+	}
+
+	header = (lzss_header_t *)pStart;
+	header->id = DEFLATE_ID;
+	header->size = inputLength;
+	*pOutputSize = size + sizeof( lzss_header_t );
+
+	return pStart;
+}
+
+static uint DEFLATE_Decompress( const byte *pInput, uint inputLength, byte *pOutput, uint outputLength )
+{
+	uint	actualSize = DEFLATE_GetActualSize( pInput );
+	size_t	size;
+
+	if( !actualSize || actualSize > outputLength || inputLength < sizeof( lzss_header_t ))
+		return 0;
+
+	size = tinfl_decompress_mem_to_mem( pOutput, actualSize, pInput + sizeof( lzss_header_t ), inputLength - sizeof( lzss_header_t ), 0 );
+
+	if( size != actualSize )
+		return 0;
+
+	return actualSize;
+}
+
+/*
+==============
+COM_IsCompressed
+
+any of compressors below
+==============
+*/
+qboolean COM_IsCompressed( const byte *source )
+{
+	return LZSS_IsCompressed( source ) || DEFLATE_GetActualSize( source ) != 0;
+}
+
+/*
+==============
+COM_GetActualSize
+==============
+*/
+uint COM_GetActualSize( const byte *source )
+{
+	if( LZSS_IsCompressed( source ))
+		return LZSS_GetActualSize( source );
+	return DEFLATE_GetActualSize( source );
+}
+
+/*
+==============
+COM_Compress
+
+result is allocated with malloc, NULL if data can't be compressed
+==============
+*/
+byte *COM_Compress( compressor_t type, byte *pInput, int inputLength, uint *pOutputSize )
+{
+	switch( type )
+	{
+	case COMPRESS_FAST:
+		return DEFLATE_Compress( pInput, inputLength, pOutputSize, 1 );
+	case COMPRESS_BEST:
+		return DEFLATE_Compress( pInput, inputLength, pOutputSize, MZ_UBER_COMPRESSION );
+	default:
+		return LZSS_Compress( pInput, inputLength, pOutputSize );
+	}
+}
+
+/*
+==============
+COM_Decompress
+
+returns decompressed size or 0 on error
+==============
+*/
+uint COM_Decompress( const byte *pInput, uint inputLength, byte *pOutput, uint outputLength )
+{
+	if( LZSS_IsCompressed( pInput ))
+	{
+		if( LZSS_GetActualSize( pInput ) > outputLength )
+			return 0;
+		return LZSS_Decompress( pInput, pOutput );
+	}
+
+	return DEFLATE_Decompress( pInput, inputLength, pOutput, outputLength );
+}
+
 /*
 ==============
 COM_IsWhiteSpace
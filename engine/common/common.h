@@ -780,6 +780,18 @@ qboolean LZSS_IsCompressed( const byte *source );
 uint LZSS_GetActualSize( const byte *source );
 byte *LZSS_Compress( byte *pInput, int inputLength, uint *pOutputSize );
 uint LZSS_Decompress( const byte *pInput, byte *pOutput );
+
+typedef enum
+{
+	COMPRESS_LZSS = 0,	// understood by every client
+	COMPRESS_FAST,	// deflate, quick
+	COMPRESS_BEST,	// deflate, best ratio
+} compressor_t;
+
+qboolean COM_IsCompressed( const byte *source );
+uint COM_GetActualSize( const byte *source );
+byte *COM_Compress( compressor_t type, byte *pInput, int inputLength, uint *pOutputSize );
+uint COM_Decompress( const byte *pInput, uint inputLength, byte *pOutput, uint outputLength );
 void GL_FreeImage( const char *name );
 void VID_InitDefaultResolution( void );
 void VID_Init( void );
@@ -568,6 +568,9 @@ void Mod_PrintWorldStats_f( void )
 	Con_Printf( "Supports transparency world water: %s\n", FBitSet( world.flags, FWORLD_WATERALPHA ) ? "Yes" : "No" );
 	Con_Printf( "Lighting: %s\n", FBitSet( w->flags, MODEL_COLORED_LIGHTING ) ? "colored" : "monochrome" );
 	Con_Printf( "World total leafs: %d\n", worldmodel->numleafs + 1 );
+	if( world.pvscache )
+		Con_Printf( "Visibility cache: %s\n", Q_memprint( world.viscachesize ));
+	else Con_Printf( "Visibility cache: disabled\n" );
 	Con_Printf( "original name: ^1%s\n", worldmodel->name );
 	Con_Printf( "internal name: ^2%s\n", world.message[0] ? world.message : "none" );
 	Con_Printf( "map compiler: ^3%s\n", world.compiler[0] ? world.compiler : "unknown" );
@@ -625,6 +628,91 @@ static byte *Mod_DecompressPVS( const byte *in, int visbytes )
 	return g_visdata;
 }
 
+/*
+===================
+Mod_MergeVisBits
+
+OR the src visibility row into dst, word at a time when possible
+===================
+*/
+static void Mod_MergeVisBits( byte *dst, const byte *src, int bytes )
+{
+	int	i = 0;
+
+	if( !((uintptr_t)dst & ( sizeof( size_t ) - 1 )) && !((uintptr_t)src & ( sizeof( size_t ) - 1 )))
+	{
+		for( ; i + (int)sizeof( size_t ) <= bytes; i += sizeof( size_t ))
+			*(size_t *)( dst + i ) |= *(const size_t *)( src + i );
+	}
+
+	for( ; i < bytes; i++ )
+		dst[i] |= src[i];
+}
+
+/*
+===================
+Mod_LeafPVS
+
+decompressed PVS for leaf, uses cache if possible
+===================
+*/
+static byte *Mod_LeafPVS( const mleaf_t *leaf )
+{
+	if( world.pvscache && leaf->cluster >= 0 && leaf->cluster < world.visclusters )
+		return world.pvscache + leaf->cluster * world.visstride;
+
+	return Mod_DecompressPVS( leaf->compressed_vis, world.visbytes );
+}
+
+/*
+===================
+Mod_BuildVisCache
+
+decompress all clusters once at world load
+memory is limited by mod_viscache cvar
+===================
+*/
+static void Mod_BuildVisCache( model_t *mod, dbspmodel_t *bmod )
+{
+	size_t	limit = (size_t)mod_viscache.value * 1024 * 1024;
+	size_t	size;
+	int	i, visclusters;
+
+	world.pvscache = NULL;
+	world.phscache = NULL;
+	world.viscachesize = 0;
+	world.visclusters = 0;
+
+	if( !limit || bmod->visdatasize <= 0 || !mod->visdata )
+		return;
+
+	visclusters = mod->submodels[0].visleafs;
+	world.visstride = ( world.fatbytes + sizeof( size_t ) - 1 ) & ~( sizeof( size_t ) - 1 );
+	size = visclusters * world.visstride;
+
+	if( size + visclusters * sizeof( byte * ) > limit )
+	{
+		Con_Reportf( "Mod_BuildVisCache: %s is over mod_viscache limit, skipped\n", Q_memprint( size ));
+		return;
+	}
+
+	world.pvscache = (byte *)Mem_Calloc( mod->mempool, size );
+	world.phscache = (byte **)Mem_Calloc( mod->mempool, visclusters * sizeof( byte * ));
+	world.viscachesize = size + visclusters * sizeof( byte * );
+
+	for( i = 0; i < mod->numleafs; i++ )
+	{
+		const mleaf_t *leaf = &mod->leafs[i];
+
+		if( leaf->cluster < 0 || leaf->cluster >= visclusters )
+			continue;
+
+		memcpy( world.pvscache + leaf->cluster * world.visstride, Mod_DecompressPVS( leaf->compressed_vis, world.visbytes ), world.visbytes );
+	}
+
+	world.visclusters = visclusters;
+}
+
 /*
 ==================
 Mod_PointInLeaf
@@ -674,7 +762,7 @@ byte *Mod_GetPVSForPoint( const vec3_t p )
 	}
 
 	if( leaf && leaf->cluster >= 0 )
-		return Mod_DecompressPVS( leaf->compressed_vis, world.visbytes );
+		return Mod_LeafPVS( leaf );
 	return NULL;
 }
 
@@ -686,8 +774,6 @@ Mod_FatPVS_RecursiveBSPNode
 */
 static void Mod_FatPVS_RecursiveBSPNode( const vec3_t org, float radius, byte *visbuffer, int visbytes, mnode_t *node )
 {
-	int	i;
-
 	while( node->contents >= 0 )
 	{
 		float d = PlaneDiff( org, node->plane );
@@ -706,12 +792,7 @@ static void Mod_FatPVS_RecursiveBSPNode( const vec3_t org, float radius, byte *v
 
 	// if this leaf is in a cluster, accumulate the vis bits
 	if(((mleaf_t *)node)->cluster >= 0 )
-	{
-		byte	*vis = Mod_DecompressPVS( ((mleaf_t *)node)->compressed_vis, world.visbytes );
-
-		for( i = 0; i < visbytes; i++ )
-			visbuffer[i] |= vis[i];
-	}
+		Mod_MergeVisBits( visbuffer, Mod_LeafPVS( (mleaf_t *)node ), visbytes );
 }
 
 /*
@@ -746,6 +827,88 @@ int Mod_FatPVS( const vec3_t org, float radius, byte *visbuffer, int visbytes, q
 	return bytes;
 }
 
+/*
+==================
+Mod_FatPHS_RecursiveBox
+
+accumulate vis bits of all leafs touching the box
+==================
+*/
+static void Mod_FatPHS_RecursiveBox( const vec3_t mins, const vec3_t maxs, byte *visbuffer, int visbytes, mnode_t *node )
+{
+	while( node->contents >= 0 )
+	{
+		int sides = BOX_ON_PLANE_SIDE( mins, maxs, node->plane );
+
+		if( sides == 1 )
+			node = node->children[0];
+		else if( sides == 2 )
+			node = node->children[1];
+		else
+		{
+			// go down both sides
+			Mod_FatPHS_RecursiveBox( mins, maxs, visbuffer, visbytes, node->children[0] );
+			node = node->children[1];
+		}
+	}
+
+	if(((mleaf_t *)node)->cluster >= 0 )
+		Mod_MergeVisBits( visbuffer, Mod_LeafPVS( (mleaf_t *)node ), visbytes );
+}
+
+/*
+==================
+Mod_GetFatPHSForPoint
+
+Returns FATPHS_RADIUS fat PVS used as PHS for a given point.
+Memoized per leaf when cache is enabled: the row merges every leaf
+within FATPHS_RADIUS of the whole leaf bounds, so it's a superset
+of the per-point result. Otherwise fills visbuffer (world.fatbytes)
+==================
+*/
+byte *Mod_GetFatPHSForPoint( const vec3_t p, byte *visbuffer, qboolean fullvis )
+{
+	vec3_t	mins, maxs;
+	mleaf_t	*leaf;
+	byte	*row;
+
+	ASSERT( worldmodel != NULL );
+
+	if( fullvis || !world.phscache || !worldmodel->visdata )
+	{
+		Mod_FatPVS( p, FATPHS_RADIUS, visbuffer, world.fatbytes, false, fullvis );
+		return visbuffer;
+	}
+
+	leaf = Mod_PointInLeaf( p, worldmodel->nodes );
+
+	if( !leaf || leaf->cluster < 0 || leaf->cluster >= world.visclusters )
+	{
+		Mod_FatPVS( p, FATPHS_RADIUS, visbuffer, world.fatbytes, false, fullvis );
+		return visbuffer;
+	}
+
+	if( world.phscache[leaf->cluster] )
+		return world.phscache[leaf->cluster];
+
+	// out of memory budget, compute on the fly
+	if( world.viscachesize + world.visstride > (size_t)mod_viscache.value * 1024 * 1024 )
+	{
+		Mod_FatPVS( p, FATPHS_RADIUS, visbuffer, world.fatbytes, false, fullvis );
+		return visbuffer;
+	}
+
+	row = (byte *)Mem_Calloc( worldmodel->mempool, world.visstride );
+	VectorSet( mins, leaf->minmaxs[0] - FATPHS_RADIUS, leaf->minmaxs[1] - FATPHS_RADIUS, leaf->minmaxs[2] - FATPHS_RADIUS );
+	VectorSet( maxs, leaf->minmaxs[3] + FATPHS_RADIUS, leaf->minmaxs[4] + FATPHS_RADIUS, leaf->minmaxs[5] + FATPHS_RADIUS );
+	Mod_FatPHS_RecursiveBox( mins, maxs, row, world.visbytes, worldmodel->nodes );
+
+	world.viscachesize += world.visstride;
+	world.phscache[leaf->cluster] = row;
+
+	return row;
+}
+
 /*
 ======================================================================
 
@@ -963,7 +1126,7 @@ static qboolean Mod_CheckWaterAlphaSupport( model_t *mod, dbspmodel_t *bmod )
 	{
 		if(( leaf->contents == CONTENTS_WATER || leaf->contents == CONTENTS_SLIME ) && leaf->cluster >= 0 )
 		{
-			pvs = Mod_DecompressPVS( leaf->compressed_vis, world.visbytes );
+			pvs = Mod_LeafPVS( leaf );
 
 			for( j = 0; j < mod->numleafs; j++ )
 			{
@@ -2969,6 +3132,9 @@ static qboolean Mod_LoadBmodelLumps( model_t *mod, const byte *mod_base, qboolea
 	if( isworld )
 	{
 		world.flags = 0;	// clear world settings
+		world.pvscache = NULL;	// will be rebuilt after leafs loading
+		world.phscache = NULL;
+		world.visclusters = 0;
 		SetBits( flags, LUMP_SAVESTATS|LUMP_SILENT );
 	}
 	bmod->isworld = isworld;
@@ -3014,6 +3180,7 @@ static qboolean Mod_LoadBmodelLumps( model_t *mod, const byte *mod_base, qboolea
 	if( isworld )
 	{
 		world.version = bmod->version;
+		Mod_BuildVisCache( mod, bmod );
 #if !XASH_DEDICATED
 		Mod_InitDebugHulls( mod );	// FIXME: build hulls for separate bmodels (shells, medkits etc)
 		world.deluxedata = bmod->deluxedata_out;	// deluxemap data pointer
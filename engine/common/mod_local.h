@@ -105,6 +105,13 @@ typedef struct world_static_s
 	size_t		visbytes;		// cluster size
 	size_t		fatbytes;		// fatpvs size
 
+	// decompressed visibility cache, rows are read-only after load
+	byte		*pvscache;	// visclusters rows of visstride bytes
+	byte		**phscache;	// memoized fat PHS rows, filled on demand
+	size_t		visstride;	// cache row size
+	size_t		viscachesize;	// memory used by both caches
+	int		visclusters;
+
 	// world bounds
 	vec3_t		mins;		// real accuracy world bounds
 	vec3_t		maxs;
@@ -123,6 +130,7 @@ extern poolhandle_t     com_studiocache;
 extern convar_t		mod_studiocache;
 extern convar_t		r_wadtextures;
 extern convar_t		r_showhull;
+extern convar_t		mod_viscache;
 
 //
 // model.c
@@ -159,6 +167,7 @@ int Mod_SaveLump( const char *filename, const int lump, void *lumpdata, int lump
 mleaf_t *Mod_PointInLeaf( const vec3_t p, mnode_t *node );
 int Mod_SampleSizeForFace( const msurface_t *surf );
 byte *Mod_GetPVSForPoint( const vec3_t p );
+byte *Mod_GetFatPHSForPoint( const vec3_t p, byte *visbuffer, qboolean fullvis );
 void Mod_UnloadBrushModel( model_t *mod );
 void Mod_PrintWorldStats_f( void );
 
@@ -26,13 +26,22 @@ GNU General Public License for more details.
 
 using namespace engine;
 
+#define MOD_HASH_SIZE	( MAX_MODELS >> 2 )
+
 static model_info_t	mod_crcinfo[MAX_MODELS];
 static model_t	mod_known[MAX_MODELS];
 static int	mod_numknown = 0;
+
+// name lookup, slots are stored +1 so zero is the end of chain
+static int	mod_hash[MOD_HASH_SIZE];
+static int	mod_hashnext[MAX_MODELS];
+static int	mod_hashkey[MAX_MODELS];	// bucket + 1 while slot is linked
+static uint	mod_freeslots[( MAX_MODELS + 31 ) / 32];	// free slots below mod_numknown
 poolhandle_t      com_studiocache;		// cache for submodels
 CVAR_DEFINE( mod_studiocache, "r_studiocache", "1", FCVAR_ARCHIVE, "enables studio cache for speedup tracing hitboxes" );
 CVAR_DEFINE_AUTO( r_wadtextures, "0", 0, "completely ignore textures in the bsp-file if enabled" );
 CVAR_DEFINE_AUTO( r_showhull, "0", 0, "draw collision hulls 1-3" );
+CVAR_DEFINE_AUTO( mod_viscache, "32", FCVAR_ARCHIVE, "memory limit in megabytes for decompressed PVS and fat PHS cache, 0 disables it" );
 
 /*
 ===============================================================================
@@ -67,6 +76,77 @@ static void Mod_Modellist_f( void )
 	Con_Printf( "\n" );
 }
 
+/*
+================
+Mod_LinkSlot
+
+slot got a name
+================
+*/
+static void Mod_LinkSlot( int i )
+{
+	int key = COM_HashKey( mod_known[i].name, MOD_HASH_SIZE );
+
+	mod_hashnext[i] = mod_hash[key];
+	mod_hash[key] = i + 1;
+	mod_hashkey[i] = key + 1;
+	ClearBits( mod_freeslots[i >> 5], BIT( i & 31 ));
+}
+
+/*
+================
+Mod_UnlinkSlot
+
+slot is free now
+================
+*/
+static void Mod_UnlinkSlot( int i )
+{
+	int *link;
+
+	if( mod_hashkey[i] )
+	{
+		for( link = &mod_hash[mod_hashkey[i] - 1]; *link; link = &mod_hashnext[*link - 1] )
+		{
+			if( *link == i + 1 )
+			{
+				*link = mod_hashnext[i];
+				break;
+			}
+		}
+
+		mod_hashkey[i] = 0;
+	}
+
+	SetBits( mod_freeslots[i >> 5], BIT( i & 31 ));
+}
+
+/*
+================
+Mod_FirstFreeSlot
+
+lowest slot is taken, so world always gets slot 0
+================
+*/
+static int Mod_FirstFreeSlot( void )
+{
+	int i, j;
+
+	for( i = 0; i < ARRAYSIZE( mod_freeslots ) && ( i << 5 ) < mod_numknown; i++ )
+	{
+		if( !mod_freeslots[i] )
+			continue;
+
+		for( j = 0; j < 32; j++ )
+		{
+			if( FBitSet( mod_freeslots[i], BIT( j )))
+				return ( i << 5 ) + j;
+		}
+	}
+
+	return mod_numknown;
+}
+
 /*
 ================
 Mod_FreeUserData
@@ -116,8 +196,17 @@ void Mod_FreeModel( model_t *mod )
 		world.version = 0;
 		world.shadowdata = NULL;
 		world.deluxedata = NULL;
+
+		// allocated in model pool
+		world.pvscache = NULL;
+		world.phscache = NULL;
+		world.viscachesize = 0;
+		world.visclusters = 0;
 	}
 
+	if( mod >= mod_known && mod < mod_known + mod_numknown )
+		Mod_UnlinkSlot( mod - mod_known );
+
 	memset( mod, 0, sizeof( *mod ));
 }
 
@@ -139,6 +228,7 @@ void Mod_Init( void )
 	Cvar_RegisterVariable( &mod_studiocache );
 	Cvar_RegisterVariable( &r_wadtextures );
 	Cvar_RegisterVariable( &r_showhull );
+	Cvar_RegisterVariable( &mod_viscache );
 
 	Cmd_AddCommand( "mapstats", Mod_PrintWorldStats_f, "show stats for currently loaded map" );
 	Cmd_AddCommand( "modellist", Mod_Modellist_f, "display loaded models list" );
@@ -162,6 +252,10 @@ void Mod_FreeAll( void )
 	for( i = 0; i < mod_numknown; i++ )
 		Mod_FreeModel( &mod_known[i] );
 	mod_numknown = 0;
+
+	memset( mod_hash, 0, sizeof( mod_hash ));
+	memset( mod_hashkey, 0, sizeof( mod_hashkey ));
+	memset( mod_freeslots, 0, sizeof( mod_freeslots ));
 }
 
 /*
@@ -211,8 +305,10 @@ model_t *Mod_FindName( const char *filename, qboolean trackCRC )
 	Q_strncpy( modname, filename, sizeof( modname ));
 
 	// search the currently loaded models
-	for( i = 0, mod = mod_known; i < mod_numknown; i++, mod++ )
+	for( i = mod_hash[COM_HashKey( modname, MOD_HASH_SIZE )]; i; i = mod_hashnext[i - 1] )
 	{
+		mod = &mod_known[i - 1];
+
 		if( !Q_stricmp( mod->name, modname ))
 		{
 			if( mod->mempool || mod->name[0] == '*' )
@@ -224,8 +320,8 @@ model_t *Mod_FindName( const char *filename, qboolean trackCRC )
 	}
 
 	// find a free model slot spot
-	for( i = 0, mod = mod_known; i < mod_numknown; i++, mod++ )
-		if( !COM_CheckStringEmpty( mod->name ) ) break; // this is a valid spot
+	i = Mod_FirstFreeSlot();
+	mod = &mod_known[i];
 
 	if( i == mod_numknown )
 	{
@@ -234,8 +330,12 @@ model_t *Mod_FindName( const char *filename, qboolean trackCRC )
 		mod_numknown++;
 	}
 
+	// slot could be cleared without Mod_FreeModel
+	Mod_UnlinkSlot( i );
+
 	// copy name, so model loader can find model file
 	Q_strncpy( mod->name, modname, sizeof( mod->name ));
+	Mod_LinkSlot( i );
 	if( trackCRC ) mod_crcinfo[i].flags = FCRC_SHOULD_CHECKSUM;
 	else mod_crcinfo[i].flags = 0;
 	mod->needload = NL_NEEDS_LOADED;
@@ -278,6 +378,7 @@ model_t *Mod_LoadModel( model_t *mod, qboolean crash )
 
 	if( !buf )
 	{
+		Mod_UnlinkSlot( mod - mod_known );
 		memset( mod, 0, sizeof( model_t ));
 
 		if( crash ) Host_Error( "Could not load model %s from disk\n", tempname );
@@ -278,7 +278,7 @@ void MSG_WriteBitLong( sizebuf_t *sb, uint data, int numbits, qboolean bSigned )
 	else MSG_WriteUBitLong( sb, data, numbits );
 }
 
-qboolean MSG_WriteBits( sizebuf_t *sb, const void *pData, int nBits )
+static qboolean MSG_WriteBitsSlow( sizebuf_t *sb, const void *pData, int nBits )
 {
 	byte	*pOut = (byte *)pData;
 	int	nBitsLeft = nBits;
@@ -319,6 +319,73 @@ qboolean MSG_WriteBits( sizebuf_t *sb, const void *pData, int nBits )
 	return !sb->bOverflow;
 }
 
+/*
+=======================
+MSG_WriteBitsShifted
+
+assemble whole dwords of the buffer in a 64-bit
+accumulator instead of masking every 32 bits in
+=======================
+*/
+static void MSG_WriteBitsShifted( sizebuf_t *sb, const byte *pIn, int nBits )
+{
+	uint32_t	*pOut = (uint32_t *)sb->pData + ( sb->iCurBit >> 5 );
+	int	shift = sb->iCurBit & 31;
+	int	i, numwords = nBits >> 5;
+	uint64_t	acc;
+	uint32_t	word;
+
+	acc = *pOut & ExtraMasks[shift]; // keep what's already written
+
+	for( i = 0; i < numwords; i++, pIn += 4 )
+	{
+		memcpy( &word, pIn, 4 );
+		acc |= (uint64_t)word << shift;
+		*pOut++ = (uint32_t)acc;
+		acc >>= 32;
+	}
+
+	if( numwords && shift )
+		*pOut = ( *pOut & ~ExtraMasks[shift] ) | (uint32_t)acc;
+
+	sb->iCurBit += numwords << 5;
+	nBits &= 31;
+
+	for( ; nBits >= 8; nBits -= 8, pIn++ )
+		MSG_WriteUBitLong( sb, *pIn, 8 );
+
+	if( nBits )
+		MSG_WriteUBitLong( sb, *pIn, nBits );
+}
+
+qboolean MSG_WriteBits( sizebuf_t *sb, const void *pData, int nBits )
+{
+#if !XASH_BIG_ENDIAN
+	const byte	*pIn = (const byte *)pData;
+	int		nBytes = nBits >> 3;
+
+	// overflows keep the old partial write behaviour
+	if( nBits > 0 && sb->iCurBit + nBits <= sb->nDataBits )
+	{
+		if( sb->iCurBit & 7 )
+		{
+			MSG_WriteBitsShifted( sb, pIn, nBits );
+			return !sb->bOverflow;
+		}
+
+		// byte aligned, plain copy
+		memcpy( sb->pData + ( sb->iCurBit >> 3 ), pIn, nBytes );
+		sb->iCurBit += nBytes << 3;
+
+		if( nBits & 7 )
+			MSG_WriteUBitLong( sb, pIn[nBytes], nBits & 7 );
+
+		return !sb->bOverflow;
+	}
+#endif
+	return MSG_WriteBitsSlow( sb, pData, nBits );
+}
+
 void MSG_WriteBitAngle( sizebuf_t *sb, float fAngle, int numbits )
 {
 	uint	mask, shift;
@@ -428,15 +495,11 @@ qboolean MSG_WriteBytes( sizebuf_t *sb, const void *pBuf, int nBytes )
 
 qboolean MSG_WriteString( sizebuf_t *sb, const char *pStr )
 {
+	// same bits as writing it char by char, terminator included
 	if( pStr )
-	{
-		do
-		{
-			MSG_WriteChar( sb, (signed char)*pStr );
-			pStr++;
-		} while( *( pStr - 1 ));
-	}
-	else MSG_WriteChar( sb, 0 );
+		return MSG_WriteBytes( sb, pStr, Q_strlen( pStr ) + 1 );
+
+	MSG_WriteChar( sb, 0 );
 
 	return !sb->bOverflow;
 }
@@ -512,7 +575,7 @@ uint MSG_ReadUBitLong( sizebuf_t *sb, int numbits )
 	return ret;
 }
 
-qboolean MSG_ReadBits( sizebuf_t *sb, void *pOutData, int nBits )
+static qboolean MSG_ReadBitsSlow( sizebuf_t *sb, void *pOutData, int nBits )
 {
 	byte	*pOut = (byte *)pOutData;
 	int	nBitsLeft = nBits;
@@ -550,6 +613,71 @@ qboolean MSG_ReadBits( sizebuf_t *sb, void *pOutData, int nBits )
 	return !sb->bOverflow;
 }
 
+/*
+=======================
+MSG_ReadBitsShifted
+
+pull whole dwords out of a 64-bit accumulator
+=======================
+*/
+static void MSG_ReadBitsShifted( sizebuf_t *sb, byte *pOut, int nBits )
+{
+	const uint32_t	*pIn = (const uint32_t *)sb->pData + ( sb->iCurBit >> 5 );
+	int		shift = sb->iCurBit & 31;
+	int		i, numwords = nBits >> 5;
+	uint64_t		acc;
+	uint32_t		word;
+
+	// shift is never zero here, so every dword
+	// read spans into the next one which is in range
+	acc = pIn[0];
+
+	for( i = 0; i < numwords; i++, pOut += 4 )
+	{
+		acc |= (uint64_t)pIn[i+1] << 32;
+		word = (uint32_t)( acc >> shift );
+		memcpy( pOut, &word, 4 );
+		acc >>= 32;
+	}
+
+	sb->iCurBit += numwords << 5;
+	nBits &= 31;
+
+	for( ; nBits >= 8; nBits -= 8, pOut++ )
+		*pOut = MSG_ReadUBitLong( sb, 8 );
+
+	if( nBits )
+		*pOut = MSG_ReadUBitLong( sb, nBits );
+}
+
+qboolean MSG_ReadBits( sizebuf_t *sb, void *pOutData, int nBits )
+{
+#if !XASH_BIG_ENDIAN
+	byte	*pOut = (byte *)pOutData;
+	int	nBytes = nBits >> 3;
+
+	// overflows keep the old partial read behaviour
+	if( nBits > 0 && sb->iCurBit + nBits <= sb->nDataBits )
+	{
+		if( sb->iCurBit & 7 )
+		{
+			MSG_ReadBitsShifted( sb, pOut, nBits );
+			return !sb->bOverflow;
+		}
+
+		// byte aligned, plain copy
+		memcpy( pOut, sb->pData + ( sb->iCurBit >> 3 ), nBytes );
+		sb->iCurBit += nBytes << 3;
+
+		if( nBits & 7 )
+			pOut[nBytes] = MSG_ReadUBitLong( sb, nBits & 7 );
+
+		return !sb->bOverflow;
+	}
+#endif
+	return MSG_ReadBitsSlow( sb, pOutData, nBits );
+}
+
 float MSG_ReadBitAngle( sizebuf_t *sb, int numbits )
 {
 	float	fReturn, shift;
@@ -681,8 +809,13 @@ char *MSG_ReadStringExt( sizebuf_t *sb, qboolean bLine )
 
 	do
 	{
-		// use MSG_ReadByte so -1 is out of bounds
-		c = MSG_ReadByte( sb );
+		// byte aligned reads skip the bit reader
+		if( !( sb->iCurBit & 7 ) && sb->iCurBit + 8 <= sb->nDataBits )
+		{
+			c = sb->pData[sb->iCurBit >> 3];
+			sb->iCurBit += 8;
+		}
+		else c = MSG_ReadByte( sb ); // use MSG_ReadByte so -1 is out of bounds
 
 		if( c == 0 ) break;
 		else if( bLine && c == '\n' )
@@ -709,7 +842,14 @@ void MSG_ExciseBits( sizebuf_t *sb, int startbit, int bitstoremove )
 	MSG_StartWriting( &temp, sb->pData, MSG_GetMaxBytes( sb ), startbit, -1 );
 	MSG_SeekToBit( sb, endbit, SEEK_SET );
 
-	for( i = 0; i < remaining_to_end; i++ )
+	// a dword is read before it's written back, so moving
+	// the tail down over itself is safe 32 bits at a time
+	for( i = 0; i + 32 <= remaining_to_end; i += 32 )
+	{
+		MSG_WriteUBitLong( &temp, MSG_ReadUBitLong( sb, 32 ), 32 );
+	}
+
+	for( ; i < remaining_to_end; i++ )
 	{
 		MSG_WriteOneBit( &temp, MSG_ReadOneBit( sb ));
 	}
@@ -717,3 +857,223 @@ void MSG_ExciseBits( sizebuf_t *sb, int startbit, int bitstoremove )
 	MSG_SeekToBit( sb, startbit, SEEK_SET );
 	sb->nDataBits -= bitstoremove;
 }
+
+#if XASH_ENGINE_TESTS
+
+#include "tests.h"
+
+#define TEST_MSG_BYTES	512
+
+static qboolean Test_MsgGetBit( const void *data, int bit )
+{
+	return ((const byte *)data)[bit >> 3] & BIT( bit & 7 ) ? true : false;
+}
+
+static qboolean Test_MsgBitsEqual( const void *a, int abit, const void *b, int bbit, int nBits )
+{
+	int	i;
+
+	for( i = 0; i < nBits; i++ )
+	{
+		if( Test_MsgGetBit( a, abit + i ) != Test_MsgGetBit( b, bbit + i ))
+			return false;
+	}
+
+	return true;
+}
+
+static int Test_MsgWriteRead( void )
+{
+	uint32_t	fast[TEST_MSG_BYTES / 4 + 2], slow[TEST_MSG_BYTES / 4 + 2];
+	byte	src[TEST_MSG_BYTES + 16], out1[TEST_MSG_BYTES + 16], out2[TEST_MSG_BYTES + 16];
+	int	i, j, start, nBits, srcoff, mismatches = 0;
+	qboolean	ret1, ret2;
+	sizebuf_t	a, b;
+
+	for( i = 0; i < 20000; i++ )
+	{
+		for( j = 0; j < (int)sizeof( fast ); j++ )
+			((byte *)fast)[j] = ((byte *)slow)[j] = COM_RandomLong( 0, 255 );
+		for( j = 0; j < (int)sizeof( src ); j++ )
+			src[j] = COM_RandomLong( 0, 255 );
+
+		// some of them run past the end
+		start = COM_RandomLong( 0, 95 );
+		nBits = COM_RandomLong( 0, TEST_MSG_BYTES * 8 - start + 64 );
+		srcoff = COM_RandomLong( 0, 3 );
+
+		MSG_StartWriting( &a, fast, TEST_MSG_BYTES, start, -1 );
+		MSG_StartWriting( &b, slow, TEST_MSG_BYTES, start, -1 );
+
+		ret1 = MSG_WriteBits( &a, src + srcoff, nBits );
+		ret2 = MSG_WriteBitsSlow( &b, src + srcoff, nBits );
+
+		if( ret1 != ret2 || a.iCurBit != b.iCurBit || a.bOverflow != b.bOverflow
+			|| !Test_MsgBitsEqual( fast, 0, slow, 0, a.iCurBit ))
+		{
+			mismatches++;
+			continue;
+		}
+
+		if( a.bOverflow )
+			continue;
+
+		if( !Test_MsgBitsEqual( fast, start, src + srcoff, 0, nBits ))
+		{
+			mismatches++;
+			continue;
+		}
+
+		memset( out1, 0, sizeof( out1 ));
+		memset( out2, 0, sizeof( out2 ));
+		MSG_StartReading( &a, fast, TEST_MSG_BYTES, start, -1 );
+		MSG_StartReading( &b, fast, TEST_MSG_BYTES, start, -1 );
+
+		ret1 = MSG_ReadBits( &a, out1 + srcoff, nBits );
+		ret2 = MSG_ReadBitsSlow( &b, out2 + srcoff, nBits );
+
+		if( ret1 != ret2 || a.iCurBit != b.iCurBit || memcmp( out1, out2, sizeof( out1 ))
+			|| !Test_MsgBitsEqual( out1 + srcoff, 0, src + srcoff, 0, nBits ))
+			mismatches++;
+	}
+
+	return mismatches;
+}
+
+static int Test_MsgStrings( void )
+{
+	uint32_t	fast[TEST_MSG_BYTES / 4], slow[TEST_MSG_BYTES / 4];
+	char	str[128];
+	int	i, j, len, start, mismatches = 0;
+	sizebuf_t	a, b;
+
+	for( i = 0; i < 5000; i++ )
+	{
+		len = COM_RandomLong( 0, sizeof( str ) - 1 );
+		for( j = 0; j < len; j++ )
+			str[j] = COM_RandomLong( 'a', 'z' );
+		str[len] = 0;
+
+		start = COM_RandomLong( 0, 95 );
+		memset( fast, 0, sizeof( fast ));
+		memset( slow, 0, sizeof( slow ));
+		MSG_StartWriting( &a, fast, sizeof( fast ), start, -1 );
+		MSG_StartWriting( &b, slow, sizeof( slow ), start, -1 );
+
+		MSG_WriteString( &a, str );
+		for( j = 0; j <= len; j++ )
+			MSG_WriteChar( &b, str[j] );
+
+		if( a.iCurBit != b.iCurBit || !Test_MsgBitsEqual( fast, 0, slow, 0, a.iCurBit ))
+		{
+			mismatches++;
+			continue;
+		}
+
+		MSG_StartReading( &a, fast, sizeof( fast ), start, -1 );
+		if( Q_strcmp( MSG_ReadString( &a ), str ) || a.iCurBit != b.iCurBit )
+			mismatches++;
+	}
+
+	return mismatches;
+}
+
+static int Test_MsgExcise( void )
+{
+	uint32_t	buf[TEST_MSG_BYTES / 4], orig[TEST_MSG_BYTES / 4];
+	int	i, j, startbit, bitstoremove, mismatches = 0;
+	sizebuf_t	sb;
+
+	for( i = 0; i < 2000; i++ )
+	{
+		for( j = 0; j < (int)sizeof( buf ); j++ )
+			((byte *)buf)[j] = COM_RandomLong( 0, 255 );
+		memcpy( orig, buf, sizeof( buf ));
+
+		startbit = COM_RandomLong( 0, TEST_MSG_BYTES * 8 - 1 );
+		bitstoremove = COM_RandomLong( 0, TEST_MSG_BYTES * 8 - startbit );
+
+		MSG_StartWriting( &sb, buf, sizeof( buf ), 0, -1 );
+		MSG_ExciseBits( &sb, startbit, bitstoremove );
+
+		if( sb.nDataBits != TEST_MSG_BYTES * 8 - bitstoremove || sb.iCurBit != startbit
+			|| !Test_MsgBitsEqual( buf, 0, orig, 0, startbit )
+			|| !Test_MsgBitsEqual( buf, startbit, orig, startbit + bitstoremove, sb.nDataBits - startbit ))
+			mismatches++;
+	}
+
+	return mismatches;
+}
+
+static void Test_MsgBenchmark( void )
+{
+	static uint32_t	buf[2048];
+	byte		payload[1400];
+	int		i, offset, iterations = 20000;
+	double		start, slow, fast;
+	sizebuf_t		sb;
+
+	for( i = 0; i < (int)sizeof( payload ); i++ )
+		payload[i] = COM_RandomLong( 0, 255 );
+
+	// netchan fragments land byte aligned, delta copies usually don't
+	for( offset = 0; offset < 8; offset += 3 )
+	{
+		start = Sys_DoubleTime();
+		for( i = 0; i < iterations; i++ )
+		{
+			MSG_StartWriting( &sb, buf, sizeof( buf ), offset, -1 );
+			MSG_WriteBitsSlow( &sb, payload, sizeof( payload ) * 8 );
+		}
+		slow = Sys_DoubleTime() - start;
+
+		start = Sys_DoubleTime();
+		for( i = 0; i < iterations; i++ )
+		{
+			MSG_StartWriting( &sb, buf, sizeof( buf ), offset, -1 );
+			MSG_WriteBits( &sb, payload, sizeof( payload ) * 8 );
+		}
+		fast = Sys_DoubleTime() - start;
+
+		Msg( "MSG_WriteBits at bit %i: %.3f ms old, %.3f ms new\n", offset, slow * 1000.0, fast * 1000.0 );
+
+		start = Sys_DoubleTime();
+		for( i = 0; i < iterations; i++ )
+		{
+			MSG_StartReading( &sb, buf, sizeof( buf ), offset, -1 );
+			MSG_ReadBitsSlow( &sb, payload, sizeof( payload ) * 8 );
+		}
+		slow = Sys_DoubleTime() - start;
+
+		start = Sys_DoubleTime();
+		for( i = 0; i < iterations; i++ )
+		{
+			MSG_StartReading( &sb, buf, sizeof( buf ), offset, -1 );
+			MSG_ReadBits( &sb, payload, sizeof( payload ) * 8 );
+		}
+		fast = Sys_DoubleTime() - start;
+
+		Msg( "MSG_ReadBits at bit %i: %.3f ms old, %.3f ms new\n", offset, slow * 1000.0, fast * 1000.0 );
+	}
+}
+
+void Test_RunMsg( void )
+{
+	int	mismatches;
+
+	MSG_InitMasks();
+
+	Msg( "Checking bit buffer fast paths against the old ones...\n" );
+
+	mismatches = Test_MsgWriteRead();
+	TASSERT_EQi( mismatches, 0 );
+
+	mismatches = Test_MsgStrings();
+	TASSERT_EQi( mismatches, 0 );
+
+	mismatches = Test_MsgExcise();
+	TASSERT_EQi( mismatches, 0 );
+
+	Test_MsgBenchmark();
+}
+#endif
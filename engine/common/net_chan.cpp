@@ -19,6 +19,9 @@ GNU General Public License for more details.
 #include "net_encode.h"
 #include "protocol.h"
 #include <sky/sky.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <gl_export.h>
 #include "client.h"
 
@@ -33,10 +36,28 @@ using namespace engine;
 #define FLOW_AVG			( 2.0f / 3.0f )	// how fast to converge flow estimates
 #define FLOW_INTERVAL		0.1		// don't compute more often than this
 #define MAX_RELIABLE_PAYLOAD		1400		// biggest packet that has frag and or reliable data
+#define FILESOURCE_MAXLOAD		( 16 * 1024 * 1024 )	// files up to this size are kept in memory
+#define FILESOURCE_WINDOW		( 256 * 1024 )	// read-ahead for bigger files
+
+// file sent to remote hosts, shared by all channels and fragments that read it
+typedef struct netfilesource_s
+{
+	struct netfilesource_s	*next;
+	char		name[MAX_OSPATH];
+	int		filetime;
+	fs_offset_t	size;
+	int		refcount;		// fragment buffers still referencing it
+	byte		*data;		// whole file
+	file_t		*file;		// or file handle with read-ahead window
+	byte		*window;
+	fs_offset_t	windowpos;
+	int		windowlen;
+} netfilesource_t;
 
 // forward declarations
 void Netchan_FlushIncoming( netchan_t *chan, int stream );
 void Netchan_AddBufferToList( fragbuf_t **pplist, fragbuf_t *pbuf );
+static void Netchan_StopPrecompress( void );
 
 /*
 packet header ( size in bits )
@@ -93,11 +114,13 @@ CVAR_DEFINE_AUTO( net_showpackets, "0", 0, "show network packets" );
 CVAR_DEFINE_AUTO( net_chokeloop, "0", 0, "apply bandwidth choke to loopback packets" );
 CVAR_DEFINE_AUTO( net_showdrop, "0", 0, "show packets that are dropped" );
 CVAR_DEFINE_AUTO( net_qport, "0", FCVAR_READ_ONLY, "current quake netport" );
+CVAR_DEFINE_AUTO( net_precompress_cache, "64", FCVAR_ARCHIVE, "size limit of precompressed downloads cache in megabytes" );
 
 int	net_drop;
 netadr_t	net_from;
 sizebuf_t	net_message;
 static poolhandle_t net_mempool;
+static netfilesource_t *net_filesources;
 byte	net_message_buffer[NET_MAX_MESSAGE];
 
 const char *ns_strings[NS_COUNT] =
@@ -241,6 +264,73 @@ static void NetSplit_SendLong( netsrc_t sock, size_t length, void *data, netadr_
 
 }
 
+/*
+===============
+Netchan_CompressBench_f
+
+compare fragment codecs on game files
+===============
+*/
+static void Netchan_CompressBench_f( void )
+{
+	const char	*names[] = { "lzss", "fast", "best" };
+	int		i, type;
+
+	if( Cmd_Argc() < 2 )
+	{
+		Con_Printf( S_USAGE "net_compressbench <file> [file...]\n" );
+		return;
+	}
+
+	for( i = 1; i < Cmd_Argc(); i++ )
+	{
+		fs_offset_t	size;
+		byte		*data = FS_LoadFile( Cmd_Argv( i ), &size, false );
+		byte		*check;
+
+		if( !data || size <= 0 )
+		{
+			Con_Printf( S_ERROR "can't load %s\n", Cmd_Argv( i ));
+			if( data ) Mem_Free( data );
+			continue;
+		}
+
+		Con_Printf( "%s, %s\n", Cmd_Argv( i ), Q_memprint( size ));
+		check = (byte *)Mem_Malloc( net_mempool, size );
+
+		for( type = COMPRESS_LZSS; type <= COMPRESS_BEST; type++ )
+		{
+			double	start, compressed, decompressed;
+			uint	outsize = 0, checksize;
+			byte	*out;
+
+			start = Sys_DoubleTime();
+			out = COM_Compress( (compressor_t)type, data, size, &outsize );
+			compressed = Sys_DoubleTime();
+
+			if( !out )
+			{
+				Con_Printf( "  %s: not compressible\n", names[type] );
+				continue;
+			}
+
+			checksize = COM_Decompress( out, outsize, check, size );
+			decompressed = Sys_DoubleTime();
+
+			Con_Printf( "  %s: %s (%.1f%%), compress %.1f MB/s, decompress %.1f MB/s%s\n",
+				names[type], Q_memprint( outsize ), outsize * 100.0 / size,
+				size / ( 1024.0 * 1024.0 ) / Q_max( compressed - start, 0.000001 ),
+				size / ( 1024.0 * 1024.0 ) / Q_max( decompressed - compressed, 0.000001 ),
+				( checksize != size || memcmp( check, data, size )) ? ", ^1MISMATCH^7" : "" );
+
+			free( out );
+		}
+
+		Mem_Free( check );
+		Mem_Free( data );
+	}
+}
+
 /*
 ===============
 Netchan_Init
@@ -259,18 +349,166 @@ void Netchan_Init( void )
 	Cvar_RegisterVariable( &net_chokeloop );
 	Cvar_RegisterVariable( &net_showdrop );
 	Cvar_RegisterVariable( &net_qport );
+	Cvar_RegisterVariable( &net_precompress_cache );
 	Cvar_FullSet( net_qport.name, buf, net_qport.flags );
 
 	net_mempool = Mem_AllocPool( "Network Pool" );
 
+	Cmd_AddCommand( "net_compressbench", Netchan_CompressBench_f, "compare compression of fragments and file transfers on given files" );
+
 	MSG_InitMasks();	// initialize bit-masks
 }
 
 void Netchan_Shutdown( void )
 {
+	netfilesource_t	*src;
+
+	for( src = net_filesources; src; src = src->next )
+	{
+		if( src->file )
+			FS_Close( src->file );
+	}
+
+	net_filesources = NULL;
+	Netchan_StopPrecompress();
 	Mem_FreePool( &net_mempool );
 }
 
+/*
+==============================
+Netchan_OpenFileSource
+
+find file already being sent or open it,
+caller must reference it from fragment buffers
+==============================
+*/
+static netfilesource_t *Netchan_OpenFileSource( const char *name )
+{
+	netfilesource_t	*src;
+	int		filetime = FS_FileTime( name, false );
+	fs_offset_t	size = FS_FileSize( name, false );
+
+	if( size <= 0 )
+		return NULL;
+
+	for( src = net_filesources; src; src = src->next )
+	{
+		// rewritten file gets new source, old one serves its remaining fragments
+		if( !Q_strcmp( src->name, name ) && src->filetime == filetime && src->size == size )
+			return src;
+	}
+
+	src = (netfilesource_t *)Mem_Calloc( net_mempool, sizeof( *src ));
+	Q_strncpy( src->name, name, sizeof( src->name ));
+	src->filetime = filetime;
+	src->size = size;
+
+	if( size <= FILESOURCE_MAXLOAD )
+	{
+		fs_offset_t	length;
+
+		src->data = FS_LoadFile( name, &length, false );
+
+		if( src->data && length != size )
+		{
+			Mem_Free( src->data );
+			src->data = NULL;
+		}
+	}
+
+	if( !src->data )
+	{
+		if(( src->file = FS_Open( name, "rb", false )) == NULL )
+		{
+			Mem_Free( src );
+			return NULL;
+		}
+
+		src->window = (byte *)Mem_Malloc( net_mempool, FILESOURCE_WINDOW );
+	}
+
+	src->next = net_filesources;
+	net_filesources = src;
+
+	return src;
+}
+
+/*
+==============================
+Netchan_ReleaseFileSource
+
+evict when last fragment is gone
+==============================
+*/
+static void Netchan_ReleaseFileSource( netfilesource_t *src )
+{
+	netfilesource_t	**link;
+
+	if( !src || --src->refcount > 0 )
+		return;
+
+	for( link = &net_filesources; *link; link = &( *link )->next )
+	{
+		if( *link == src )
+		{
+			*link = src->next;
+			break;
+		}
+	}
+
+	if( src->file )
+		FS_Close( src->file );
+
+	if( src->data )
+		Mem_Free( src->data );
+
+	if( src->window )
+		Mem_Free( src->window );
+
+	Mem_Free( src );
+}
+
+/*
+==============================
+Netchan_ReadFileSource
+
+==============================
+*/
+static qboolean Netchan_ReadFileSource( netfilesource_t *src, fs_offset_t offset, byte *out, int size )
+{
+	if( offset < 0 || size < 0 || offset + size > src->size )
+		return false;
+
+	if( src->data )
+	{
+		memcpy( out, src->data + offset, size );
+		return true;
+	}
+
+	// refill read-ahead window starting at requested fragment
+	if( offset < src->windowpos || offset + size > src->windowpos + src->windowlen )
+	{
+		int	length = Q_min( src->size - offset, (fs_offset_t)FILESOURCE_WINDOW );
+
+		if( size > FILESOURCE_WINDOW )
+			return false;
+
+		FS_Seek( src->file, offset, SEEK_SET );
+
+		if( FS_Read( src->file, src->window, length ) != length )
+		{
+			src->windowlen = 0;
+			return false;
+		}
+
+		src->windowpos = offset;
+		src->windowlen = length;
+	}
+
+	memcpy( out, src->window + ( offset - src->windowpos ), size );
+	return true;
+}
+
 void Netchan_ReportFlow( netchan_t *chan )
 {
 	char	incoming[64];
@@ -385,6 +623,7 @@ static void Netchan_UnlinkFragment( fragbuf_t *buf, fragbuf_t **list )
 		*list = buf->next;
 
 		// destroy remnant
+		Netchan_ReleaseFileSource( buf->source );
 		Mem_Free( buf );
 		return;
 	}
@@ -397,6 +636,7 @@ static void Netchan_UnlinkFragment( fragbuf_t *buf, fragbuf_t **list )
 			search->next = buf->next;
 
 			// destroy remnant
+			Netchan_ReleaseFileSource( buf->source );
 			Mem_Free( buf );
 			return;
 		}
@@ -422,6 +662,7 @@ static void Netchan_ClearFragbufs( fragbuf_t **ppbuf )
 	while( buf )
 	{
 		n = buf->next;
+		Netchan_ReleaseFileSource( buf->source );
 		Mem_Free( buf->frag_message_buf );
 		Mem_Free( buf );
 		buf = n;
@@ -723,11 +964,11 @@ static void Netchan_CreateFragments_( netchan_t *chan, sizebuf_t *msg )
 
 	wait = (fragbufwaiting_t *)Mem_Calloc( net_mempool, sizeof( fragbufwaiting_t ));
 
-	if( !LZSS_IsCompressed( MSG_GetData( msg )))
+	if( !COM_IsCompressed( MSG_GetData( msg )))
 	{
 		uint	uCompressedSize = 0;
 		uint	uSourceSize = MSG_GetNumBytesWritten( msg );
-		byte	*pbOut = LZSS_Compress( msg->pData, uSourceSize, &uCompressedSize );
+		byte	*pbOut = COM_Compress( chan->compression != COMPRESS_LZSS ? COMPRESS_FAST : COMPRESS_LZSS, msg->pData, uSourceSize, &uCompressedSize );
 
 		if( pbOut && uCompressedSize > 0 && uCompressedSize < uSourceSize )
 		{
@@ -882,10 +1123,10 @@ void Netchan_CreateFileFragmentsFromBuffer( netchan_t *chan, const char *filenam
 		chunksize = chan->pfnBlockSize( chan->client, FRAGSIZE_FRAG );
 	else chunksize = FRAGMENT_MAX_SIZE; // fallback
 
-	if( !LZSS_IsCompressed( pbuf ))
+	if( !COM_IsCompressed( pbuf ))
 	{
 		uint	uCompressedSize = 0;
-		byte	*pbOut = LZSS_Compress( pbuf, size, &uCompressedSize );
+		byte	*pbOut = COM_Compress( chan->compression != COMPRESS_LZSS ? COMPRESS_FAST : COMPRESS_LZSS, pbuf, size, &uCompressedSize );
 
 		if( pbOut && uCompressedSize > 0 && uCompressedSize < size )
 		{
@@ -949,6 +1190,444 @@ void Netchan_CreateFileFragmentsFromBuffer( netchan_t *chan, const char *filenam
 	}
 }
 
+/*
+==============================
+
+	Download precompression
+
+	compressed copies of downloadable files are made by worker thread
+	and stored as ztmp/<md5 of contents>.<ext>, so unchanged or
+	duplicated files are never compressed again. the main thread only
+	opens sources and writes results, one file per frame; reading,
+	hashing and compression are done by the worker. copies that no
+	resource of the current map refers to are evicted oldest first
+	once the cache grows past net_precompress_cache megabytes
+
+==============================
+*/
+#define PRECOMP_DIR		"ztmp"
+
+typedef enum
+{
+	PRECOMP_QUEUED = 0,	// waiting for main thread to read it
+	PRECOMP_HASHING,	// worker hashes contents read by main thread
+	PRECOMP_HASHED,	// main thread checks the cache
+	PRECOMP_COMPRESSING,	// worker compresses missing artifacts
+	PRECOMP_COMPRESSED,	// main thread writes them
+	PRECOMP_DONE,
+	PRECOMP_FAILED,
+} precompstate_t;
+
+typedef struct netprecomp_s
+{
+	struct netprecomp_s	*next;
+	char		name[MAX_OSPATH];
+	int		filetime;
+	int		generation;	// last map that asked for it
+	fs_offset_t	size;
+	precompstate_t	state;
+	byte		*data;		// contents, read by main thread
+	char		hash[33];
+	qboolean		need[2];		// lzss, deflate artifacts missing
+	byte		*out[2];
+	uint		outsize[2];
+} netprecomp_t;
+
+typedef struct
+{
+	const char	*name;
+	int		time;
+	fs_offset_t	size;
+} precompfile_t;
+
+static struct
+{
+	netprecomp_t		*jobs;
+	netprecomp_t		*active;	// job owned by the worker
+	int			generation;
+	qboolean			prune;	// cache has to be checked for stale copies
+	std::thread		*thread;
+	std::mutex		lock;
+	std::condition_variable	wake;
+	qboolean			quit;
+} precomp;
+
+static const char *precomp_ext[2] = { "ztmp", "zdfl" };
+
+/*
+==============================
+Netchan_PrecompressWorker
+
+==============================
+*/
+static void Netchan_PrecompressWorker( void )
+{
+	std::unique_lock<std::mutex> lock( precomp.lock );
+
+	while( 1 )
+	{
+		netprecomp_t	*job;
+		int		i;
+
+		precomp.wake.wait( lock, [] { return precomp.quit || ( precomp.active && ( precomp.active->state == PRECOMP_HASHING || precomp.active->state == PRECOMP_COMPRESSING )); } );
+
+		if( precomp.quit )
+			return;
+
+		job = precomp.active;
+		lock.unlock();
+
+		if( job->state == PRECOMP_HASHING )
+		{
+			MD5Context_t	ctx;
+			byte		digest[16];
+
+			MD5Init( &ctx );
+			MD5Update( &ctx, job->data, job->size );
+			MD5Final( digest, &ctx );
+
+			for( i = 0; i < 16; i++ )
+				Q_snprintf( &job->hash[i * 2], 3, "%02x", digest[i] );
+		}
+		else
+		{
+			for( i = 0; i < 2; i++ )
+			{
+				if( job->need[i] )
+					job->out[i] = COM_Compress( i ? COMPRESS_BEST : COMPRESS_LZSS, job->data, job->size, &job->outsize[i] );
+			}
+		}
+
+		lock.lock();
+
+		if( job->state == PRECOMP_HASHING )
+			job->state = PRECOMP_HASHED;
+		else job->state = PRECOMP_COMPRESSED;
+	}
+}
+
+/*
+==============================
+Netchan_FreePrecompressJob
+
+==============================
+*/
+static void Netchan_FreePrecompressJob( netprecomp_t *job )
+{
+	int	i;
+
+	if( job->data )
+		free( job->data );
+
+	for( i = 0; i < 2; i++ )
+	{
+		if( job->out[i] )
+			free( job->out[i] );
+	}
+
+	Mem_Free( job );
+}
+
+/*
+==============================
+Netchan_StopPrecompress
+
+==============================
+*/
+static void Netchan_StopPrecompress( void )
+{
+	netprecomp_t	*job, *next;
+
+	if( precomp.thread )
+	{
+		{
+			std::lock_guard<std::mutex> lock( precomp.lock );
+			precomp.quit = true;
+		}
+
+		precomp.wake.notify_all();
+		precomp.thread->join();
+		delete precomp.thread;
+		precomp.thread = NULL;
+	}
+
+	for( job = precomp.jobs; job; job = next )
+	{
+		next = job->next;
+		Netchan_FreePrecompressJob( job );
+	}
+
+	precomp.jobs = precomp.active = NULL;
+	precomp.quit = false;
+}
+
+/*
+==============================
+Netchan_PrecompressReset
+
+called on map change before resources are queued,
+files new map doesn't ask for are forgotten on next prune
+==============================
+*/
+void Netchan_PrecompressReset( void )
+{
+	std::lock_guard<std::mutex> lock( precomp.lock );
+
+	precomp.generation++;
+	precomp.prune = true;
+}
+
+/*
+==============================
+Netchan_Precompress
+
+queue file for background compression
+==============================
+*/
+void Netchan_Precompress( const char *filename )
+{
+	netprecomp_t	*job;
+	fs_offset_t	size = FS_FileSize( filename, false );
+	int		filetime = FS_FileTime( filename, false );
+
+	if( size <= 0 )
+		return;
+
+	std::lock_guard<std::mutex> lock( precomp.lock );
+
+	for( job = precomp.jobs; job; job = job->next )
+	{
+		if( Q_strcmp( job->name, filename ))
+			continue;
+
+		job->generation = precomp.generation;
+
+		// changed file is compressed again after worker is done with it
+		if(( job->state == PRECOMP_DONE || job->state == PRECOMP_FAILED ) && ( job->size != size || job->filetime != filetime ))
+			job->state = PRECOMP_QUEUED;
+		return;
+	}
+
+	job = (netprecomp_t *)Mem_Calloc( net_mempool, sizeof( *job ));
+	Q_strncpy( job->name, filename, sizeof( job->name ));
+	job->generation = precomp.generation;
+	job->next = precomp.jobs;
+	precomp.jobs = job;
+}
+
+/*
+==============================
+Netchan_SortPrecompressed
+
+oldest first
+==============================
+*/
+static int Netchan_SortPrecompressed( const void *a, const void *b )
+{
+	return ((const precompfile_t *)a)->time - ((const precompfile_t *)b)->time;
+}
+
+/*
+==============================
+Netchan_PrunePrecompressed
+
+evict copies current map doesn't refer to
+while cache is over the limit
+==============================
+*/
+static void Netchan_PrunePrecompressed( void )
+{
+	fs_offset_t	total = 0, limit;
+	precompfile_t	*stale;
+	int		i, numstale = 0;
+	netprecomp_t	*job, **prev;
+	search_t		*t;
+
+	precomp.prune = false;
+
+	// forget files previous maps asked for
+	for( prev = &precomp.jobs; ( job = *prev ) != NULL; )
+	{
+		if( job->generation == precomp.generation || job == precomp.active )
+		{
+			prev = &job->next;
+			continue;
+		}
+
+		*prev = job->next;
+		Netchan_FreePrecompressJob( job );
+	}
+
+	t = FS_Search( PRECOMP_DIR "/*", true, true );
+	if( !t ) return;
+
+	stale = (precompfile_t *)Mem_Malloc( net_mempool, sizeof( *stale ) * t->numfilenames );
+	limit = (fs_offset_t)( Q_max( net_precompress_cache.value, 0.0f ) * 1024.0f * 1024.0f );
+
+	for( i = 0; i < t->numfilenames; i++ )
+	{
+		const char	*name = COM_FileWithoutPath( t->filenames[i] );
+		fs_offset_t	size = FS_FileSize( t->filenames[i], true );
+
+		total += Q_max( size, 0 );
+
+		for( job = precomp.jobs; job; job = job->next )
+		{
+			if( job->generation == precomp.generation && job->hash[0] && !Q_strnicmp( name, job->hash, 32 ))
+				break;
+		}
+
+		if( job ) continue; // still in use
+
+		stale[numstale].name = t->filenames[i];
+		stale[numstale].time = FS_FileTime( t->filenames[i], true );
+		stale[numstale].size = Q_max( size, 0 );
+		numstale++;
+	}
+
+	qsort( stale, numstale, sizeof( *stale ), Netchan_SortPrecompressed );
+
+	for( i = 0; i < numstale && total > limit; i++ )
+	{
+		if( !FS_Delete( stale[i].name ))
+			continue;
+
+		Con_Reportf( "evicted %s from precompressed cache\n", stale[i].name );
+		total -= stale[i].size;
+	}
+
+	Mem_Free( stale );
+	Mem_Free( t );
+}
+
+/*
+==============================
+Netchan_PrecompressFrame
+
+feed the worker, called every server frame
+==============================
+*/
+void Netchan_PrecompressFrame( void )
+{
+	std::unique_lock<std::mutex> lock( precomp.lock );
+	netprecomp_t	*job = precomp.active;
+	file_t		*file;
+	int		i;
+
+	if( job && job->state == PRECOMP_HASHED )
+	{
+		// contents already compressed, by another name or in earlier session
+		for( i = 0; i < 2; i++ )
+			job->need[i] = !FS_FileExists( va( PRECOMP_DIR "/%s.%s", job->hash, precomp_ext[i] ), false );
+
+		if( job->need[0] || job->need[1] )
+		{
+			job->state = PRECOMP_COMPRESSING;
+			lock.unlock();
+			precomp.wake.notify_one();
+			return;
+		}
+
+		job->state = PRECOMP_COMPRESSED;
+	}
+
+	if( job && job->state == PRECOMP_COMPRESSED )
+	{
+		for( i = 0; i < 2; i++ )
+		{
+			if( !job->out[i] )
+				continue;
+
+			FS_WriteFile( va( PRECOMP_DIR "/%s.%s", job->hash, precomp_ext[i] ), job->out[i], job->outsize[i] );
+			Con_Reportf( "precompressed %s (%s -> %s)\n", job->name, Q_memprint( job->size ), Q_memprint( job->outsize[i] ));
+			free( job->out[i] );
+			job->out[i] = NULL;
+			precomp.prune = true;
+		}
+
+		// incompressible file is sent as is
+		job->state = ( job->need[0] && !FS_FileExists( va( PRECOMP_DIR "/%s.%s", job->hash, precomp_ext[0] ), false )) ? PRECOMP_FAILED : PRECOMP_DONE;
+		free( job->data );
+		job->data = NULL;
+		precomp.active = job = NULL;
+	}
+
+	if( job )
+		return; // worker is busy
+
+	for( job = precomp.jobs; job; job = job->next )
+	{
+		if( job->state == PRECOMP_QUEUED )
+			break;
+	}
+
+	if( !job )
+	{
+		// everything current map needs is hashed
+		if( precomp.prune )
+			Netchan_PrunePrecompressed();
+		return;
+	}
+
+	job->hash[0] = '\0';
+	job->filetime = FS_FileTime( job->name, false );
+
+	// filesystem isn't thread safe, archive entries share the pack's file offset,
+	// so the worker only gets the bytes. Memory pools aren't either, use malloc
+	file = FS_Open( job->name, "rb", false );
+	job->size = file ? FS_FileLength( file ) : 0;
+	job->data = job->size > 0 ? (byte *)malloc( job->size ) : NULL;
+
+	if( !job->data || FS_Read( file, job->data, job->size ) != job->size )
+	{
+		if( file )
+			FS_Close( file );
+		free( job->data );
+		job->data = NULL;
+		job->state = PRECOMP_FAILED;
+		return;
+	}
+
+	FS_Close( file );
+
+	if( !precomp.thread )
+		precomp.thread = new std::thread( Netchan_PrecompressWorker );
+
+	job->state = PRECOMP_HASHING;
+	precomp.active = job;
+	lock.unlock();
+	precomp.wake.notify_one();
+}
+
+/*
+==============================
+Netchan_PrecompressedName
+
+returns compressed copy of unchanged file if it's ready
+==============================
+*/
+static qboolean Netchan_PrecompressedName( const char *filename, qboolean deflate, char *out, size_t size )
+{
+	std::lock_guard<std::mutex> lock( precomp.lock );
+	netprecomp_t	*job;
+
+	for( job = precomp.jobs; job; job = job->next )
+	{
+		if( !Q_strcmp( job->name, filename ))
+			break;
+	}
+
+	if( !job || job->state != PRECOMP_DONE )
+		return false;
+
+	if( job->size != FS_FileSize( filename, false ) || job->filetime != FS_FileTime( filename, false ))
+		return false;
+
+	Q_snprintf( out, size, PRECOMP_DIR "/%s.%s", job->hash, precomp_ext[deflate ? 1 : 0] );
+
+	return FS_FileExists( out, false );
+}
+
 /*
 ==============================
 Netchan_CreateFileFragments
@@ -963,11 +1642,10 @@ int Netchan_CreateFileFragments( netchan_t *chan, const char *filename )
 	int		bufferid = 1;
 	fs_offset_t	filesize = 0;
 	char		compressedfilename[MAX_OSPATH];
-	int		compressedFileTime;
-	int		fileTime;
 	qboolean		firstfragment = true;
 	qboolean		bCompressed = false;
 	fragbufwaiting_t	*wait, *p;
+	netfilesource_t	*src;
 	fragbuf_t		*buf;
 	
 	if(( filesize = FS_FileSize( filename, false )) <= 0 )
@@ -980,39 +1658,23 @@ int Netchan_CreateFileFragments( netchan_t *chan, const char *filename )
 		chunksize = chan->pfnBlockSize( chan->client, FRAGSIZE_FRAG );
 	else chunksize = FRAGMENT_MAX_SIZE; // fallback
 
-	Q_strncpy( compressedfilename, filename, sizeof( compressedfilename ));
-	COM_ReplaceExtension( compressedfilename, ".ztmp", sizeof( compressedfilename ));
-	compressedFileTime = FS_FileTime( compressedfilename, false );
-	fileTime = FS_FileTime( filename, false );
-
-	if( compressedFileTime >= fileTime )
+	// compressing here would stall the frame, send it as is until the cache is ready
+	if( Netchan_PrecompressedName( filename, chan->compression != COMPRESS_LZSS, compressedfilename, sizeof( compressedfilename )))
 	{
-		// if compressed file already created and newer than source
 		fs_offset_t compressedSize = FS_FileSize( compressedfilename, false );
-		if( compressedSize != -1 )
+
+		if( compressedSize > 0 )
 		{
 			bCompressed = true;
 			filesize = compressedSize;
 		}
 	}
-	else
-	{
-		uint	uCompressedSize;
-		byte	*uncompressed;
-		byte	*compressed;
-
-		uncompressed = FS_LoadFile( filename, &filesize, false );
-		compressed = LZSS_Compress( uncompressed, filesize, &uCompressedSize );
+	else Netchan_Precompress( filename );
 
-		if( compressed )
-		{
-			Con_DPrintf( "compressed file %s (%s -> %s)\n", filename, Q_memprint( filesize ), Q_memprint( uCompressedSize ));
-			FS_WriteFile( compressedfilename, compressed, uCompressedSize );
-			filesize = uCompressedSize;
-			bCompressed = true;
-			free( compressed );
-		}
-		Mem_Free( uncompressed );
+	if(( src = Netchan_OpenFileSource( bCompressed ? compressedfilename : filename )) == NULL )
+	{
+		Con_Printf( S_WARN "Unable to open %s for transfer\n", filename );
+		return 0;
 	}
 
 	wait = (fragbufwaiting_t *)Mem_Calloc( net_mempool, sizeof( fragbufwaiting_t ));
@@ -1044,6 +1706,8 @@ int Netchan_CreateFileFragments( netchan_t *chan, const char *filename )
 		buf->size = send;
 		buf->foffset = pos;
 		buf->iscompressed = bCompressed;
+		buf->source = src;
+		src->refcount++;
 		Q_strncpy( buf->filename, filename, sizeof( buf->filename ));
 
 		pos += send;
@@ -1092,6 +1756,31 @@ void Netchan_FlushIncoming( netchan_t *chan, int stream )
 	chan->incomingready[stream] = false;
 }
 
+/*
+==============================
+Netchan_AbortIncomingFile
+
+server gave up on this file, drop
+the part of it we already received
+==============================
+*/
+void Netchan_AbortIncomingFile( netchan_t *chan, const char *filename )
+{
+	fragbuf_t	*p = chan->incomingbufs[FRAG_FILE_STREAM];
+	sizebuf_t	temp;
+
+	// the name is only in the first fragment
+	if( !p || FRAG_GETID( p->bufferid ) != 1 )
+		return;
+
+	MSG_StartReading( &temp, MSG_GetData( &p->frag_message ), MSG_GetNumBytesWritten( &p->frag_message ), 0, -1 );
+
+	if( Q_stricmp( MSG_ReadString( &temp ), filename ))
+		return; // another file is in flight
+
+	Netchan_FlushIncoming( chan, FRAG_FILE_STREAM );
+}
+
 /*
 ==============================
 Netchan_CopyNormalFragments
@@ -1128,14 +1817,14 @@ qboolean Netchan_CopyNormalFragments( netchan_t *chan, sizebuf_t *msg, size_t *l
 		p = n;
 	}
 
-	if( LZSS_IsCompressed( MSG_GetData( msg )))
+	if( COM_IsCompressed( MSG_GetData( msg )))
 	{
-		uint	uDecompressedLen = LZSS_GetActualSize( MSG_GetData( msg ));
+		uint	uDecompressedLen = COM_GetActualSize( MSG_GetData( msg ));
 		byte	buf[NET_MAX_MESSAGE];
 
 		if( uDecompressedLen <= sizeof( buf ))
 		{
-			size = LZSS_Decompress( MSG_GetData( msg ), buf );
+			size = COM_Decompress( MSG_GetData( msg ), size, buf, sizeof( buf ));
 			memcpy( msg->pData, buf, size );
 		}
 		else
@@ -1258,12 +1947,12 @@ qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg )
 		p = n;
 	}
 
-	if( LZSS_IsCompressed( buffer ))
+	if( COM_IsCompressed( buffer ))
 	{
-		uint	uncompressedSize = LZSS_GetActualSize( buffer ) + 1;
+		uint	uncompressedSize = COM_GetActualSize( buffer ) + 1;
 		byte	*uncompressedBuffer = Mem_Calloc( net_mempool, uncompressedSize );
 
-		nsize = LZSS_Decompress( buffer, uncompressedBuffer );
+		nsize = COM_Decompress( buffer, nsize, uncompressedBuffer, uncompressedSize );
 		Mem_Free( buffer );
 		buffer = uncompressedBuffer;
 	}
@@ -1554,32 +2243,34 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 			{
 				sizebuf_t	temp;
 
-				// which buffer are we sending ?
-				chan->reliable_fragid[i] = MAKE_FRAGID( pbuf->bufferid, chan->fragbufcount[i] );
-
 				// if it's not in-memory, then we'll need to copy it in frame the file handle.
 				if( pbuf->isfile && !pbuf->isbuffer )
 				{
 					byte	filebuffer[NET_MAX_FRAGMENT];
-					file_t	*file;
 
-					if( pbuf->iscompressed )
+					if( !pbuf->source || !Netchan_ReadFileSource( pbuf->source, pbuf->foffset, filebuffer, pbuf->size ))
 					{
-						char	compressedfilename[MAX_OSPATH];
-
-						Q_strncpy( compressedfilename, pbuf->filename, sizeof( compressedfilename ));
-						COM_ReplaceExtension( compressedfilename, ".ztmp", sizeof( compressedfilename ));
-						file = FS_Open( compressedfilename, "rb", false );
+						// never send a file with holes, drop what's left of it
+						Con_Printf( S_ERROR "%s: can't read %s, transfer aborted\n", __func__, pbuf->filename );
+
+						// and let the client discard the fragments it already got
+						if( chan->sock == NS_SERVER )
+						{
+							MSG_BeginServerCmd( &chan->message, svc_filetxferfailed );
+							MSG_WriteString( &chan->message, pbuf->filename );
+						}
+
+						Netchan_ClearFragbufs( &chan->fragbufs[i] );
+						chan->fragbufcount[i] = 0;
+						continue;
 					}
-					else file = FS_Open( pbuf->filename, "rb", false );
-
-					FS_Seek( file, pbuf->foffset, SEEK_SET );
-					FS_Read( file, filebuffer, pbuf->size );
 
 					MSG_WriteBits( &pbuf->frag_message, filebuffer, pbuf->size << 3 );
-					FS_Close( file );
 				}
 
+				// which buffer are we sending ?
+				chan->reliable_fragid[i] = MAKE_FRAGID( pbuf->bufferid, chan->fragbufcount[i] );
+
 				// copy frag stuff on top of current buffer
 				MSG_StartWriting( &temp, chan->reliable_buf, sizeof( chan->reliable_buf ), chan->reliable_length, -1 );
 				MSG_WriteBits( &temp, MSG_GetData( &pbuf->frag_message ), MSG_GetNumBitsWritten( &pbuf->frag_message ));
@@ -1596,6 +2287,13 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 					chan->frag_startpos[j] += chan->frag_length[i];
 			}
 		}
+
+		// the only payload was an aborted file, nothing to send reliably
+		if(( send_from_regular || send_frag ) && !chan->reliable_length )
+		{
+			chan->reliable_sequence ^= 1;
+			send_reliable = false;
+		}
 	}
 
 	memset( send_buf, 0, sizeof( send_buf ));
@@ -25,6 +25,7 @@ GNU General Public License for more details.
 #include "event_args.h"
 #include "protocol.h"
 #include "client.h"
+#include <mutex>
 
 using namespace engine;
 
@@ -50,7 +51,23 @@ using namespace engine;
 #define CLDT_DEF( x )	#x, offsetof( clientdata_t, x ), sizeof( ((clientdata_t *)0)->x )
 #define WPDT_DEF( x )	#x, offsetof( weapon_data_t, x ), sizeof( ((weapon_data_t *)0)->x )
 
+#define DELTA_MAX_FIELDS	128	// per-thread copy of the largest table
+#define DELTA_PLAN_MAX_WORDS	128	// largest struct a plan may cover, in 8-byte words
+
 static qboolean		delta_init = false;
+static qboolean		delta_threaded = false;	// encoders may run from several threads
+static qboolean		delta_plans = true;		// use compiled plans where available
+static std::mutex		delta_lock;		// serializes game encoders while threaded
+static thread_local delta_t	delta_fields[DELTA_MAX_FIELDS];
+
+// encoder result kept by Delta_PrepareEntity for MSG_WritePreparedEntity
+static thread_local struct
+{
+	delta_info_t	*dt;
+	entity_state_t	*from;
+	entity_state_t	*to;
+	delta_t		*pFields;
+} delta_prepared;
 
 // list of all the struct names
 static const delta_field_t cmd_fields[] =
@@ -342,6 +359,9 @@ static delta_info_t dt_info[] =
 { NULL },
 };
 
+STATIC_ASSERT( NUM_FIELDS( ent_fields ) <= DELTA_MAX_FIELDS, "DELTA_MAX_FIELDS is too small" );
+STATIC_ASSERT( NUM_FIELDS( cd_fields ) <= DELTA_MAX_FIELDS, "DELTA_MAX_FIELDS is too small" );
+
 static delta_info_t *Delta_FindStruct( const char *name )
 {
 	int	i;
@@ -402,12 +422,37 @@ static delta_info_t *Delta_FindStructByDelta( const delta_t *pFields )
 	return NULL;
 }
 
-static void Delta_CustomEncode( delta_info_t *dt, const void *from, const void *to )
+/*
+=====================
+Delta_CustomEncode
+
+activate all the fields and let the game encoder
+turn some of them off. returns the field list to
+process: when encoding is threaded the game sees the
+shared table under lock and the caller gets a
+private snapshot of the result
+=====================
+*/
+static delta_t *Delta_CustomEncode( delta_info_t *dt, const void *from, const void *to )
 {
 	int	i;
 
 	Assert( dt != NULL );
 
+	if( delta_threaded )
+	{
+		std::lock_guard<std::mutex> guard( delta_lock );
+
+		for( i = 0; i < dt->numFields; i++ )
+			dt->pFields[i].bInactive = false;
+
+		if( dt->userCallback )
+			dt->userCallback( dt->pFields, (const byte*)from, (const byte*)to );
+
+		memcpy( delta_fields, dt->pFields, dt->numFields * sizeof( delta_t ));
+		return delta_fields;
+	}
+
 	// set all fields is active by default
 	for( i = 0; i < dt->numFields; i++ )
 		dt->pFields[i].bInactive = false;
@@ -416,6 +461,179 @@ static void Delta_CustomEncode( delta_info_t *dt, const void *from, const void *
 	{
 		dt->userCallback( dt->pFields, (const byte*)from, (const byte*)to );
 	}
+
+	return dt->pFields;
+}
+
+/*
+=====================
+Delta_SetThreaded
+
+must be toggled while no encoding is in progress
+=====================
+*/
+void Delta_SetThreaded( qboolean threaded )
+{
+	delta_threaded = threaded;
+}
+
+/*
+=============================================================================
+
+compiled encoding plans
+
+=============================================================================
+*/
+// field kinds, resolved from the flags in the
+// same priority Delta_CompareField checks them
+enum
+{
+	DELTA_KIND_NONE = 0,
+	DELTA_KIND_BYTE,
+	DELTA_KIND_SHORT,
+	DELTA_KIND_INTEGER,
+	DELTA_KIND_FLOAT,
+	DELTA_KIND_ANGLE,
+	DELTA_KIND_TIMEWINDOW_8,
+	DELTA_KIND_TIMEWINDOW_BIG,
+	DELTA_KIND_STRING,
+};
+
+typedef struct delta_plan_field_s
+{
+	int		kind;
+	int		offset;
+	int		width;		// bytes the compare reads
+	int		firstWord;	// words spanned by those bytes
+	int		lastWord;
+	int		bits;
+	int		signbit;
+	qboolean		exact;		// raw bytes differ only if the encoded value does
+} delta_plan_field_t;
+
+typedef struct delta_plan_s
+{
+	int		numFields;
+	int		numBytes;		// extent of the struct touched by any field
+	delta_plan_field_t	*fields;
+} delta_plan_t;
+
+/*
+=====================
+Delta_SetPlans
+
+must be toggled while no encoding is in progress
+=====================
+*/
+void Delta_SetPlans( qboolean enable )
+{
+	delta_plans = enable;
+}
+
+static void Delta_FreePlan( delta_info_t *dt )
+{
+	if( dt->plan )
+	{
+		Z_Free( dt->plan );
+		dt->plan = NULL;
+	}
+}
+
+/*
+=====================
+Delta_CompilePlan
+
+resolve every field once into a flat description:
+its kind, the bytes it occupies and whether a raw byte
+difference already means the field has to be sent
+=====================
+*/
+static void Delta_CompilePlan( delta_info_t *dt )
+{
+	delta_plan_t	*plan;
+	delta_plan_field_t	*pf;
+	delta_t		*pField;
+	int		i, numBytes = 0;
+
+	Delta_FreePlan( dt );
+
+	if( !dt->pFields || dt->numFields <= 0 || dt->numFields > DELTA_MAX_FIELDS )
+		return;
+
+	plan = (delta_plan_t *)Z_Calloc( sizeof( delta_plan_t ) + dt->numFields * sizeof( delta_plan_field_t ));
+	plan->fields = (delta_plan_field_t *)( plan + 1 );
+	plan->numFields = dt->numFields;
+
+	for( i = 0, pField = dt->pFields; i < dt->numFields; i++, pField++ )
+	{
+		pf = &plan->fields[i];
+		pf->offset = pField->offset;
+		pf->bits = pField->bits;
+		pf->signbit = FBitSet( pField->flags, DT_SIGNED ) ? 1 : 0;
+
+		if( FBitSet( pField->flags, DT_BYTE ))
+			pf->kind = DELTA_KIND_BYTE, pf->width = 1;
+		else if( FBitSet( pField->flags, DT_SHORT ))
+			pf->kind = DELTA_KIND_SHORT, pf->width = 2;
+		else if( FBitSet( pField->flags, DT_INTEGER ))
+			pf->kind = DELTA_KIND_INTEGER, pf->width = 4;
+		else if( FBitSet( pField->flags, DT_FLOAT ))
+			pf->kind = DELTA_KIND_FLOAT, pf->width = 4;
+		else if( FBitSet( pField->flags, DT_ANGLE ))
+			pf->kind = DELTA_KIND_ANGLE, pf->width = 4;
+		else if( FBitSet( pField->flags, DT_TIMEWINDOW_8 ))
+			pf->kind = DELTA_KIND_TIMEWINDOW_8, pf->width = 4;
+		else if( FBitSet( pField->flags, DT_TIMEWINDOW_BIG ))
+			pf->kind = DELTA_KIND_TIMEWINDOW_BIG, pf->width = 4;
+		else if( FBitSet( pField->flags, DT_STRING ))
+			pf->kind = DELTA_KIND_STRING, pf->width = pField->size;
+		else pf->kind = DELTA_KIND_NONE, pf->width = 0;
+
+		switch( pf->kind )
+		{
+		case DELTA_KIND_BYTE:
+		case DELTA_KIND_SHORT:
+		case DELTA_KIND_INTEGER:
+			// neither clamped nor scaled, so the value is sent as is
+			pf->exact = Q_equal( pField->multiplier, 1.0f ) && pf->bits >= pf->width * 8;
+			break;
+		case DELTA_KIND_FLOAT:
+		case DELTA_KIND_ANGLE:
+			pf->exact = true; // compared as raw ints
+			break;
+		default:
+			pf->exact = false;
+			break;
+		}
+
+		if( pf->width > 0 )
+		{
+			pf->firstWord = pf->offset >> 3;
+			pf->lastWord = ( pf->offset + pf->width - 1 ) >> 3;
+			numBytes = Q_max( numBytes, pf->offset + pf->width );
+		}
+	}
+
+	if( numBytes > DELTA_PLAN_MAX_WORDS * 8 )
+	{
+		Con_Reportf( S_WARN "%s: %s is too large for a delta plan\n", __func__, dt->pName );
+		Z_Free( plan );
+		return;
+	}
+
+	plan->numBytes = numBytes;
+	dt->plan = plan;
+}
+
+static void Delta_CompilePlans( void )
+{
+	int	i;
+
+	for( i = 0; i < NUM_FIELDS( dt_info ); i++ )
+	{
+		if( dt_info[i].bInitialized )
+			Delta_CompilePlan( &dt_info[i] );
+	}
 }
 
 static delta_field_t *Delta_FindFieldInfo( const delta_field_t *pInfo, const char *fieldName )
@@ -452,6 +670,9 @@ static qboolean Delta_AddField( delta_info_t *dt, const char *pName, int flags,
 	delta_t		*pField;
 	int		i;
 
+	// table is about to change
+	Delta_FreePlan( dt );
+
 	// check for coexisting field
 	for( i = 0, pField = dt->pFields; i < dt->numFields; i++, pField++ )
 	{
@@ -829,7 +1050,12 @@ void Delta_Init( void )
 	dt = Delta_FindStructByIndex( DT_MOVEVARS_T );
 
 	Assert( dt != NULL );
-	if( dt->bInitialized ) return;	// "movevars_t" already specified by user
+	if( dt->bInitialized )
+	{
+		// "movevars_t" already specified by user
+		Delta_CompilePlans();
+		return;
+	}
 
 	// create movevars_t delta internal
 	Delta_AddField( dt, "gravity", DT_FLOAT|DT_SIGNED, 16, 8.0f, 1.0f );
@@ -867,6 +1093,8 @@ void Delta_Init( void )
 
 	// now done
 	dt->bInitialized = true;
+
+	Delta_CompilePlans();
 }
 
 void Delta_InitClient( void )
@@ -886,6 +1114,8 @@ void Delta_InitClient( void )
 	}
 
 	if( numActive ) delta_init = true;
+
+	Delta_CompilePlans();
 }
 
 void Delta_Shutdown( void )
@@ -900,6 +1130,7 @@ void Delta_Shutdown( void )
 		dt_info[i].customEncode = CUSTOM_NONE;
 		dt_info[i].userCallback = NULL;
 		dt_info[i].funcName[0] = '\0';
+		Delta_FreePlan( &dt_info[i] );
 
 		if( dt_info[i].pFields )
 		{
@@ -1077,6 +1308,76 @@ static qboolean Delta_CompareField( delta_t *pField, void *from, void *to, doubl
 	return fromF == toF;
 }
 
+/*
+=====================
+Delta_PlanCompare
+
+compare the structs eight bytes at a time and fill the
+changed-field mask, only fields lying over a changed word
+are looked at individually. returns false if nothing changed
+=====================
+*/
+static qboolean Delta_PlanCompare( const delta_plan_t *plan, delta_t *pField, void *from, void *to, double timebase, uint64_t *changed )
+{
+	uint64_t		words[DELTA_PLAN_MAX_WORDS / 64] = { 0 };
+	const byte	*a = (const byte *)from;
+	const byte	*b = (const byte *)to;
+	const delta_plan_field_t	*pf;
+	uint64_t		wa, wb;
+	qboolean		any = false;
+	int		i, w, tail;
+
+	for( i = 0, w = 0; i + 8 <= plan->numBytes; i += 8, w++ )
+	{
+		memcpy( &wa, a + i, 8 );
+		memcpy( &wb, b + i, 8 );
+		if( wa != wb ) words[w >> 6] |= BIT64( w & 63 );
+	}
+
+	// never read past the last field
+	if(( tail = plan->numBytes - i ) > 0 )
+	{
+		wa = wb = 0;
+		memcpy( &wa, a + i, tail );
+		memcpy( &wb, b + i, tail );
+		if( wa != wb ) words[w >> 6] |= BIT64( w & 63 );
+	}
+
+	memset( changed, 0, sizeof( uint64_t ) * ( DELTA_MAX_FIELDS / 64 ));
+
+	for( w = 0; w < DELTA_PLAN_MAX_WORDS / 64; w++ )
+	{
+		if( words[w] ) break;
+	}
+
+	if( w == DELTA_PLAN_MAX_WORDS / 64 )
+		return false; // identical structs
+
+	for( i = 0, pf = plan->fields; i < plan->numFields; i++, pf++, pField++ )
+	{
+		if( pField->bInactive || pf->kind == DELTA_KIND_NONE )
+			continue;
+
+		for( w = pf->firstWord; w <= pf->lastWord; w++ )
+		{
+			if( FBitSet( words[w >> 6], BIT64( w & 63 )))
+				break;
+		}
+
+		// the word may have changed because of a neighbour
+		if( w > pf->lastWord || !memcmp( a + pf->offset, b + pf->offset, pf->width ))
+			continue;
+
+		if( !pf->exact && Delta_CompareField( pField, from, to, timebase ))
+			continue;
+
+		changed[i >> 6] |= BIT64( i & 63 );
+		any = true;
+	}
+
+	return any;
+}
+
 /*
 =====================
 Delta_TestBaseline
@@ -1108,11 +1409,34 @@ int Delta_TestBaseline( entity_state_t *from, entity_state_t *to, qboolean playe
 
 	countBits++; // entityType flag
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
+	Assert( dt->pFields != NULL );
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	pField = Delta_CustomEncode( dt, from, to );
+
+	if( delta_plans && dt->plan )
+	{
+		uint64_t	changed[DELTA_MAX_FIELDS / 64];
+
+		// flag about field change (sets always)
+		countBits += dt->numFields;
+
+		if( !Delta_PlanCompare( dt->plan, pField, from, to, timebase, changed ))
+			return countBits;
+
+		for( i = 0; i < dt->numFields; i++, pField++ )
+		{
+			if( !FBitSet( changed[i >> 6], BIT64( i & 63 )))
+				continue;
+
+			// strings are handled differently
+			if( FBitSet( pField->flags, DT_STRING ))
+				countBits += Q_strlen((char *)((byte *)to + pField->offset )) * 8;
+			else countBits += pField->bits;
+		}
+
+		return countBits;
+	}
 
 	// process fields
 	for( i = 0; i < dt->numFields; i++, pField++ )
@@ -1141,21 +1465,13 @@ write fields by offsets
 assume from and to is valid
 =====================
 */
-static qboolean Delta_WriteField( sizebuf_t *msg, delta_t *pField, void *from, void *to, double timebase )
+static void Delta_WriteFieldValue( sizebuf_t *msg, delta_t *pField, void *to, double timebase )
 {
 	int		signbit = FBitSet( pField->flags, DT_SIGNED ) ? 1 : 0;
 	float		flValue, flAngle;
 	uint		iValue;
 	const char	*pStr;
 
-	if( Delta_CompareField( pField, from, to, timebase ))
-	{
-		MSG_WriteOneBit( msg, 0 );	// unchanged
-		return false;
-	}
-
-	MSG_WriteOneBit( msg, 1 );	// changed
-
 	if( pField->flags & DT_BYTE )
 	{
 		if( signbit )
@@ -1231,9 +1547,117 @@ static qboolean Delta_WriteField( sizebuf_t *msg, delta_t *pField, void *from, v
 		pStr = (char *)((byte *)to + pField->offset );
 		MSG_WriteString( msg, pStr );
 	}
+}
+
+static qboolean Delta_WriteField( sizebuf_t *msg, delta_t *pField, void *from, void *to, double timebase )
+{
+	if( Delta_CompareField( pField, from, to, timebase ))
+	{
+		MSG_WriteOneBit( msg, 0 );	// unchanged
+		return false;
+	}
+
+	MSG_WriteOneBit( msg, 1 );	// changed
+	Delta_WriteFieldValue( msg, pField, to, timebase );
 	return true;
 }
 
+/*
+=====================
+Delta_PlanWriteValue
+
+write a changed field from its compiled plan entry,
+anything that needs clamping or scaling goes through
+the generic writer so the bits stay the same
+=====================
+*/
+static void Delta_PlanWriteValue( sizebuf_t *msg, const delta_plan_field_t *pf, delta_t *pField, void *to, double timebase )
+{
+	const byte	*data = (const byte *)to + pf->offset;
+	float		flValue;
+	uint		iValue;
+
+	switch( pf->kind )
+	{
+	case DELTA_KIND_BYTE:
+		if( !pf->exact )
+			break;
+		iValue = pf->signbit ? *(int8_t *)data : *(uint8_t *)data;
+		MSG_WriteBitLong( msg, iValue, pf->bits, pf->signbit );
+		return;
+	case DELTA_KIND_SHORT:
+		if( !pf->exact )
+			break;
+		iValue = pf->signbit ? *(int16_t *)data : *(uint16_t *)data;
+		MSG_WriteBitLong( msg, iValue, pf->bits, pf->signbit );
+		return;
+	case DELTA_KIND_INTEGER:
+		if( !pf->exact )
+			break;
+		iValue = *(uint32_t *)data;
+		MSG_WriteBitLong( msg, iValue, pf->bits, pf->signbit );
+		return;
+	case DELTA_KIND_FLOAT:
+		flValue = *(float *)data;
+		iValue = (int)((double)flValue * pField->multiplier);
+		iValue = Delta_ClampIntegerField( pField, iValue, pf->signbit, pf->bits );
+		MSG_WriteBitLong( msg, iValue, pf->bits, pf->signbit );
+		return;
+	case DELTA_KIND_ANGLE:
+		MSG_WriteBitAngle( msg, *(float *)data, pf->bits );
+		return;
+	}
+
+	Delta_WriteFieldValue( msg, pField, to, timebase );
+}
+
+/*
+=====================
+Delta_WriteFields
+
+write the change bit and value of every field,
+returns the number of changed fields
+=====================
+*/
+static int Delta_WriteFields( sizebuf_t *msg, delta_info_t *dt, delta_t *pField, void *from, void *to, double timebase )
+{
+	uint64_t	changed[DELTA_MAX_FIELDS / 64];
+	const delta_plan_t	*plan = dt->plan;
+	int	i, numChanges = 0;
+
+	if( !delta_plans || !plan )
+	{
+		for( i = 0; i < dt->numFields; i++, pField++ )
+		{
+			if( Delta_WriteField( msg, pField, from, to, timebase ))
+				numChanges++;
+		}
+		return numChanges;
+	}
+
+	if( !Delta_PlanCompare( plan, pField, from, to, timebase, changed ))
+	{
+		for( i = 0; i < plan->numFields; i++ )
+			MSG_WriteOneBit( msg, 0 );
+		return 0;
+	}
+
+	for( i = 0; i < plan->numFields; i++, pField++ )
+	{
+		if( !FBitSet( changed[i >> 6], BIT64( i & 63 )))
+		{
+			MSG_WriteOneBit( msg, 0 );	// unchanged
+			continue;
+		}
+
+		MSG_WriteOneBit( msg, 1 );	// changed
+		Delta_PlanWriteValue( msg, &plan->fields[i], pField, to, timebase );
+		numChanges++;
+	}
+
+	return numChanges;
+}
+
 /*
 ====================
 Delta_CopyField
@@ -1404,22 +1828,17 @@ void MSG_WriteDeltaUsercmd( sizebuf_t *msg, usercmd_t *from, usercmd_t *to )
 {
 	delta_t		*pField;
 	delta_info_t	*dt;
-	int		i;
 
 	dt = Delta_FindStructByIndex( DT_USERCMD_T );
 	Assert( dt && dt->bInitialized );
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
+	Assert( dt->pFields != NULL );
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	pField = Delta_CustomEncode( dt, from, to );
 
 	// process fields
-	for( i = 0; i < dt->numFields; i++, pField++ )
-	{
-		Delta_WriteField( msg, pField, from, to, 0.0f );
-	}
+	Delta_WriteFields( msg, dt, pField, from, to, 0.0f );
 }
 
 /*
@@ -1466,22 +1885,17 @@ void MSG_WriteDeltaEvent( sizebuf_t *msg, event_args_t *from, event_args_t *to )
 {
 	delta_t		*pField;
 	delta_info_t	*dt;
-	int		i;
 
 	dt = Delta_FindStructByIndex( DT_EVENT_T );
 	Assert( dt && dt->bInitialized );
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
+	Assert( dt->pFields != NULL );
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	pField = Delta_CustomEncode( dt, from, to );
 
 	// process fields
-	for( i = 0; i < dt->numFields; i++, pField++ )
-	{
-		Delta_WriteField( msg, pField, from, to, 0.0f );
-	}
+	Delta_WriteFields( msg, dt, pField, from, to, 0.0f );
 }
 
 /*
@@ -1521,28 +1935,23 @@ qboolean MSG_WriteDeltaMovevars( sizebuf_t *msg, movevars_t *from, movevars_t *t
 {
 	delta_t		*pField;
 	delta_info_t	*dt;
-	int		i, startBit;
-	int		numChanges = 0;
+	int		startBit;
+	int		numChanges;
 
 	dt = Delta_FindStructByIndex( DT_MOVEVARS_T );
 	Assert( dt && dt->bInitialized );
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
+	Assert( dt->pFields != NULL );
 
 	startBit = msg->iCurBit;
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	pField = Delta_CustomEncode( dt, from, to );
 
 	MSG_BeginServerCmd( msg, svc_deltamovevars );
 
 	// process fields
-	for( i = 0; i < dt->numFields; i++, pField++ )
-	{
-		if( Delta_WriteField( msg, pField, from, to, 0.0f ))
-			numChanges++;
-	}
+	numChanges = Delta_WriteFields( msg, dt, pField, from, to, 0.0f );
 
 	// if we have no changes - kill the message
 	if( !numChanges )
@@ -1593,28 +2002,23 @@ void MSG_WriteClientData( sizebuf_t *msg, clientdata_t *from, clientdata_t *to,
 {
 	delta_t		*pField;
 	delta_info_t	*dt;
-	int		i, startBit;
-	int		numChanges = 0;
+	int		startBit;
+	int		numChanges;
 
 	dt = Delta_FindStructByIndex( DT_CLIENTDATA_T );
 	Assert( dt && dt->bInitialized );
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
+	Assert( dt->pFields != NULL );
 
 	startBit = msg->iCurBit;
 
 	MSG_WriteOneBit( msg, 1 ); // have clientdata
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	pField = Delta_CustomEncode( dt, from, to );
 
 	// process fields
-	for( i = 0; i < dt->numFields; i++, pField++ )
-	{
-		if( Delta_WriteField( msg, pField, from, to, timebase ))
-			numChanges++;
-	}
+	numChanges = Delta_WriteFields( msg, dt, pField, from, to, timebase );
 
 	if( numChanges ) return; // we have updates
 
@@ -1674,17 +2078,16 @@ void MSG_WriteWeaponData( sizebuf_t *msg, weapon_data_t *from, weapon_data_t *to
 {
 	delta_t		*pField;
 	delta_info_t	*dt;
-	int		i, startBit;
-	int		numChanges = 0;
+	int		startBit;
+	int		numChanges;
 
 	dt = Delta_FindStructByIndex( DT_WEAPONDATA_T );
 	Assert( dt && dt->bInitialized );
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
+	Assert( dt->pFields != NULL );
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	pField = Delta_CustomEncode( dt, from, to );
 
 	startBit = msg->iCurBit;
 
@@ -1692,11 +2095,7 @@ void MSG_WriteWeaponData( sizebuf_t *msg, weapon_data_t *from, weapon_data_t *to
 	MSG_WriteUBitLong( msg, index, MAX_WEAPON_BITS );
 
 	// process fields
-	for( i = 0; i < dt->numFields; i++, pField++ )
-	{
-		if( Delta_WriteField( msg, pField, from, to, timebase ))
-			numChanges++;
-	}
+	numChanges = Delta_WriteFields( msg, dt, pField, from, to, timebase );
 
 	// if we have no changes - kill the message
 	if( !numChanges ) MSG_SeekToBit( msg, startBit, SEEK_SET );
@@ -1735,9 +2134,79 @@ entity_state_t communication
 
 =============================================================================
 */
+static delta_info_t *Delta_EntityInfo( entity_state_t *to, int delta_type )
+{
+	delta_info_t	*dt;
+
+	if( FBitSet( to->entityType, ENTITY_BEAM ))
+	{
+		dt = Delta_FindStructByIndex( DT_CUSTOM_ENTITY_STATE_T );
+	}
+	else if( delta_type == DELTA_PLAYER )
+	{
+		dt = Delta_FindStructByIndex( DT_ENTITY_STATE_PLAYER_T );
+	}
+	else
+	{
+		dt = Delta_FindStructByIndex( DT_ENTITY_STATE_T );
+	}
+
+	Assert( dt && dt->bInitialized );
+	Assert( dt->pFields != NULL );
+
+	return dt;
+}
+
+static delta_t *Delta_EntityFields( delta_info_t *dt, entity_state_t *from, entity_state_t *to, int delta_type )
+{
+	int	i;
+
+	if( delta_type == DELTA_STATIC )
+	{
+		// static entities won't to be custom encoded
+		for( i = 0; i < dt->numFields; i++ )
+			dt->pFields[i].bInactive = false;
+		return dt->pFields;
+	}
+
+	// activate fields and call custom encode func
+	return Delta_CustomEncode( dt, from, to );
+}
+
+/*
+==================
+Delta_PrepareEntity
+
+run the custom encoder for an entity delta ahead of
+MSG_WritePreparedEntity and return a hash of the fields
+it turned off, so callers caching encoded deltas can tell
+when the game encodes the same states differently
+==================
+*/
+uint Delta_PrepareEntity( entity_state_t *from, entity_state_t *to, int delta_type )
+{
+	delta_info_t	*dt;
+	delta_t		*pField;
+	uint		hash;
+	int		i;
+
+	dt = Delta_EntityInfo( to, delta_type );
+	pField = Delta_EntityFields( dt, from, to, delta_type );
+
+	delta_prepared.dt = dt;
+	delta_prepared.from = from;
+	delta_prepared.to = to;
+	delta_prepared.pFields = pField;
+
+	for( i = 0, hash = 2166136261u; i < dt->numFields; i++, pField++ )
+		hash = ( hash ^ ( pField->bInactive ? 1 : 0 )) * 16777619u;
+
+	return hash ^ (uint)( dt - dt_info );
+}
+
 /*
 ==================
-MSG_WriteDeltaEntity
+Delta_WriteEntity
 
 Writes part of a packetentities message, including the entity number.
 Can delta from either a baseline or a previous packet_entity
@@ -1746,11 +2215,11 @@ If force is not set, then nothing at all will be generated if the entity is
 identical, under the assumption that the in-order delta code will catch it.
 ==================
 */
-void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, int delta_type, double timebase, int baseline )
+static void Delta_WriteEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, int delta_type, double timebase, int baseline, qboolean prepared )
 {
 	delta_info_t	*dt = NULL;
 	delta_t		*pField;
-	int		i, startBit;
+	int		startBit;
 	int		numChanges = 0;
 
 	if( to == NULL )
@@ -1796,47 +2265,40 @@ void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *
 	}
 	else MSG_WriteOneBit( msg, 0 );
 
-	if( FBitSet( to->entityType, ENTITY_BEAM ))
-	{
-		dt = Delta_FindStructByIndex( DT_CUSTOM_ENTITY_STATE_T );
-	}
-	else if( delta_type == DELTA_PLAYER )
-	{
-		dt = Delta_FindStructByIndex( DT_ENTITY_STATE_PLAYER_T );
-	}
-	else
-	{
-		dt = Delta_FindStructByIndex( DT_ENTITY_STATE_T );
-	}
+	dt = Delta_EntityInfo( to, delta_type );
 
-	Assert( dt && dt->bInitialized );
+	// the encoder already ran in Delta_PrepareEntity
+	if( prepared && delta_prepared.dt == dt && delta_prepared.from == from && delta_prepared.to == to )
+		pField = delta_prepared.pFields;
+	else pField = Delta_EntityFields( dt, from, to, delta_type );
 
-	pField = dt->pFields;
-	Assert( pField != NULL );
-
-	if( delta_type == DELTA_STATIC )
-	{
-		// static entities won't to be custom encoded
-		for( i = 0; i < dt->numFields; i++ )
-			dt->pFields[i].bInactive = false;
-	}
-	else
-	{
-		// activate fields and call custom encode func
-		Delta_CustomEncode( dt, from, to );
-	}
+	delta_prepared.dt = NULL;
 
 	// process fields
-	for( i = 0; i < dt->numFields; i++, pField++ )
-	{
-		if( Delta_WriteField( msg, pField, from, to, timebase ))
-			numChanges++;
-	}
+	numChanges += Delta_WriteFields( msg, dt, pField, from, to, timebase );
 
 	// if we have no changes - kill the message
 	if( !numChanges && !force ) MSG_SeekToBit( msg, startBit, SEEK_SET );
 }
 
+void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, int delta_type, double timebase, int baseline )
+{
+	Delta_WriteEntity( from, to, msg, force, delta_type, timebase, baseline, false );
+}
+
+/*
+==================
+MSG_WritePreparedEntity
+
+same as MSG_WriteDeltaEntity, reusing the encoder result
+of the Delta_PrepareEntity call made just before it
+==================
+*/
+void MSG_WritePreparedEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, int delta_type, double timebase, int baseline )
+{
+	Delta_WriteEntity( from, to, msg, force, delta_type, timebase, baseline, true );
+}
+
 /*
 ==================
 MSG_ReadDeltaEntity
@@ -2071,3 +2533,160 @@ void GAME_EXPORT Delta_UnsetFieldByIndex( delta_t *pFields, int fieldNumber )
 
 	dt->pFields[fieldNumber].bInactive = true;
 }
+
+#if XASH_ENGINE_TESTS
+
+#include "tests.h"
+
+typedef struct
+{
+	const char	*name;
+	int		flags;
+	int		bits;
+	float		mul;
+} test_delta_t;
+
+// every kind, clamped and scaled integers, an unencoded field
+static const test_delta_t test_ent_fields[] =
+{
+{ "origin[0]", DT_FLOAT|DT_SIGNED, 21, 8.0f },
+{ "origin[1]", DT_FLOAT|DT_SIGNED, 21, 8.0f },
+{ "angles[0]", DT_ANGLE, 16, 1.0f },
+{ "modelindex", DT_INTEGER, 10, 1.0f },
+{ "sequence", DT_INTEGER, 32, 1.0f },
+{ "frame", DT_FLOAT, 8, 1.0f },
+{ "skin", DT_SHORT|DT_SIGNED, 9, 1.0f },
+{ "solid", DT_SHORT, 16, 1.0f },
+{ "effects", DT_INTEGER|DT_SIGNED, 32, 1.0f },
+{ "scale", DT_FLOAT, 16, 256.0f },
+{ "eflags", DT_BYTE, 8, 1.0f },
+{ "rendercolor.r", DT_BYTE, 8, 1.0f },
+{ "controller[0]", DT_BYTE|DT_SIGNED, 8, 1.0f },
+{ "blending[0]", DT_BYTE, 6, 0.5f },
+{ "animtime", DT_TIMEWINDOW_8, 8, 1.0f },
+{ "framerate", DT_TIMEWINDOW_BIG, 16, 1000.0f },
+{ "velocity[0]", DT_FLOAT|DT_SIGNED, 16, 8.0f },
+{ "health", DT_INTEGER, 12, 0.5f },
+{ "aiment", 0, 8, 1.0f },
+{ "fov", DT_FLOAT|DT_ANGLE, 16, 1.0f },
+{ "startpos[0]", DT_ANGLE, 12, 1.0f },
+{ NULL },
+};
+
+static const test_delta_t test_pm_fields[] =
+{
+{ "gravity", DT_FLOAT|DT_SIGNED, 16, 8.0f },
+{ "zmax", DT_FLOAT|DT_SIGNED, 18, 1.0f },
+{ "skyName", DT_STRING, 1, 1.0f },
+{ "footsteps", DT_INTEGER, 1, 1.0f },
+{ "fog_settings", DT_INTEGER, 32, 1.0f },
+{ "wateralpha", DT_FLOAT|DT_SIGNED, 16, 32.0f },
+{ NULL },
+};
+
+static void Test_DeltaRandomize( delta_info_t *dt, byte *data, qboolean all )
+{
+	const delta_field_t	*pInfo;
+	delta_t		*pField;
+	int		i, len;
+
+	for( pInfo = dt->pInfo; pInfo->name; pInfo++ )
+	{
+		if( !all && COM_RandomLong( 0, 3 ))
+			continue;
+
+		for( i = 0, pField = NULL; i < dt->numFields; i++ )
+		{
+			if( !Q_strcmp( dt->pFields[i].name, pInfo->name ))
+				pField = &dt->pFields[i];
+		}
+
+		if( pField && FBitSet( pField->flags, DT_FLOAT|DT_ANGLE|DT_TIMEWINDOW_8|DT_TIMEWINDOW_BIG ))
+		{
+			*(float *)( data + pInfo->offset ) = COM_RandomFloat( -4096.0f, 4096.0f );
+		}
+		else if( pField && FBitSet( pField->flags, DT_STRING ))
+		{
+			// leave garbage past the terminator
+			len = COM_RandomLong( 0, pInfo->size - 1 );
+			for( i = 0; i < pInfo->size; i++ )
+				data[pInfo->offset + i] = i < len ? COM_RandomLong( 'a', 'c' ) : i == len ? 0 : COM_RandomLong( 0, 255 );
+		}
+		else
+		{
+			// fields outside the table too, they share words with encoded ones
+			for( i = 0; i < pInfo->size; i++ )
+				data[pInfo->offset + i] = COM_RandomLong( 0, 255 );
+		}
+	}
+}
+
+static int Test_DeltaPlans( delta_info_t *dt, const test_delta_t *fields, size_t size )
+{
+	uint64_t	from[DELTA_PLAN_MAX_WORDS], to[DELTA_PLAN_MAX_WORDS];
+	uint32_t	legacy[1024], planned[1024];
+	qboolean	oldplans = delta_plans;
+	sizebuf_t	a, b;
+	int	i, j, na, nb, mismatches = 0;
+	double	timebase;
+
+	for( ; fields->name; fields++ )
+		Delta_AddField( dt, fields->name, fields->flags, fields->bits, fields->mul, 1.0f );
+	dt->bInitialized = true;
+
+	Delta_CompilePlan( dt );
+	TASSERT( dt->plan != NULL );
+
+	for( i = 0; i < 2000; i++ )
+	{
+		for( j = 0; j < (int)size; j++ )
+			((byte *)from)[j] = COM_RandomLong( 0, 255 );
+
+		Test_DeltaRandomize( dt, (byte *)from, true );
+		memcpy( to, from, size );
+		Test_DeltaRandomize( dt, (byte *)to, false );
+
+		for( j = 0; j < dt->numFields; j++ )
+			dt->pFields[j].bInactive = !COM_RandomLong( 0, 7 );
+
+		timebase = COM_RandomFloat( 0.0f, 1000.0f );
+
+		memset( legacy, 0, sizeof( legacy ));
+		memset( planned, 0, sizeof( planned ));
+		MSG_Init( &a, "legacy", legacy, sizeof( legacy ));
+		MSG_Init( &b, "planned", planned, sizeof( planned ));
+
+		delta_plans = false;
+		na = Delta_WriteFields( &a, dt, dt->pFields, from, to, timebase );
+		delta_plans = true;
+		nb = Delta_WriteFields( &b, dt, dt->pFields, from, to, timebase );
+
+		if( na != nb || MSG_GetNumBitsWritten( &a ) != MSG_GetNumBitsWritten( &b )
+			|| memcmp( legacy, planned, MSG_GetNumBytesWritten( &a )))
+			mismatches++;
+	}
+
+	delta_plans = oldplans;
+	Delta_FreePlan( dt );
+	Z_Free( dt->pFields );
+
+	return mismatches;
+}
+
+void Test_RunDelta( void )
+{
+	delta_info_t	ent = { "entity_state_t", ent_fields, NUM_FIELDS( ent_fields ) };
+	delta_info_t	pm = { "movevars_t", pm_fields, NUM_FIELDS( pm_fields ) };
+	int		mismatches;
+
+	MSG_InitMasks();
+
+	Msg( "Checking delta plans against the field walk...\n" );
+
+	mismatches = Test_DeltaPlans( &ent, test_ent_fields, sizeof( entity_state_t ));
+	TASSERT_EQi( mismatches, 0 );
+
+	mismatches = Test_DeltaPlans( &pm, test_pm_fields, sizeof( movevars_t ));
+	TASSERT_EQi( mismatches, 0 );
+}
+#endif
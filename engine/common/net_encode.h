@@ -69,6 +69,8 @@ typedef struct
 	char		funcName[32];
 	pfnDeltaEncode	userCallback;
 	qboolean		bInitialized;
+
+	struct delta_plan_s	*plan;	// compiled once the table is complete
 } delta_info_t;
 
 //
@@ -83,6 +85,8 @@ void Delta_SetField( delta_t *pFields, const char *fieldname );
 void Delta_UnsetField( delta_t *pFields, const char *fieldname );
 void Delta_SetFieldByIndex( delta_t *pFields, int fieldNumber );
 void Delta_UnsetFieldByIndex( delta_t *pFields, int fieldNumber );
+void Delta_SetThreaded( qboolean threaded );
+void Delta_SetPlans( qboolean enable );
 
 // send table over network
 void Delta_WriteDescriptionToClient( sizebuf_t *msg );
@@ -107,6 +111,8 @@ void MSG_ReadClientData( sizebuf_t *msg, struct clientdata_s *from, struct clien
 void MSG_WriteWeaponData( sizebuf_t *msg, struct weapon_data_s *from, struct weapon_data_s *to, double timebase, int index );
 void MSG_ReadWeaponData( sizebuf_t *msg, struct weapon_data_s *from, struct weapon_data_s *to, double timebase );
 void MSG_WriteDeltaEntity( struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, int type, double timebase, int ofs );
+uint Delta_PrepareEntity( struct entity_state_s *from, struct entity_state_s *to, int type );
+void MSG_WritePreparedEntity( struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, int type, double timebase, int ofs );
 qboolean MSG_ReadDeltaEntity( sizebuf_t *msg, struct entity_state_s *from, struct entity_state_s *to, int num, int type, double timebase );
 int Delta_TestBaseline( struct entity_state_s *from, struct entity_state_s *to, qboolean player, double timebase );
 
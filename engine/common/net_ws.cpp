@@ -27,6 +27,7 @@ GNU General Public License for more details.
 #endif
 
 #include <sky/sky.h>
+#include <vector>
 
 #ifndef XASH_DEDICATED
 #include "client.h"
@@ -36,6 +37,17 @@ using namespace engine;
 
 #define NET_USE_FRAGMENTS
 
+#if XASH_LINUX && !defined XASH_WEBSOCKET && !defined XASH_NO_NETWORK
+#define NET_USE_MMSG	// batched recvmmsg/sendmmsg
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT		103
+#endif
+#endif
+
 #define MAX_LOOPBACK		4
 #define MASK_LOOPBACK		(MAX_LOOPBACK - 1)
 
@@ -89,6 +101,87 @@ typedef struct
 } SPLITPACKET;
 #pragma pack(pop)
 
+#ifdef NET_USE_MMSG
+#define NET_RECV_BATCH		32	// max datagrams per recvmmsg call
+
+// preallocated slots filled by single recvmmsg call
+typedef struct
+{
+	byte		data[NET_RECV_BATCH][NET_MAX_FRAGMENT];
+	struct sockaddr_storage	addr[NET_RECV_BATCH];
+	struct iovec	iov[NET_RECV_BATCH];
+	struct mmsghdr	hdr[NET_RECV_BATCH];
+	int		head;	// next slot to read
+	int		count;	// filled slots
+	int		turn;	// which protocol is polled first
+} net_recvring_t;
+
+#define NET_SEND_BATCH		64	// max datagrams queued per socket, also UDP GSO segments limit
+#define NET_SEND_BUFFER		( 256 * 1024 )
+#define NET_GSO_MAX_SIZE		65000	// UDP payload limit for single GSO super-datagram
+
+// outgoing datagrams queued during the frame, sent with single sendmmsg
+typedef struct
+{
+	byte		buffer[NET_SEND_BUFFER];
+	size_t		used;
+	int		count;
+	int		net_socket;
+	size_t		offset[NET_SEND_BATCH];
+	size_t		size[NET_SEND_BATCH];
+	struct sockaddr_storage	addr[NET_SEND_BATCH];
+	socklen_t		addrlen[NET_SEND_BATCH];
+	struct iovec	iov[NET_SEND_BATCH];
+	struct mmsghdr	hdr[NET_SEND_BATCH];
+	int		first[NET_SEND_BATCH];	// first queued datagram of each message
+	char		control[NET_SEND_BATCH][CMSG_SPACE( sizeof( uint16_t ))];
+} net_sendqueue_t;
+
+typedef struct
+{
+	size_t		recv_calls;
+	size_t		recv_packets;
+	size_t		recv_maxbatch;
+	size_t		send_calls;
+	size_t		send_packets;
+	size_t		send_maxbatch;
+	size_t		send_gso_messages;
+	size_t		send_gso_segments;
+} net_batchstats_t;
+#endif
+
+#define NET_WS_RING		256	// inbound websocket messages waiting for the engine
+#define NET_WS_RING_BYTES	( 2 * 1024 * 1024 )	// cap for all slot buffers of a socket
+#define NET_WS_SLOT_ALIGN	256
+
+// pooled inbound buffers, filled by websocket channel readers.
+// slot buffers are kept between messages and grow to the datagram size
+typedef struct
+{
+	byte		*data[NET_WS_RING];
+	size_t		size[NET_WS_RING];	// allocated size of the slot
+	size_t		length[NET_WS_RING];
+	int		channel[NET_WS_RING];
+	qboolean	unreliable[NET_WS_RING];
+	qboolean	stale[NET_WS_RING];	// superseded by newer unreliable datagram
+	int		head;		// next slot to read
+	int		count;		// filled slots
+	size_t		allocated;	// sum of size[]
+	size_t		dropped;
+	size_t		superseded;
+} net_wsring_t;
+
+#define NET_WS_FLOW_BACKUP	64
+
+// netchan sequences written to websocket channel and acknowledged by the peer.
+// websocket runs over tcp, so a lost segment stalls everything behind it
+typedef struct
+{
+	uint		sent;		// last outgoing sequence
+	uint		acked;		// last sequence acknowledged by the peer
+	double		senttime[NET_WS_FLOW_BACKUP];
+} net_wsflow_t;
+
 typedef struct
 {
 	net_loopback_t	loopbacks[NS_COUNT];
@@ -108,6 +201,12 @@ typedef struct
 #if XASH_WIN32
 	WSADATA		winsockdata;
 #endif
+#ifdef NET_USE_MMSG
+	net_recvring_t	*recvring[NS_COUNT];
+	net_sendqueue_t	*sendqueue[NS_COUNT][2];	// IPv4 and IPv6
+	net_batchstats_t	batchstats[NS_COUNT];
+#endif
+	net_wsring_t	wsring[NS_COUNT];
 } net_state_t;
 
 static net_state_t		net;
@@ -120,6 +219,14 @@ static CVAR_DEFINE( net_clientport, "clientport", "0", FCVAR_READ_ONLY, "network
 static CVAR_DEFINE( net_fakelag, "fakelag", "0", FCVAR_PRIVILEGED, "lag all incoming network data (including loopback) by xxx ms." );
 static CVAR_DEFINE( net_fakeloss, "fakeloss", "0", FCVAR_PRIVILEGED, "act like we dropped the packet this % of the time." );
 CVAR_DEFINE( net_clockwindow, "clockwindow", "0.5", FCVAR_PRIVILEGED, "timewindow to execute client moves" );
+#ifdef NET_USE_MMSG
+static CVAR_DEFINE_AUTO( net_recvbatch, "1", FCVAR_PRIVILEGED, "drain sockets with recvmmsg into a ring of preallocated buffers" );
+static CVAR_DEFINE_AUTO( net_sendbatch, "0", FCVAR_PRIVILEGED, "queue server datagrams and send them with sendmmsg at the end of server frame" );
+static CVAR_DEFINE_AUTO( net_sendgso, "0", FCVAR_PRIVILEGED, "coalesce batched datagrams to the same address with UDP GSO" );
+#endif
+static CVAR_DEFINE_AUTO( net_wscoalesce, "1", FCVAR_PRIVILEGED, "send all server datagrams of a frame to a client as single websocket message" );
+static CVAR_DEFINE_AUTO( net_wsunreliable, "0", FCVAR_PRIVILEGED, "latest-wins delivery for unreliable websocket datagrams to peers that advertised it" );
+static CVAR_DEFINE_AUTO( net_wsbacklog, "0.25", FCVAR_PRIVILEGED, "seconds datagram may stay unacknowledged before websocket stream is considered backed up" );
 
 netadr_t			net_local;
 netadr_t			net6_local;
@@ -131,7 +238,7 @@ static CVAR_DEFINE( net_ip6clientport, "ip6_clientport", "0", FCVAR_READ_ONLY, "
 static CVAR_DEFINE_AUTO( net6_address, "0", FCVAR_PRIVILEGED|FCVAR_READ_ONLY, "contain local IPv6 address of current client" );
 
 
-static bool NET_GetWebSocketPacket(netsrc_t sock, netadr_t* from, byte* data, size_t* length);
+static bool NET_GetWebSocketPacket( netsrc_t sock, netadr_t *from, byte **out, size_t *length );
 static void NET_SendWebsocket(netsrc_t sock, int net_socket, const char* buf, size_t len, int flags, const struct sockaddr_storage* to, size_t tolen, size_t splitsize);
 
 /*
@@ -1441,6 +1548,210 @@ static qboolean NET_GetLong( byte *pData, int size, size_t *outSize, int splitsi
 	return false;
 }
 
+/*
+==================
+NET_ReceivedPacket
+
+handle datagram received from the socket
+src is returned back in *out if no processing required, otherwise it's copied to data
+==================
+*/
+static qboolean NET_ReceivedPacket( netsrc_t sock, netadr_t *from, byte *src, size_t size, byte *data, byte **out, size_t *length )
+{
+	*out = data;
+	*length = size;
+
+	// fast path: nobody needs to touch the data
+	if( net.fakelag <= 0.0f && !( sock == NS_CLIENT && *(int *)src == NET_HEADER_SPLITPACKET ))
+	{
+		NET_ClearLagData( true, true );
+		*out = src;
+		return true;
+	}
+
+	// Transfer data
+	if( src != data )
+		memcpy( data, src, size );
+#if !XASH_DEDICATED
+	if( CL_LegacyMode( ))
+		return NET_LagPacket( true, sock, from, length, data );
+
+	// check for split message
+	if( sock == NS_CLIENT && *(int *)data == NET_HEADER_SPLITPACKET )
+	{
+		return NET_GetLong( data, size, length, CL_GetSplitSize( ));
+	}
+#endif
+	// lag the packet, if needed
+	return NET_LagPacket( true, sock, from, length, data );
+}
+
+/*
+==================
+NET_ReceiveError
+
+report unexpected socket errors
+==================
+*/
+static void NET_ReceiveError( const char *func, const netadr_t *from )
+{
+	int	err = WSAGetLastError();
+
+	switch( err )
+	{
+	case WSAEWOULDBLOCK:
+	case WSAECONNRESET:
+	case WSAECONNREFUSED:
+	case WSAEMSGSIZE:
+	case WSAETIMEDOUT:
+		break;
+	default:	// let's continue even after errors
+		if( from )
+			Con_DPrintf( S_ERROR "%s: %s from %s\n", func, NET_ErrorString(), NET_AdrToString( *from ));
+		else Con_DPrintf( S_ERROR "%s: %s\n", func, NET_ErrorString());
+		break;
+	}
+}
+
+#ifdef NET_USE_MMSG
+/*
+==================
+NET_GetRecvRing
+
+allocate receive ring on first use
+==================
+*/
+static net_recvring_t *NET_GetRecvRing( netsrc_t sock )
+{
+	net_recvring_t	*ring = net.recvring[sock];
+	int		i;
+
+	if( ring )
+		return ring;
+
+	ring = net.recvring[sock] = (net_recvring_t *)Z_Calloc( sizeof( net_recvring_t ));
+
+	for( i = 0; i < NET_RECV_BATCH; i++ )
+	{
+		ring->iov[i].iov_base = ring->data[i];
+		ring->iov[i].iov_len = sizeof( ring->data[i] );
+		ring->hdr[i].msg_hdr.msg_name = &ring->addr[i];
+		ring->hdr[i].msg_hdr.msg_iov = &ring->iov[i];
+		ring->hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return ring;
+}
+
+/*
+==================
+NET_FreeRecvRings
+==================
+*/
+static void NET_FreeRecvRings( void )
+{
+	int	i;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+		if( !net.recvring[i] )
+			continue;
+
+		Mem_Free( net.recvring[i] );
+		net.recvring[i] = NULL;
+	}
+}
+
+/*
+==================
+NET_FillRecvRing
+
+drain IPv4 and IPv6 sockets into the ring
+the protocol polled first is alternated, so one can't starve another
+==================
+*/
+static qboolean NET_FillRecvRing( netsrc_t sock, net_recvring_t *ring )
+{
+	net_batchstats_t	*stats = &net.batchstats[sock];
+	int		i, j, ret, count = 0;
+
+	for( i = 0; i < 2 && count < NET_RECV_BATCH; i++ )
+	{
+		int	net_socket = (( i + ring->turn ) & 1 ) ? net.ip6_sockets[sock] : net.ip_sockets[sock];
+
+		if( !NET_IsSocketValid( net_socket ))
+			continue;
+
+		for( j = count; j < NET_RECV_BATCH; j++ )
+		{
+			ring->hdr[j].msg_hdr.msg_namelen = sizeof( ring->addr[j] );
+			ring->hdr[j].msg_hdr.msg_flags = 0;
+			ring->hdr[j].msg_len = 0;
+		}
+
+		ret = recvmmsg( net_socket, &ring->hdr[count], NET_RECV_BATCH - count, MSG_DONTWAIT, NULL );
+
+		if( NET_IsSocketError( ret ))
+		{
+			NET_ReceiveError( "NET_FillRecvRing", NULL );
+			continue;
+		}
+
+		count += ret;
+		stats->recv_calls++;
+	}
+
+	ring->turn ^= 1;
+	ring->head = 0;
+	ring->count = count;
+
+	stats->recv_packets += count;
+	if( count > stats->recv_maxbatch )
+		stats->recv_maxbatch = count;
+
+	return count > 0;
+}
+
+/*
+==================
+NET_QueueBatchedPacket
+
+read next datagram from the ring, refill it when empty
+==================
+*/
+static qboolean NET_QueueBatchedPacket( netsrc_t sock, netadr_t *from, byte *data, byte **out, size_t *length )
+{
+	net_recvring_t	*ring = NET_GetRecvRing( sock );
+
+	*length = 0;
+
+	while( ring->head < ring->count || NET_FillRecvRing( sock, ring ))
+	{
+		int	slot = ring->head++;
+		size_t	size = ring->hdr[slot].msg_len;
+
+		NET_SockadrToNetadr( &ring->addr[slot], from );
+
+		if( size >= NET_MAX_FRAGMENT || FBitSet( ring->hdr[slot].msg_hdr.msg_flags, MSG_TRUNC ))
+		{
+			Con_Reportf( "NET_QueuePacket: oversize packet from %s\n", NET_AdrToString( *from ));
+			continue;
+		}
+
+		if( size < sizeof( int ))
+		{
+			// NET_ReceivedPacket peeks the header
+			memset( ring->data[slot] + size, 0, sizeof( int ) - size );
+		}
+
+		return NET_ReceivedPacket( sock, from, ring->data[slot], size, data, out, length );
+	}
+
+	*out = data;
+	return NET_LagPacket( false, sock, from, length, data );
+}
+#endif // NET_USE_MMSG
+
 /*
 ==================
 NET_QueuePacket
@@ -1449,10 +1760,10 @@ queue normal and lagged packets
 ==================
 */
 
-static qboolean NET_QueuePacket( netsrc_t sock, netadr_t *from, byte *data, size_t *length )
+static qboolean NET_QueuePacket( netsrc_t sock, netadr_t *from, byte *data, byte **out, size_t *length )
 {
 #ifdef XASH_WEBSOCKET
-	return NET_GetWebSocketPacket(sock, from, data, length);
+	return NET_GetWebSocketPacket( sock, from, out, length );
 #else
 	byte		buf[NET_MAX_FRAGMENT];
 	int		ret, protocol;
@@ -1460,7 +1771,13 @@ static qboolean NET_QueuePacket( netsrc_t sock, netadr_t *from, byte *data, size
 	WSAsize_t	addr_len;
 	struct sockaddr_storage	addr = { 0 };
 
+#ifdef NET_USE_MMSG
+	if( net_recvbatch.value )
+		return NET_QueueBatchedPacket( sock, from, data, out, length );
+#endif
+
 	*length = 0;
+	*out = data;
 
 	for( protocol = 0; protocol < 2; protocol++ )
 	{
@@ -1483,21 +1800,20 @@ static qboolean NET_QueuePacket( netsrc_t sock, netadr_t *from, byte *data, size
 		{
 			if( ret < NET_MAX_FRAGMENT )
 			{
-				// Transfer data
-				memcpy( data, buf, ret );
-				*length = ret;
-#if !XASH_DEDICATED
-				if( CL_LegacyMode( ))
-					return NET_LagPacket( true, sock, from, length, data );
+				if( ret < sizeof( int ))
+					memset( buf + ret, 0, sizeof( int ) - ret );
 
-				// check for split message
-				if( sock == NS_CLIENT && *(int *)data == NET_HEADER_SPLITPACKET )
+				if( !NET_ReceivedPacket( sock, from, buf, ret, data, out, length ))
+					return false;
+
+				// stack buffer can't leave this function
+				if( *out == buf )
 				{
-					return NET_GetLong( data, ret, length, CL_GetSplitSize( ));
+					memcpy( data, buf, *length );
+					*out = data;
 				}
-#endif
-				// lag the packet, if needed
-				return NET_LagPacket( true, sock, from, length, data );
+
+				return true;
 			}
 			else
 			{
@@ -1506,20 +1822,7 @@ static qboolean NET_QueuePacket( netsrc_t sock, netadr_t *from, byte *data, size
 		}
 		else
 		{
-			int	err = WSAGetLastError();
-
-			switch( err )
-			{
-			case WSAEWOULDBLOCK:
-			case WSAECONNRESET:
-			case WSAECONNREFUSED:
-			case WSAEMSGSIZE:
-			case WSAETIMEDOUT:
-				break;
-			default:	// let's continue even after errors
-				Con_DPrintf( S_ERROR "NET_QueuePacket: %s from %s\n", NET_ErrorString(), NET_AdrToString( *from ));
-				break;
-			}
+			NET_ReceiveError( "NET_QueuePacket", from );
 		}
 	}
 
@@ -1529,28 +1832,51 @@ static qboolean NET_QueuePacket( netsrc_t sock, netadr_t *from, byte *data, size
 
 /*
 ==================
-NET_GetPacket
+NET_GetPacketEx
 
-Never called by the game logic, just the system event queing
+Same as NET_GetPacket but may return pointer to internal receive buffer
+in *out instead of copying the datagram. Valid until the next call
 ==================
 */
-qboolean NET_GetPacket( netsrc_t sock, netadr_t *from, byte *data, size_t *length )
+qboolean NET_GetPacketEx( netsrc_t sock, netadr_t *from, byte *data, byte **out, size_t *length )
 {
-	if( !data || !length )
+	if( !data || !out || !length )
 		return false;
 
 	NET_AdjustLag();
 
+	*out = data;
+
 	if( NET_GetLoopPacket( sock, from, data, length ))
 	{
 		return NET_LagPacket( true, sock, from, length, data );
 	}
 	else
 	{
-		return NET_QueuePacket( sock, from, data, length );
+		return NET_QueuePacket( sock, from, data, out, length );
 	}
 }
 
+/*
+==================
+NET_GetPacket
+
+Never called by the game logic, just the system event queing
+==================
+*/
+qboolean NET_GetPacket( netsrc_t sock, netadr_t *from, byte *data, size_t *length )
+{
+	byte	*out;
+
+	if( !NET_GetPacketEx( sock, from, data, &out, length ))
+		return false;
+
+	if( out != data )
+		memcpy( data, out, *length );
+
+	return true;
+}
+
 /*
 ==================
 NET_SendLong
@@ -1625,104 +1951,635 @@ static int NET_SendLong( netsrc_t sock, int net_socket, const char *buf, size_t
 
 /*
 ==================
-NET_SendPacketEx
+NET_SendError
+
+report socket error after sendto/sendmmsg
 ==================
 */
-void NET_SendPacketEx( netsrc_t sock, size_t length, const void *data, netadr_t to, size_t splitsize )
+static void NET_SendError( const netadr_t *to )
 {
-	int		ret;
-	struct sockaddr_storage	addr = { 0 };
-	SOCKET		net_socket = 0;
+	int err = WSAGetLastError();
 
-	if( !net.initialized || to.type == NA_LOOPBACK )
-	{
-		NET_SendLoopPacket( sock, length, data, to );
+	// WSAEWOULDBLOCK is silent
+	if( err == WSAEWOULDBLOCK )
 		return;
-	}
-	else if( to.type == NA_BROADCAST || to.type == NA_IP )
+
+	// some PPP links don't allow broadcasts
+	if( err == WSAEADDRNOTAVAIL && ( to->type == NA_BROADCAST || to->type6 == NA_MULTICAST_IP6 ))
+		return;
+
+	if( Host_IsDedicated( ))
 	{
-		net_socket = net.ip_sockets[sock];
-		if( !NET_IsSocketValid( net_socket ))
-			return;
+		Con_DPrintf( S_ERROR "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( *to ));
 	}
-	else if( to.type6 == NA_MULTICAST_IP6 || to.type6 == NA_IP6 )
+	else if( err == WSAEADDRNOTAVAIL || err == WSAENOBUFS )
 	{
-		net_socket = net.ip6_sockets[sock];
-		if( !NET_IsSocketValid( net_socket ))
-			return;
+		Con_DPrintf( S_ERROR "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( *to ));
 	}
 	else
 	{
-		Host_Error( "NET_SendPacket: bad address type %i (%i)\n", to.type, to.type6 );
+		Con_Printf( S_ERROR "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( *to ));
 	}
+}
 
-	NET_NetadrToSockadr( &to, &addr );
+#ifdef NET_USE_MMSG
+/*
+==================
+NET_SendQueueMessage
 
-	ret = NET_SendLong( sock, net_socket, (const char*)data, length, 0, &addr, NET_SockAddrLen( &addr ), splitsize );
+setup mmsghdr for queued datagrams [first, last)
+more than one datagram means they're sent as a single GSO message
+==================
+*/
+static void NET_SendQueueMessage( net_sendqueue_t *q, int msg, int first, int last )
+{
+	struct mmsghdr	*hdr = &q->hdr[msg];
+	size_t		total = q->offset[last - 1] + q->size[last - 1] - q->offset[first];
 
-	if( NET_IsSocketError( ret ))
-	{
-		int err = WSAGetLastError();
+	q->iov[msg].iov_base = q->buffer + q->offset[first];
+	q->iov[msg].iov_len = total;
+	q->first[msg] = first;
 
-		// WSAEWOULDBLOCK is silent
-		if( err == WSAEWOULDBLOCK )
-			return;
+	memset( hdr, 0, sizeof( *hdr ));
+	hdr->msg_hdr.msg_name = &q->addr[first];
+	hdr->msg_hdr.msg_namelen = q->addrlen[first];
+	hdr->msg_hdr.msg_iov = &q->iov[msg];
+	hdr->msg_hdr.msg_iovlen = 1;
 
-		// some PPP links don't allow broadcasts
-		if( err == WSAEADDRNOTAVAIL && ( to.type == NA_BROADCAST || to.type6 == NA_MULTICAST_IP6 ))
-			return;
+	if( last - first > 1 )
+	{
+		struct cmsghdr *cmsg;
 
-		if( Host_IsDedicated( ))
-		{
-			Con_DPrintf( S_ERROR "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( to ));
-		}
-		else if( err == WSAEADDRNOTAVAIL || err == WSAENOBUFS )
-		{
-			Con_DPrintf( S_ERROR "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( to ));
-		}
-		else
-		{
-			Con_Printf( S_ERROR "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( to ));
-		}
-	}
+		hdr->msg_hdr.msg_control = q->control[msg];
+		hdr->msg_hdr.msg_controllen = sizeof( q->control[msg] );
 
+		cmsg = CMSG_FIRSTHDR( &hdr->msg_hdr );
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ));
+		*(uint16_t *)CMSG_DATA( cmsg ) = q->size[first];
+	}
 }
 
 /*
 ==================
-NET_SendPacket
+NET_SendQueueCanSegment
+
+can datagram be appended to GSO message started at first
+all segments must go to same address and have same size, except the last one
 ==================
 */
-void NET_SendPacket( netsrc_t sock, size_t length, const void *data, netadr_t to )
+static qboolean NET_SendQueueCanSegment( const net_sendqueue_t *q, int first, int next )
 {
-	NET_SendPacketEx( sock, length, data, to, 0 );
+	if( next - first >= NET_SEND_BATCH )
+		return false;
+
+	if( q->addrlen[next] != q->addrlen[first] || memcmp( &q->addr[next], &q->addr[first], q->addrlen[first] ))
+		return false;
+
+	// previous datagram was shorter, so it must have been the last one
+	if( q->size[next - 1] != q->size[first] )
+		return false;
+
+	if( q->size[next] > q->size[first] )
+		return false;
+
+	if( q->offset[next] + q->size[next] - q->offset[first] > NET_GSO_MAX_SIZE )
+		return false;
+
+	return true;
 }
 
-class WebsocketClient : public Shared::NetworkingWS::Client
+/*
+==================
+NET_FlushQueue
+==================
+*/
+static void NET_FlushQueue( netsrc_t sock, net_sendqueue_t *q )
 {
-public:
-	using Shared::NetworkingWS::Client::Client;
+	net_batchstats_t	*stats = &net.batchstats[sock];
+	int		i, first, msgs = 0, done = 0;
 
-public:
-	std::list<sky::BitBuffer> mIncomingMessages;
+	if( !q || !q->count )
+		return;
 
-protected:
-	std::shared_ptr<Shared::NetworkingWS::Channel> createChannel() override
+	for( first = 0; first < q->count; )
 	{
-		auto channel = std::make_shared<Shared::NetworkingWS::SimpleChannel>();
-		channel->addMessageReader("msg", [this](sky::BitBuffer& msg) {
-			mIncomingMessages.push_back(msg);
-		});
-		return channel;
+		int last = first + 1;
+
+		if( net_sendgso.value )
+		{
+			while( last < q->count && NET_SendQueueCanSegment( q, first, last ))
+				last++;
+		}
+
+		NET_SendQueueMessage( q, msgs, first, last );
+
+		if( last - first > 1 )
+		{
+			stats->send_gso_messages++;
+			stats->send_gso_segments += last - first;
+		}
+
+		msgs++;
+		first = last;
 	}
-};
 
-#ifndef EMSCRIPTEN
-static int gServerChannelsCount = 1;
-static std::unordered_map<int, void*> gServerChannels;
+	while( done < msgs )
+	{
+		int ret = sendmmsg( q->net_socket, &q->hdr[done], msgs - done, 0 );
 
-class ServerChannel : public Shared::NetworkingWS::SimpleChannel
-{
+		stats->send_calls++;
+
+		if( NET_IsSocketError( ret ))
+		{
+			int	err = WSAGetLastError();
+			netadr_t	to;
+
+			// kernel without UDP GSO support, fallback to plain datagrams
+			if( q->hdr[done].msg_hdr.msg_controllen && ( err == EIO || err == EINVAL || err == ENOPROTOOPT || err == EOPNOTSUPP ))
+			{
+				int	start = q->first[done];
+				int	end = done + 1 < msgs ? q->first[done + 1] : q->count;
+
+				Con_Printf( S_WARN "NET_FlushQueue: UDP GSO is not supported, disabling net_sendgso\n" );
+				Cvar_DirectSet( &net_sendgso, "0" );
+
+				for( i = start; i < end; i++ )
+				{
+					if( NET_IsSocketError( sendto( q->net_socket, (const char *)q->buffer + q->offset[i], q->size[i], 0, (const struct sockaddr *)&q->addr[i], q->addrlen[i] )))
+					{
+						NET_SockadrToNetadr( &q->addr[i], &to );
+						NET_SendError( &to );
+					}
+				}
+			}
+			else
+			{
+				NET_SockadrToNetadr( (struct sockaddr_storage *)q->hdr[done].msg_hdr.msg_name, &to );
+				NET_SendError( &to );
+			}
+
+			// skip failed message
+			done++;
+			continue;
+		}
+
+		done += ret;
+	}
+
+	stats->send_packets += q->count;
+	if( q->count > stats->send_maxbatch )
+		stats->send_maxbatch = q->count;
+
+	q->count = 0;
+	q->used = 0;
+}
+
+/*
+==================
+NET_FlushSendQueue
+
+send everything queued for the sock
+==================
+*/
+void NET_FlushSendQueue( netsrc_t sock )
+{
+	NET_FlushQueue( sock, net.sendqueue[sock][0] );
+	NET_FlushQueue( sock, net.sendqueue[sock][1] );
+}
+
+/*
+==================
+NET_FreeSendQueues
+==================
+*/
+static void NET_FreeSendQueues( void )
+{
+	int	i, j;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+		for( j = 0; j < 2; j++ )
+		{
+			if( !net.sendqueue[i][j] )
+				continue;
+
+			Mem_Free( net.sendqueue[i][j] );
+			net.sendqueue[i][j] = NULL;
+		}
+	}
+}
+
+/*
+==================
+NET_QueueSendPacket
+
+copy datagram into the send queue, flush it first if there is no room
+==================
+*/
+static void NET_QueueSendPacket( netsrc_t sock, int net_socket, int protocol, const void *data, size_t length, const struct sockaddr_storage *to )
+{
+	net_sendqueue_t	*q = net.sendqueue[sock][protocol];
+	int		i;
+
+	if( !q )
+		q = net.sendqueue[sock][protocol] = (net_sendqueue_t *)Z_Calloc( sizeof( net_sendqueue_t ));
+
+	// socket was reopened
+	if( q->count && q->net_socket != net_socket )
+		NET_FlushQueue( sock, q );
+
+	if( q->count == NET_SEND_BATCH || q->used + length > sizeof( q->buffer ))
+		NET_FlushQueue( sock, q );
+
+	i = q->count++;
+	q->net_socket = net_socket;
+	q->offset[i] = q->used;
+	q->size[i] = length;
+	q->addr[i] = *to;
+	q->addrlen[i] = NET_SockAddrLen( to );
+	memcpy( q->buffer + q->used, data, length );
+	q->used += length;
+}
+#else
+static void NET_FlushWebsocket( void );
+
+void NET_FlushSendQueue( netsrc_t sock )
+{
+	if( sock == NS_SERVER )
+		NET_FlushWebsocket();
+}
+#endif // NET_USE_MMSG
+
+/*
+==================
+NET_SendPacketEx
+==================
+*/
+void NET_SendPacketEx( netsrc_t sock, size_t length, const void *data, netadr_t to, size_t splitsize )
+{
+	int		ret;
+	struct sockaddr_storage	addr = { 0 };
+	SOCKET		net_socket = 0;
+
+	if( !net.initialized || to.type == NA_LOOPBACK )
+	{
+		NET_SendLoopPacket( sock, length, data, to );
+		return;
+	}
+	else if( to.type == NA_BROADCAST || to.type == NA_IP )
+	{
+		net_socket = net.ip_sockets[sock];
+		if( !NET_IsSocketValid( net_socket ))
+			return;
+	}
+	else if( to.type6 == NA_MULTICAST_IP6 || to.type6 == NA_IP6 )
+	{
+		net_socket = net.ip6_sockets[sock];
+		if( !NET_IsSocketValid( net_socket ))
+			return;
+	}
+	else
+	{
+		Host_Error( "NET_SendPacket: bad address type %i (%i)\n", to.type, to.type6 );
+	}
+
+	NET_NetadrToSockadr( &to, &addr );
+
+#ifdef NET_USE_MMSG
+	if( sock == NS_SERVER )
+	{
+		int	protocol = net_socket == net.ip6_sockets[sock] ? 1 : 0;
+
+		// split packets are paced, never batch them
+		if( net_sendbatch.value && ( splitsize <= sizeof( SPLITPACKET ) || length <= splitsize ) && length < NET_MAX_FRAGMENT )
+		{
+			NET_QueueSendPacket( sock, net_socket, protocol, data, length, &addr );
+			return;
+		}
+
+		// keep the order of datagrams
+		NET_FlushQueue( sock, net.sendqueue[sock][protocol] );
+	}
+#endif
+
+	ret = NET_SendLong( sock, net_socket, (const char*)data, length, 0, &addr, NET_SockAddrLen( &addr ), splitsize );
+
+	if( NET_IsSocketError( ret ))
+		NET_SendError( &to );
+}
+
+/*
+==================
+NET_SendPacket
+==================
+*/
+void NET_SendPacket( netsrc_t sock, size_t length, const void *data, netadr_t to )
+{
+	NET_SendPacketEx( sock, length, data, to, 0 );
+}
+
+/*
+====================
+NET_TrimWebsocketRing
+
+free buffers of the slots that hold nothing, except
+the one handed out by the last NET_GetWebSocketPacket
+====================
+*/
+static void NET_TrimWebsocketRing( net_wsring_t *ring )
+{
+	int	i, last = ( ring->head + NET_WS_RING - 1 ) % NET_WS_RING;
+
+	for( i = 0; i < NET_WS_RING; i++ )
+	{
+		if( !ring->data[i] || i == last || ( i - ring->head + NET_WS_RING ) % NET_WS_RING < ring->count )
+			continue;
+
+		Mem_Free( ring->data[i] );
+		ring->allocated -= ring->size[i];
+		ring->data[i] = NULL;
+		ring->size[i] = 0;
+	}
+}
+
+/*
+====================
+NET_WebsocketSlot
+
+returns free inbound slot with room for length bytes or NULL
+====================
+*/
+static byte *NET_WebsocketSlot( netsrc_t sock, int channel, size_t length, qboolean unreliable )
+{
+	net_wsring_t	*ring = &net.wsring[sock];
+	int		i, j;
+
+	// keep the slot returned by the last NET_GetWebSocketPacket intact
+	if( ring->count >= NET_WS_RING - 1 )
+	{
+		ring->dropped++;
+		return NULL;
+	}
+
+	// latest wins, engine will skip older unreliable datagram of this channel
+	if( unreliable )
+	{
+		for( j = 0; j < ring->count; j++ )
+		{
+			i = ( ring->head + j ) % NET_WS_RING;
+
+			if( ring->unreliable[i] && !ring->stale[i] && ring->channel[i] == channel )
+			{
+				ring->stale[i] = true;
+				ring->superseded++;
+			}
+		}
+	}
+
+	i = ( ring->head + ring->count ) % NET_WS_RING;
+
+	if( ring->size[i] < length )
+	{
+		size_t size = Q_max( length, (size_t)1 );
+
+		size = ( size + NET_WS_SLOT_ALIGN - 1 ) & ~( NET_WS_SLOT_ALIGN - 1 );
+
+		// give back buffers of the idle slots before going over the cap
+		if( ring->allocated - ring->size[i] + size > NET_WS_RING_BYTES )
+			NET_TrimWebsocketRing( ring );
+
+		if( ring->allocated - ring->size[i] + size > NET_WS_RING_BYTES )
+		{
+			ring->dropped++;
+			return NULL;
+		}
+
+		if( ring->data[i] )
+			Mem_Free( ring->data[i] );
+
+		ring->allocated += size - ring->size[i];
+		ring->size[i] = size;
+		ring->data[i] = (byte *)Z_Malloc( size );
+	}
+
+	ring->length[i] = length;
+	ring->channel[i] = channel;
+	ring->unreliable[i] = unreliable;
+	ring->stale[i] = false;
+	ring->count++;
+
+	return ring->data[i];
+}
+
+/*
+====================
+NET_WebsocketUnreliable
+
+netchan datagram without reliable data and fragments,
+newer one makes it useless
+====================
+*/
+static qboolean NET_WebsocketUnreliable( const void *data, size_t length )
+{
+	uint	sequence;
+
+	if( length < 8 )
+		return false;
+
+	memcpy( &sequence, data, sizeof( sequence ));
+	sequence = LittleLong( sequence );
+
+	// connectionless and split packets have both bits set
+	return FBitSet( sequence, BIT( 31 ) | BIT( 30 )) ? false : true;
+}
+
+/*
+====================
+NET_WebsocketFlowSent
+====================
+*/
+static void NET_WebsocketFlowSent( net_wsflow_t *flow, uint sequence, double time )
+{
+	// netchan was reset, forget the old stream
+	if( sequence <= flow->sent )
+		flow->acked = sequence - 1;
+
+	flow->sent = sequence;
+	flow->senttime[sequence & ( NET_WS_FLOW_BACKUP - 1 )] = time;
+}
+
+/*
+====================
+NET_WebsocketFlowAcked
+====================
+*/
+static void NET_WebsocketFlowAcked( net_wsflow_t *flow, uint ack )
+{
+	if( ack > flow->acked && ack <= flow->sent )
+		flow->acked = ack;
+}
+
+/*
+====================
+NET_WebsocketBackedUp
+
+true if oldest unacknowledged datagram waits longer than maxlag
+====================
+*/
+static qboolean NET_WebsocketBackedUp( const net_wsflow_t *flow, double time, double maxlag )
+{
+	uint	oldest;
+
+	if( flow->acked >= flow->sent )
+		return false;
+
+	if( flow->sent - flow->acked >= NET_WS_FLOW_BACKUP )
+		return true;
+
+	oldest = ( flow->acked + 1 ) & ( NET_WS_FLOW_BACKUP - 1 );
+
+	return ( time - flow->senttime[oldest] ) > maxlag;
+}
+
+/*
+====================
+NET_WebsocketSequences
+
+read netchan sequence and ack, false for connectionless packets
+====================
+*/
+static qboolean NET_WebsocketSequences( const void *data, size_t length, uint *sequence, uint *ack )
+{
+	uint	w[2];
+
+	if( length < sizeof( w ))
+		return false;
+
+	memcpy( w, data, sizeof( w ));
+	w[0] = LittleLong( w[0] );
+	w[1] = LittleLong( w[1] );
+
+	if( w[0] == (uint)NET_HEADER_OUTOFBANDPACKET || w[0] == (uint)NET_HEADER_SPLITPACKET )
+		return false;
+
+	*sequence = w[0] & ~( BIT( 31 ) | BIT( 30 ));
+	*ack = w[1] & ~( BIT( 31 ) | BIT( 30 ));
+
+	return true;
+}
+
+/*
+====================
+NET_WebsocketRead
+
+store single datagram into inbound ring
+====================
+*/
+static void NET_WebsocketRead( netsrc_t sock, int channel, sky::BitBuffer &msg, qboolean unreliable, net_wsflow_t *flow )
+{
+	size_t	length = msg.getRemaining();
+	uint	sequence, ack;
+	byte	*data;
+
+	if(( data = NET_WebsocketSlot( sock, channel, length, unreliable )) == NULL )
+		return;
+
+	msg.read( data, length );
+
+	if( flow && NET_WebsocketSequences( data, length, &sequence, &ack ))
+		NET_WebsocketFlowAcked( flow, ack );
+}
+
+/*
+====================
+NET_WebsocketReadBatch
+
+split coalesced message, see NET_FlushWebsocket
+====================
+*/
+static void NET_WebsocketReadBatch( netsrc_t sock, int channel, sky::BitBuffer &msg, net_wsflow_t *flow )
+{
+	while( msg.getRemaining() >= sizeof( uint32_t ))
+	{
+		uint32_t	header = msg.read<uint32_t>();
+		size_t	length = header & ~BIT( 31 );
+		uint	sequence, ack;
+		byte	*data;
+
+		if( length > msg.getRemaining( ))
+			break; // broken message
+
+		if(( data = NET_WebsocketSlot( sock, channel, length, FBitSet( header, BIT( 31 )) ? true : false )) != NULL )
+		{
+			msg.read( data, length );
+
+			if( flow && NET_WebsocketSequences( data, length, &sequence, &ack ))
+				NET_WebsocketFlowAcked( flow, ack );
+		}
+		else
+		{
+			while( length-- )
+				msg.read<uint8_t>();
+		}
+	}
+}
+
+/*
+====================
+NET_FreeWebsocketRings
+====================
+*/
+static void NET_FreeWebsocketRings( void )
+{
+	int	i, j;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+		net_wsring_t *ring = &net.wsring[i];
+
+		for( j = 0; j < NET_WS_RING; j++ )
+		{
+			if( ring->data[j] )
+				Mem_Free( ring->data[j] );
+		}
+
+		memset( ring, 0, sizeof( *ring ));
+	}
+}
+
+class WebsocketClient : public Shared::NetworkingWS::Client
+{
+public:
+	using Shared::NetworkingWS::Client::Client;
+
+protected:
+	std::shared_ptr<Shared::NetworkingWS::Channel> createChannel() override
+	{
+		auto channel = std::make_shared<Shared::NetworkingWS::SimpleChannel>();
+		channel->addMessageReader("msg", [](sky::BitBuffer& msg) {
+			NET_WebsocketRead(NS_CLIENT, 0, msg, false, nullptr);
+		});
+		channel->addMessageReader("umsg", [](sky::BitBuffer& msg) {
+			NET_WebsocketRead(NS_CLIENT, 0, msg, true, nullptr);
+		});
+		channel->addMessageReader("msgs", [](sky::BitBuffer& msg) {
+			NET_WebsocketReadBatch(NS_CLIENT, 0, msg, nullptr);
+		});
+		return channel;
+	}
+};
+
+#ifndef EMSCRIPTEN
+class ServerChannel;
+
+static int gServerChannelsCount = 1;
+static std::unordered_map<int, ServerChannel*> gServerChannels; // netadr_t::ip4 -> channel
+static std::vector<int> gPendingChannels; // channels with coalesced datagrams
+
+class ServerChannel : public Shared::NetworkingWS::SimpleChannel
+{
 public:
 	ServerChannel() : SimpleChannel()
 	{
@@ -1745,6 +2602,18 @@ public:
 
 public:
 	int index = 0;
+
+	// datagrams sent during the frame, each prefixed by uint32 length,
+	// high bit of the length marks unreliable datagram
+	std::vector<uint8_t> pending;
+	int pendingCount = 0;
+	bool listed = false; // in gPendingChannels
+	bool coalesce = false; // client advertised NET_EXT_WSBATCH
+	bool unreliable = false; // client advertised NET_EXT_WSUNRELIABLE
+
+	// latest unreliable datagram held back while the stream is backed up
+	std::vector<uint8_t> held;
+	net_wsflow_t flow = {};
 };
 
 class WebsocketServer : public Shared::NetworkingWS::Server
@@ -1752,23 +2621,20 @@ class WebsocketServer : public Shared::NetworkingWS::Server
 public:
 	using Shared::NetworkingWS::Server::Server;
 
-public:
-	struct IncomingMsg
-	{
-		int channel_index;
-		sky::BitBuffer buf;
-	};
-	std::list<IncomingMsg> mIncomingMessages;
-
 protected:
 	std::shared_ptr<Shared::NetworkingWS::Channel> createChannel() override
 	{
 		auto channel = std::make_shared<ServerChannel>();
-		channel->addMessageReader("msg", [this, channel = std::weak_ptr(channel)](sky::BitBuffer& msg) {
-			IncomingMsg in_msg;
-			in_msg.channel_index = channel.lock()->index;
-			in_msg.buf = msg;
-			mIncomingMessages.push_back(in_msg);
+		auto index = channel->index;
+		auto flow = &channel->flow;
+		channel->addMessageReader("msg", [index, flow](sky::BitBuffer& msg) {
+			NET_WebsocketRead(NS_SERVER, index, msg, false, flow);
+		});
+		channel->addMessageReader("umsg", [index, flow](sky::BitBuffer& msg) {
+			NET_WebsocketRead(NS_SERVER, index, msg, true, flow);
+		});
+		channel->addMessageReader("msgs", [index, flow](sky::BitBuffer& msg) {
+			NET_WebsocketReadBatch(NS_SERVER, index, msg, flow);
 		});
 		return channel;
 	}
@@ -1776,6 +2642,7 @@ protected:
 #endif
 
 static std::optional<WebsocketClient> gWebsocketClient;
+static bool gWebsocketServerUnreliable = false; // server advertised NET_EXT_WSUNRELIABLE
 #ifndef EMSCRIPTEN
 static std::optional<WebsocketServer> gWebsocketServer;
 #endif
@@ -1810,6 +2677,7 @@ static int NET_CreateWebSocketClient(const std::string& server_address)
 void NET_DestroyClientWebsocket()
 {
 	gWebsocketClient.reset();
+	net.wsring[NS_CLIENT].head = net.wsring[NS_CLIENT].count = 0;
 	net.ip_sockets[NS_CLIENT] = 0;
 }
 
@@ -1831,61 +2699,240 @@ static int NET_CreateWebSocketServer(uint16_t port)
 	return WEBSOCKET_OK;
 }
 
-static bool NET_GetWebSocketPacket(netsrc_t sock, netadr_t* from, byte* data, size_t* length)
+/*
+====================
+NET_GetWebSocketPacket
+
+returns pointer to the pooled slot, it's valid until the next call
+====================
+*/
+static bool NET_GetWebSocketPacket( netsrc_t sock, netadr_t *from, byte **out, size_t *length )
 {
-	if (sock == NS_CLIENT)
+	net_wsring_t	*ring = &net.wsring[sock];
+	int		i;
+
+	do
 	{
-#ifndef XASH_DEDICATED
-		if (!gWebsocketClient.has_value())
+		if( !ring->count )
 			return false;
 
-		auto& msgs = gWebsocketClient.value().mIncomingMessages;
+		i = ring->head;
+		ring->head = ( ring->head + 1 ) % NET_WS_RING;
+		ring->count--;
+	} while( ring->stale[i] );
 
-		if (msgs.empty())
-			return false;
-
-		auto& msg = msgs.front();
-		*length = msg.getRemaining();
-		msg.read(data, *length);
-		msgs.pop_front();
+	*out = ring->data[i];
+	*length = ring->length[i];
 
+	if( sock == NS_CLIENT )
+	{
+#ifndef XASH_DEDICATED
 		*from = cls.serveradr;
-
 		return true;
 #else
 		return false;
 #endif
 	}
-	else if (sock == NS_SERVER)
+
+	from->ip4 = ring->channel[i];
+	from->port = 1337;
+	from->type = NA_IP;
+
+	return true;
+}
+
+#ifndef EMSCRIPTEN
+/*
+====================
+NET_SendWebsocketChannel
+====================
+*/
+static void NET_SendWebsocketChannel( ServerChannel *channel, const char *name, const void *data, size_t length )
+{
+	const auto& channels = gWebsocketServer.value().getChannels();
+	auto bitbuf = sky::BitBuffer();
+
+	bitbuf.write((void*)data, length);
+	channels.at(channel->getHdl())->sendReliable(name, bitbuf);
+}
+#endif
+
+#ifndef EMSCRIPTEN
+/*
+====================
+NET_QueueWebsocket
+====================
+*/
+static void NET_QueueWebsocket( ServerChannel *channel, const void *data, size_t length, qboolean unreliable )
+{
+	uint	sequence, ack;
+
+	if( NET_WebsocketSequences( data, length, &sequence, &ack ))
+	{
+		NET_WebsocketFlowSent( &channel->flow, sequence, host.realtime );
+
+		// peer drops anything older than this datagram
+		channel->held.clear();
+	}
+
+	if( !net_wscoalesce.value || !channel->coalesce )
 	{
+		NET_SendWebsocketChannel( channel, unreliable ? "umsg" : "msg", data, length );
+		return;
+	}
+
+	uint32_t header = length;
+	auto& pending = channel->pending;
+	auto offset = pending.size();
+
+	if( unreliable )
+		SetBits( header, BIT( 31 ));
+
+	pending.resize( offset + sizeof( header ) + length );
+	memcpy( pending.data() + offset, &header, sizeof( header ));
+	memcpy( pending.data() + offset + sizeof( header ), data, length );
+	channel->pendingCount++;
+
+	if( !channel->listed )
+	{
+		channel->listed = true;
+		gPendingChannels.push_back( channel->index );
+	}
+}
+#endif
+
+/*
+====================
+NET_FlushWebsocket
+
+send datagrams coalesced during the frame,
+single message per client
+====================
+*/
+static void NET_FlushWebsocket( void )
+{
 #ifndef EMSCRIPTEN
-		if (!gWebsocketServer.has_value())
-			return false;
+	static std::vector<int> walking, waiting;
+	static std::vector<uint8_t> held;
 
-		auto& msgs = gWebsocketServer.value().mIncomingMessages;
+	if( !gWebsocketServer.has_value( ))
+	{
+		gPendingChannels.clear();
+		return;
+	}
 
-		if (msgs.empty())
-			return false;
+	// walk a private copy, gPendingChannels is only appended after the loop
+	walking.clear();
+	walking.swap( gPendingChannels );
+	waiting.clear();
 
-		auto& msg = msgs.front();
-		*length = msg.buf.getRemaining();
-		msg.buf.read(data, *length);
+	for( int index : walking )
+	{
+		auto it = gServerChannels.find( index );
 
-		from->ip4 = msg.channel_index;
-		from->port = 1337;
-		from->type = NA_IP;
+		if( it == gServerChannels.end( ))
+			continue; // disconnected during the frame
 
-		msgs.pop_front();
+		ServerChannel *channel = it->second;
 
-		return true;
-#else
-		return false;
+		// stays listed while walked, so queueing the held
+		// datagram below doesn't list it once more
+		if( !channel->held.empty( ))
+		{
+			if( NET_WebsocketBackedUp( &channel->flow, host.realtime, net_wsbacklog.value ))
+			{
+				waiting.push_back( channel->index );
+			}
+			else
+			{
+				held.swap( channel->held );
+				NET_QueueWebsocket( channel, held.data(), held.size(), true );
+			}
+		}
+
+		if( channel->pendingCount == 1 )
+		{
+			uint32_t header;
+
+			memcpy( &header, channel->pending.data(), sizeof( header ));
+
+			// old clients understand only the single datagrams
+			NET_SendWebsocketChannel( channel, FBitSet( header, BIT( 31 )) ? "umsg" : "msg",
+				channel->pending.data() + sizeof( header ), channel->pending.size() - sizeof( header ));
+		}
+		else if( channel->pendingCount > 1 )
+		{
+			NET_SendWebsocketChannel( channel, "msgs", channel->pending.data(), channel->pending.size( ));
+		}
+
+		channel->pending.clear(); // keeps the capacity
+		channel->pendingCount = 0;
+		channel->listed = false;
+	}
+
+	for( int index : waiting )
+	{
+		auto it = gServerChannels.find( index );
+
+		if( it != gServerChannels.end( ) && !it->second->listed )
+		{
+			it->second->listed = true;
+			gPendingChannels.push_back( index );
+		}
+	}
+#endif
+}
+
+/*
+====================
+NET_WebsocketSetCoalesce
+
+called on connect, the client has to understand "msgs"
+before its datagrams can be coalesced
+====================
+*/
+void NET_WebsocketSetCoalesce( netadr_t adr, qboolean enable )
+{
+#ifndef EMSCRIPTEN
+	auto it = gServerChannels.find( adr.ip4 );
+
+	if( adr.type != NA_IP || it == gServerChannels.end( ))
+		return;
+
+	it->second->coalesce = enable ? true : false;
 #endif
+}
+
+/*
+====================
+NET_WebsocketSetUnreliable
+
+called on connect, the peer has to understand "umsg"
+before unreliable datagrams can be sent as such
+====================
+*/
+void NET_WebsocketSetUnreliable( netsrc_t sock, netadr_t adr, qboolean enable )
+{
+	if( sock == NS_CLIENT )
+	{
+		gWebsocketServerUnreliable = enable ? true : false;
+		return;
 	}
+
+#ifndef EMSCRIPTEN
+	auto it = gServerChannels.find( adr.ip4 );
+
+	if( adr.type != NA_IP || it == gServerChannels.end( ))
+		return;
+
+	it->second->unreliable = enable ? true : false;
+#endif
 }
 
 static void NET_SendWebsocket(netsrc_t sock, int net_socket, const char* buf, size_t len, int flags, const struct sockaddr_storage* to, size_t tolen, size_t splitsize)
 {
+	qboolean unreliable = net_wsunreliable.value && NET_WebsocketUnreliable(buf, len);
+
 	if (sock == NS_CLIENT)
 	{
 		assert(gWebsocketClient.has_value());
@@ -1893,32 +2940,44 @@ static void NET_SendWebsocket(netsrc_t sock, int net_socket, const char* buf, si
 		if (!gWebsocketClient.value().isConnected())
 			return;
 
+		unreliable = unreliable && gWebsocketServerUnreliable;
+
 		auto bitbuf = sky::BitBuffer();
 		bitbuf.write((void*)buf, len);
-		gWebsocketClient.value().getChannel()->sendReliable("msg", bitbuf);
+		gWebsocketClient.value().getChannel()->sendReliable(unreliable ? "umsg" : "msg", bitbuf);
 	}
 	else if (sock == NS_SERVER)
 	{
 #ifndef EMSCRIPTEN
 		assert(gWebsocketServer.has_value());
-		auto bitbuf = sky::BitBuffer();
-		bitbuf.write((void*)buf, len);
 
 		netadr_t adr;
 		NET_SockadrToNetadr(to, &adr);
 
-		const auto& channels = gWebsocketServer.value().getChannels();
+		auto it = gServerChannels.find(adr.ip4);
+
+		if (it == gServerChannels.end())
+			return;
+
+		ServerChannel *channel = it->second;
+
+		// older peers have no "umsg" reader
+		unreliable = unreliable && channel->unreliable;
 
-		for (const auto& [index, ptr] : gServerChannels)
+		// don't feed the stalled stream, keep only the newest snapshot
+		if (unreliable && NET_WebsocketBackedUp(&channel->flow, host.realtime, net_wsbacklog.value))
 		{
-			if (adr.ip4 != index)
-				continue;
+			channel->held.assign((const uint8_t*)buf, (const uint8_t*)buf + len);
 
-			auto server_channel = (ServerChannel*)ptr;
-			auto hdl = server_channel->getHdl();
-			channels.at(hdl)->sendReliable("msg", bitbuf);
+			if (!channel->listed)
+			{
+				channel->listed = true;
+				gPendingChannels.push_back(channel->index);
+			}
 			return;
 		}
+
+		NET_QueueWebsocket(channel, buf, len, unreliable);
 #endif
 	}
 }
@@ -2260,6 +3319,8 @@ void NET_Config( qboolean multiplayer, qboolean changeport, std::optional<std::s
 		// shut down any existing sockets
 		for( i = 0; i < NS_COUNT; i++ )
 		{
+			NET_FlushSendQueue( (netsrc_t)i );
+
 			if( NET_IsSocketValid( net.ip_sockets[i] ))
 			{
 				closesocket( net.ip_sockets[i] );
@@ -2271,6 +3332,10 @@ void NET_Config( qboolean multiplayer, qboolean changeport, std::optional<std::s
 				closesocket( net.ip6_sockets[i] );
 				net.ip6_sockets[i] = INVALID_SOCKET;
 			}
+#ifdef NET_USE_MMSG
+			if( net.recvring[i] )
+				net.recvring[i]->head = net.recvring[i]->count = 0;
+#endif
 		}
 	}
 
@@ -2354,6 +3419,36 @@ void NET_ClearLagData( qboolean bClient, qboolean bServer )
 	if( bServer ) NET_ClearLaggedList( &net.lagdata[NS_SERVER] );
 }
 
+#ifdef NET_USE_MMSG
+/*
+====================
+NET_BatchStats_f
+====================
+*/
+static void NET_BatchStats_f( void )
+{
+	const char	*names[NS_COUNT] = { "client", "server" };
+	int		i;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+		const net_batchstats_t *stats = &net.batchstats[i];
+
+		Con_Printf( "%s socket:\n", names[i] );
+		Con_Printf( "  recvmmsg calls: %lu, datagrams: %lu, avg batch: %.2f, max batch: %lu\n",
+			(unsigned long)stats->recv_calls, (unsigned long)stats->recv_packets,
+			stats->recv_calls ? (double)stats->recv_packets / stats->recv_calls : 0.0,
+			(unsigned long)stats->recv_maxbatch );
+		Con_Printf( "  sendmmsg calls: %lu, datagrams: %lu, avg batch: %.2f, max batch: %lu\n",
+			(unsigned long)stats->send_calls, (unsigned long)stats->send_packets,
+			stats->send_calls ? (double)stats->send_packets / stats->send_calls : 0.0,
+			(unsigned long)stats->send_maxbatch );
+		Con_Printf( "  GSO messages: %lu, segments: %lu\n",
+			(unsigned long)stats->send_gso_messages, (unsigned long)stats->send_gso_segments );
+	}
+}
+#endif
+
 /*
 ====================
 NET_Init
@@ -2374,6 +3469,15 @@ void NET_Init( void )
 	Cvar_RegisterVariable( &net_clientport );
 	Cvar_RegisterVariable( &net_fakelag );
 	Cvar_RegisterVariable( &net_fakeloss );
+	Cvar_RegisterVariable( &net_wscoalesce );
+	Cvar_RegisterVariable( &net_wsunreliable );
+	Cvar_RegisterVariable( &net_wsbacklog );
+#ifdef NET_USE_MMSG
+	Cvar_RegisterVariable( &net_recvbatch );
+	Cvar_RegisterVariable( &net_sendbatch );
+	Cvar_RegisterVariable( &net_sendgso );
+	Cmd_AddCommand( "net_batchstats", NET_BatchStats_f, "show batched socket i/o statistics" );
+#endif
 
 	Q_snprintf( cmd, sizeof( cmd ), "%i", PORT_SERVER );
 	Cvar_FullSet( "hostport", cmd, FCVAR_READ_ONLY );
@@ -2447,6 +3551,11 @@ void NET_Shutdown( void )
 	NET_ClearLagData( true, true );
 
 	NET_Config( false, false );
+#ifdef NET_USE_MMSG
+	NET_FreeRecvRings();
+	NET_FreeSendQueues();
+#endif
+	NET_FreeWebsocketRings();
 #if XASH_WIN32
 	WSACleanup();
 #endif
@@ -3313,3 +4422,185 @@ void HTTP_Shutdown( void )
 
 	http.last_server = NULL;
 }
+
+#if XASH_ENGINE_TESTS
+
+#include "tests.h"
+
+#define WSSIM_TIME		20000	// milliseconds
+#define WSSIM_FRAME		33	// server sends snapshot every frame
+#define WSSIM_SIZE		1000	// snapshot bytes
+#define WSSIM_RATE		36	// link bytes per millisecond
+#define WSSIM_LATENCY		40	// one way
+#define WSSIM_RTO		300	// retransmission stall
+#define WSSIM_LOSS		45	// every Nth segment is lost
+#define WSSIM_SNAPSHOTS		( WSSIM_TIME / WSSIM_FRAME + 2 )
+
+/*
+====================
+Test_WebsocketLink
+
+stand-in for the websocket stream: in-order, rate limited,
+every lost segment stalls the link until retransmission.
+returns average and worst age of the snapshot shown by the client
+====================
+*/
+static void Test_WebsocketLink( qboolean latestwins, double *avg, double *worst )
+{
+	static int	generated[WSSIM_SNAPSHOTS], delivered[WSSIM_SNAPSHOTS];
+	static uint	queue[WSSIM_SNAPSHOTS];
+	net_wsflow_t	flow;
+	int	qhead = 0, qtail = 0, linkfree = 0, lastdelivery = 0;
+	uint	seq = 0, held = 0, segments = 0;
+	int	shown = 0, acked = 0;
+	double	total = 0.0;
+	int	t;
+
+	memset( &flow, 0, sizeof( flow ));
+	memset( delivered, 0, sizeof( delivered ));
+	*worst = 0.0;
+
+	for( t = 0; t < WSSIM_TIME; t++ )
+	{
+		if( t % WSSIM_FRAME == 0 )
+		{
+			generated[++seq] = t;
+
+			if( latestwins && NET_WebsocketBackedUp( &flow, t * 0.001, 0.25 ))
+			{
+				held = seq;
+			}
+			else
+			{
+				held = 0;
+				NET_WebsocketFlowSent( &flow, seq, t * 0.001 );
+				queue[qtail++] = seq;
+			}
+		}
+
+		if( held && !NET_WebsocketBackedUp( &flow, t * 0.001, 0.25 ))
+		{
+			NET_WebsocketFlowSent( &flow, held, t * 0.001 );
+			queue[qtail++] = held;
+			held = 0;
+		}
+
+		// in-order stream, lost segment stalls everything behind it
+		if( t >= linkfree && qhead < qtail )
+		{
+			uint s = queue[qhead++];
+
+			linkfree = t + WSSIM_SIZE / WSSIM_RATE;
+			if( ++segments % WSSIM_LOSS == 0 )
+				linkfree += WSSIM_RTO;
+
+			lastdelivery = Q_max( lastdelivery, linkfree + WSSIM_LATENCY );
+			delivered[s] = lastdelivery;
+		}
+
+		// client shows newest delivered snapshot, ack comes back one latency later
+		while( shown < qhead && delivered[queue[shown]] <= t )
+			shown++;
+
+		while( acked < shown && delivered[queue[acked]] + WSSIM_LATENCY <= t )
+			NET_WebsocketFlowAcked( &flow, queue[acked++] );
+
+		if( shown )
+		{
+			double stale = t - generated[queue[shown - 1]];
+
+			total += stale;
+			if( stale > *worst )
+				*worst = stale;
+		}
+	}
+	*avg = total / WSSIM_TIME;
+}
+
+static void Test_WebsocketLatestWins( void )
+{
+	double	avg[2], worst[2];
+
+	Test_WebsocketLink( false, &avg[0], &worst[0] );
+	Test_WebsocketLink( true, &avg[1], &worst[1] );
+
+	Msg( "websocket snapshot age: reliable %.0f/%.0f ms, latest-wins %.0f/%.0f ms (avg/max)\n",
+		avg[0], worst[0], avg[1], worst[1] );
+
+	TASSERT( avg[1] < avg[0] );
+	TASSERT( worst[1] < worst[0] );
+}
+
+static void Test_WebsocketRing( void )
+{
+	byte	*data;
+	size_t	length;
+	netadr_t	from;
+	int	i;
+
+	// two unreliable datagrams from the same channel, the older is skipped
+	NET_WebsocketSlot( NS_SERVER, 1, 8, true )[0] = 1;
+	NET_WebsocketSlot( NS_SERVER, 2, 8, true )[0] = 2;
+	NET_WebsocketSlot( NS_SERVER, 1, 8, false )[0] = 3;
+	NET_WebsocketSlot( NS_SERVER, 1, 8, true )[0] = 4;
+
+	TASSERT( NET_GetWebSocketPacket( NS_SERVER, &from, &data, &length ));
+	TASSERT_EQi( data[0], 2 );
+	TASSERT_EQi( from.ip4, 2 );
+	TASSERT( NET_GetWebSocketPacket( NS_SERVER, &from, &data, &length ));
+	TASSERT_EQi( data[0], 3 );
+	TASSERT( NET_GetWebSocketPacket( NS_SERVER, &from, &data, &length ));
+	TASSERT_EQi( data[0], 4 );
+	TASSERT( !NET_GetWebSocketPacket( NS_SERVER, &from, &data, &length ));
+	TASSERT_EQi( (int)net.wsring[NS_SERVER].superseded, 1 );
+
+	// full ring never overwrites the slot handed out last
+	for( i = 0; i < NET_WS_RING; i++ )
+	{
+		if(( data = NET_WebsocketSlot( NS_SERVER, 1, 8, false )) != NULL )
+			data[0] = i;
+	}
+
+	TASSERT_EQi( (int)net.wsring[NS_SERVER].dropped, 1 );
+
+	NET_FreeWebsocketRings();
+}
+
+static void Test_WebsocketRingBytes( void )
+{
+	net_wsring_t	*ring = &net.wsring[NS_SERVER];
+	byte	*data;
+	size_t	length;
+	netadr_t	from;
+	int	i, failed = 0;
+
+	// slots are sized by the datagram
+	NET_WebsocketSlot( NS_SERVER, 1, 8, false );
+	TASSERT_EQi( (int)ring->allocated, NET_WS_SLOT_ALIGN );
+
+	// nothing goes over the cap
+	TASSERT( NET_WebsocketSlot( NS_SERVER, 1, NET_WS_RING_BYTES + 1, false ) == NULL );
+	TASSERT_EQi( (int)ring->dropped, 1 );
+	TASSERT( NET_GetWebSocketPacket( NS_SERVER, &from, &data, &length ));
+
+	// big datagrams take the memory of the idle slots
+	for( i = 0; i < 64; i++ )
+	{
+		if( !NET_WebsocketSlot( NS_SERVER, 1, 60000, false ) || !NET_GetWebSocketPacket( NS_SERVER, &from, &data, &length ))
+			failed++;
+	}
+
+	TASSERT_EQi( failed, 0 );
+	TASSERT( ring->allocated <= NET_WS_RING_BYTES );
+
+	NET_FreeWebsocketRings();
+}
+
+void Test_RunWebsocket( void )
+{
+	Test_WebsocketRing();
+	Test_WebsocketRingBytes();
+	Test_WebsocketLatestWins();
+}
+
+#endif // XASH_ENGINE_TESTS
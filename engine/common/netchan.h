@@ -192,6 +192,7 @@ typedef struct fragbuf_s
 	char		filename[MAX_OSPATH];		// name of the file to save out on remote host
 	int		foffset;				// offset in file from which to read data
 	int		size;				// size of data to read at that offset
+	struct netfilesource_s	*source;			// shared file reader, see Netchan_OpenFileSource
 } fragbuf_t;
 
 // Waiting list of fragbuf chains
@@ -272,6 +273,7 @@ typedef struct netchan_s
 	size_t		total_sended;
 	size_t		total_received;
 	qboolean	split;
+	compressor_t	compression;	// fragment codec the remote side can decode
 	unsigned int	maxpacket;
 	unsigned int	splitid;
 	netsplit_t netsplit;
@@ -292,8 +294,12 @@ void Netchan_Setup( netsrc_t sock, netchan_t *chan, netadr_t adr, int qport, voi
 void Netchan_CreateFileFragmentsFromBuffer( netchan_t *chan, const char *filename, byte *pbuf, int size );
 qboolean Netchan_CopyNormalFragments( netchan_t *chan, sizebuf_t *msg, size_t *length );
 qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg );
+void Netchan_AbortIncomingFile( netchan_t *chan, const char *filename );
 void Netchan_CreateFragments( netchan_t *chan, sizebuf_t *msg );
 int Netchan_CreateFileFragments( netchan_t *chan, const char *filename );
+void Netchan_PrecompressReset( void );
+void Netchan_Precompress( const char *filename );
+void Netchan_PrecompressFrame( void );
 void Netchan_TransmitBits( netchan_t *chan, int lengthInBits, byte *data );
 void Netchan_OutOfBand( int net_socket, netadr_t adr, int length, byte *data );
 void Netchan_OutOfBandPrint( int net_socket, netadr_t adr, const char *format, ... ) _format( 3 );
@@ -285,7 +285,17 @@ extern const char	*svc_strings[svc_lastmsg+1];
 extern const char	*clc_strings[clc_lastmsg+1];
 
 // FWGS extensions
+// sent as a bitfield in the "ext" key of the connect protinfo, the server
+// echoes back the subset it accepted. Bits are wire format: never reuse or
+// renumber one, take the next free bit and add it to NET_EXT_MASK.
+// NET_LEGACY_EXT_* in netchan.h belong to the legacy protocol, a separate field
 #define NET_EXT_SPLITSIZE (1U<<0) // set splitsize by cl_dlmax
+#define NET_EXT_COMPRESS  (1U<<1) // deflate compressed fragments and file transfers
+#define NET_EXT_WSBATCH   (1U<<2) // websocket client reads coalesced "msgs" messages
+#define NET_EXT_WSUNRELIABLE (1U<<3) // websocket peer reads latest-wins "umsg" messages
+// (1U<<4) and up are free
+
+#define NET_EXT_MASK      (NET_EXT_SPLITSIZE|NET_EXT_COMPRESS|NET_EXT_WSBATCH|NET_EXT_WSUNRELIABLE) // every bit this build understands
 
 // legacy protocol definitons
 #define PROTOCOL_LEGACY_VERSION		48
@@ -39,17 +39,25 @@ void Test_RunCon( void );
 void Test_RunVOX( void );
 void Test_RunIPFilter( void );
 void Test_RunGamma( void );
+void Test_RunWebsocket( void );
+void Test_RunDelta( void );
+void Test_RunMsg( void );
+void Test_RunImdraw( void );
 
 #define TEST_LIST_0 \
 	Test_RunLibCommon(); \
 	Test_RunCommon(); \
 	Test_RunCmd(); \
 	Test_RunCvar(); \
-	Test_RunIPFilter();
+	Test_RunIPFilter(); \
+	Test_RunWebsocket(); \
+	Test_RunMsg(); \
+	Test_RunDelta();
 
 #define TEST_LIST_0_CLIENT \
 	Test_RunCon(); \
-	Test_RunGamma();
+	Test_RunGamma(); \
+	Test_RunImdraw();
 
 #define TEST_LIST_1 \
 	Test_RunImagelib();
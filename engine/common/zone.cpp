@@ -21,6 +21,11 @@ GNU General Public License for more details.
 #define MEMHEADER_SENTINEL1	0xDEADF00DU
 #define MEMHEADER_SENTINEL2	0xDFU
 
+// small blocks are carved from per-pool slabs, one free list per size class
+#define MEM_SLAB_CLASSES	5
+#define MEM_SLAB_MIN_CELLS	8
+#define MEM_SLAB_MAX_CELLS	256
+
 #ifdef XASH_CUSTOM_SWAP
 #include "platform/swap/swap.h"
 #define Q_malloc SWAP_Malloc
@@ -46,6 +51,17 @@ typedef struct memheader_s
 	// immediately followed by data, which is followed by a MEMHEADER_SENTINEL2 byte
 } memheader_t;
 
+typedef struct memslab_s
+{
+	struct memslab_s	*next;
+	size_t		cells;
+
+	// immediately followed by cells, each is memheader_t and class size
+} memslab_t;
+
+// block size with sentinel2, multiples of 16 to keep cells aligned
+static const size_t mem_slabclass[MEM_SLAB_CLASSES] = { 32, 64, 128, 256, 512 };
+
 typedef struct mempool_s
 {
 	uint32_t		sentinel1;	// should always be MEMHEADER_SENTINEL1
@@ -54,6 +70,10 @@ typedef struct mempool_s
 	size_t		realsize;		// total memory allocated in this pool (actual malloc total)
 	size_t		lastchecksize;	// updated each time the pool is displayed by memlist
 	struct mempool_s	*next;		// linked into global mempool list
+	memslab_t		*slabs[MEM_SLAB_CLASSES];
+	memheader_t	*freecells[MEM_SLAB_CLASSES];	// linked through memheader next
+	size_t		slabcells[MEM_SLAB_CLASSES];
+	size_t		usedcells[MEM_SLAB_CLASSES];
 	const char	*filename;	// file name and line where Mem_AllocPool was called
 	int		fileline;
 #if XASH_64BIT
@@ -69,23 +89,47 @@ static mempool_t *poolchain = NULL; // critical stuff
 // a1ba: due to mempool being passed with the model through reused 32-bit field
 // which makes engine incompatible with 64-bit pointers I changed mempool type
 // from pointer to 32-bit handle, thankfully mempool structure is private
-// But! Mempools are handled through linked list so we can't index them safely
+// Handles are never reused, so table indexed by handle catches stale ones
 static poolhandle_t lastidx = 0;
+static mempool_t **pooltable = NULL;
+static size_t pooltablesize = 0;
 
 static mempool_t *Mem_FindPool( poolhandle_t poolptr )
 {
-	mempool_t *pool;
-
-	for( pool = poolchain; pool; pool = pool->next )
-	{
-		if( pool->idx == poolptr )
-			return pool;
-	}
+	if( poolptr > 0 && poolptr < pooltablesize && pooltable[poolptr] )
+		return pooltable[poolptr];
 
 	Sys_Error( "%s: not allocated or double freed pool %d", __FUNCTION__, poolptr );
 
 	return NULL;
 }
+
+static void Mem_RegisterPool( mempool_t *pool )
+{
+	pool->idx = ++lastidx;
+
+	if( pool->idx >= pooltablesize )
+	{
+		size_t newsize = pooltablesize ? pooltablesize * 2 : 256;
+		mempool_t **table = (mempool_t **)Q_malloc( newsize * sizeof( *table ));
+
+		if( table == NULL )
+			Sys_Error( "Mem_AllocPool: out of memory for pool table\n" );
+
+		memset( table, 0, newsize * sizeof( *table ));
+
+		if( pooltable )
+		{
+			memcpy( table, pooltable, pooltablesize * sizeof( *table ));
+			Q_free( pooltable );
+		}
+
+		pooltable = table;
+		pooltablesize = newsize;
+	}
+
+	pooltable[pool->idx] = pool;
+}
 #else
 static mempool_t *Mem_FindPool( poolhandle_t poolptr )
 {
@@ -93,10 +137,107 @@ static mempool_t *Mem_FindPool( poolhandle_t poolptr )
 }
 #endif
 
+/*
+========================
+Mem_SlabClass
+
+returns size class for small block or -1
+========================
+*/
+static inline int Mem_SlabClass( size_t size )
+{
+	int i;
+
+	for( i = 0; i < MEM_SLAB_CLASSES; i++ )
+	{
+		if( size + 1 <= mem_slabclass[i] )
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+========================
+Mem_AllocCell
+
+every next slab is bigger, so pools with few
+small allocations don't waste much
+========================
+*/
+static memheader_t *Mem_AllocCell( mempool_t *pool, int cls, const char *filename, int fileline )
+{
+	size_t cellsize = sizeof( memheader_t ) + mem_slabclass[cls];
+	memheader_t *mem;
+
+	if( !pool->freecells[cls] )
+	{
+		size_t cells = pool->slabcells[cls] ? pool->slabcells[cls] : MEM_SLAB_MIN_CELLS;
+		memslab_t *slab;
+		size_t i;
+
+		if( cells > MEM_SLAB_MAX_CELLS )
+			cells = MEM_SLAB_MAX_CELLS;
+
+		slab = (memslab_t *)Q_malloc( sizeof( memslab_t ) + cells * cellsize );
+
+		if( slab == NULL ) Sys_Error( "Mem_Alloc: out of memory (alloc at %s:%i)\n", filename, fileline );
+
+		slab->cells = cells;
+		slab->next = pool->slabs[cls];
+		pool->slabs[cls] = slab;
+		pool->slabcells[cls] += cells;
+		pool->realsize += sizeof( memslab_t ) + cells * cellsize;
+
+		for( i = cells; i-- > 0; )
+		{
+			mem = (memheader_t *)((byte *)( slab + 1 ) + i * cellsize );
+			mem->next = pool->freecells[cls];
+			pool->freecells[cls] = mem;
+		}
+	}
+
+	mem = pool->freecells[cls];
+	pool->freecells[cls] = mem->next;
+	pool->usedcells[cls]++;
+
+	return mem;
+}
+
+/*
+========================
+Mem_ReleaseSlabs
+
+all blocks in slabs must be already freed
+========================
+*/
+static void Mem_ReleaseSlabs( mempool_t *pool )
+{
+	int cls;
+
+	for( cls = 0; cls < MEM_SLAB_CLASSES; cls++ )
+	{
+		memslab_t *slab, *next;
+
+		for( slab = pool->slabs[cls]; slab; slab = next )
+		{
+			next = slab->next;
+			pool->realsize -= sizeof( memslab_t ) + slab->cells * ( sizeof( memheader_t ) + mem_slabclass[cls] );
+			Q_free( slab );
+		}
+
+		pool->slabs[cls] = NULL;
+		pool->freecells[cls] = NULL;
+		pool->slabcells[cls] = 0;
+		pool->usedcells[cls] = 0;
+	}
+}
+
 void *_Mem_Alloc( poolhandle_t poolptr, size_t size, qboolean clear, const char *filename, int fileline )
 {
 	memheader_t *mem;
 	mempool_t   *pool;
+	int         cls;
 
 	if( size <= 0 ) return NULL;
 	if( !poolptr ) Sys_Error( "Mem_Alloc: pool == NULL (alloc at %s:%i)\n", filename, fileline );
@@ -105,10 +246,17 @@ void *_Mem_Alloc( poolhandle_t poolptr, size_t size, qboolean clear, const char
 
 	pool->totalsize += size;
 
-	// big allocations are not clumped
-	pool->realsize += sizeof( memheader_t ) + size + sizeof( size_t );
-	mem = (memheader_t *)Q_malloc( sizeof( memheader_t ) + size + sizeof( size_t ));
-	if( mem == NULL ) Sys_Error( "Mem_Alloc: out of memory (alloc at %s:%i)\n", filename, fileline );
+	if(( cls = Mem_SlabClass( size )) >= 0 )
+	{
+		mem = Mem_AllocCell( pool, cls, filename, fileline );
+	}
+	else
+	{
+		// big allocations are not clumped
+		pool->realsize += sizeof( memheader_t ) + size + sizeof( size_t );
+		mem = (memheader_t *)Q_malloc( sizeof( memheader_t ) + size + sizeof( size_t ));
+		if( mem == NULL ) Sys_Error( "Mem_Alloc: out of memory (alloc at %s:%i)\n", filename, fileline );
+	}
 
 	mem->filename = filename;
 	mem->fileline = fileline;
@@ -150,6 +298,7 @@ static const char *Mem_CheckFilename( const char *filename )
 static void Mem_FreeBlock( memheader_t *mem, const char *filename, int fileline )
 {
 	mempool_t		*pool;
+	int		cls;
 
 	if( mem->sentinel1 != MEMHEADER_SENTINEL1 )
 	{
@@ -177,6 +326,16 @@ static void Mem_FreeBlock( memheader_t *mem, const char *filename, int fileline
 	// memheader has been unlinked, do the actual free now
 	pool->totalsize -= mem->size;
 
+	if(( cls = Mem_SlabClass( mem->size )) >= 0 )
+	{
+		// sentinels are kept, so freeing it again fails on chain check
+		mem->prev = NULL;
+		mem->next = pool->freecells[cls];
+		pool->freecells[cls] = mem;
+		pool->usedcells[cls]--;
+		return;
+	}
+
 	pool->realsize -= sizeof( memheader_t ) + mem->size + sizeof( size_t );
 	Q_free( mem );
 }
@@ -187,6 +346,8 @@ void _Mem_Free( void *data, const char *filename, int fileline )
 	Mem_FreeBlock((memheader_t *)((byte *)data - sizeof( memheader_t )), filename, fileline );
 }
 
+static void Mem_CheckHeaderSentinels( void *data, const char *filename, int fileline );
+
 void *_Mem_Realloc( poolhandle_t poolptr, void *memptr, size_t size, qboolean clear, const char *filename, int fileline )
 {
 	memheader_t	*memhdr = NULL;
@@ -196,8 +357,26 @@ void *_Mem_Realloc( poolhandle_t poolptr, void *memptr, size_t size, qboolean cl
 
 	if( memptr )
 	{
+		int cls;
+
 		memhdr = (memheader_t *)((byte *)memptr - sizeof( memheader_t ));
 		if( size == memhdr->size ) return memptr;
+
+		// still fits the same cell
+		cls = Mem_SlabClass( size );
+		if( cls >= 0 && cls == Mem_SlabClass( memhdr->size ) && memhdr->pool == Mem_FindPool( poolptr ))
+		{
+			Mem_CheckHeaderSentinels( memptr, filename, fileline );
+
+			if( clear && size > memhdr->size )
+				memset( (byte *)memptr + memhdr->size, 0, size - memhdr->size );
+
+			memhdr->pool->totalsize += size - memhdr->size;
+			memhdr->size = size;
+			*((byte *)memptr + size ) = MEMHEADER_SENTINEL2;
+
+			return memptr;
+		}
 	}
 
 	nb = (char*)_Mem_Alloc( poolptr, size, clear, filename, fileline );
@@ -237,7 +416,7 @@ poolhandle_t _Mem_AllocPool( const char *name, const char *filename, int filelin
 	poolchain = pool;
 	
 #if XASH_64BIT
-	pool->idx = ++lastidx;
+	Mem_RegisterPool( pool );
 	return pool->idx;
 #else
 	return (poolhandle_t)pool;
@@ -260,6 +439,10 @@ void _Mem_FreePool( poolhandle_t *poolptr, const char *filename, int fileline )
 
 		// free memory owned by the pool
 		while( pool->chain ) Mem_FreeBlock( pool->chain, filename, fileline );
+		Mem_ReleaseSlabs( pool );
+#if XASH_64BIT
+		pooltable[pool->idx] = NULL;
+#endif
 		// free the pool itself
 		memset( pool, 0xBF, sizeof( mempool_t ));
 		Q_free( pool );
@@ -277,6 +460,7 @@ void _Mem_EmptyPool( poolhandle_t poolptr, const char *filename, int fileline )
 
 	// free memory owned by the pool
 	while( pool->chain ) Mem_FreeBlock( pool->chain, filename, fileline );
+	Mem_ReleaseSlabs( pool );
 }
 
 static qboolean Mem_CheckAlloc( mempool_t *pool, void *data )
@@ -356,7 +540,10 @@ void _Mem_Check( const char *filename, int fileline )
 void Mem_PrintStats( void )
 {
 	size_t    count = 0, size = 0, realsize = 0;
+	size_t    slabcells[MEM_SLAB_CLASSES] = { 0 }, usedcells[MEM_SLAB_CLASSES] = { 0 };
+	size_t    slabsize = 0, usedsize = 0;
 	mempool_t *pool;
+	int       cls;
 
 	Mem_Check();
 	for( pool = poolchain; pool; pool = pool->next )
@@ -364,10 +551,31 @@ void Mem_PrintStats( void )
 		count++;
 		size += pool->totalsize;
 		realsize += pool->realsize;
+
+		for( cls = 0; cls < MEM_SLAB_CLASSES; cls++ )
+		{
+			slabcells[cls] += pool->slabcells[cls];
+			usedcells[cls] += pool->usedcells[cls];
+		}
 	}
 
 	Con_Printf( "^3%lu^7 memory pools, totalling: ^1%s\n", count, Q_memprint( size ));
 	Con_Printf( "total allocated size: ^1%s\n", Q_memprint( realsize ));
+
+	for( cls = 0; cls < MEM_SLAB_CLASSES; cls++ )
+	{
+		size_t cellsize = sizeof( memheader_t ) + mem_slabclass[cls];
+
+		if( !slabcells[cls] )
+			continue;
+
+		slabsize += slabcells[cls] * cellsize;
+		usedsize += usedcells[cls] * cellsize;
+		Con_Printf( "%4lu byte cells: %lu of %lu used (%lu%%)\n", mem_slabclass[cls] - 1, usedcells[cls], slabcells[cls], usedcells[cls] * 100 / slabcells[cls] );
+	}
+
+	if( slabsize )
+		Con_Printf( "slabs: ^1%s^7, used ^1%s^7 (%lu%%)\n", Q_memprint( slabsize ), Q_memprint( usedsize ), usedsize * 100 / slabsize );
 }
 
 void Mem_PrintList( size_t minallocationsize )
@@ -41,6 +41,13 @@ GNU General Public License for more details.
 extern int SV_UPDATE_BACKUP;
 #endif
 
+// player positions kept for lag compensation, records are at least
+// SV_LAGRECORD_INTERVAL apart so the ring holds over 2.5 seconds at any
+// framerate, past the longest rewind of 1.5 seconds latency plus 0.1 lerp
+#define SV_LAGRECORD_BACKUP	512
+#define SV_LAGRECORD_MASK	(SV_LAGRECORD_BACKUP - 1)
+#define SV_LAGRECORD_INTERVAL	0.005
+
 // hostflags
 #define SVF_SKIPLOCALHOST	BIT( 0 )
 #define SVF_MERGE_VISIBILITY	BIT( 1 )	// we are do portal pass
@@ -204,6 +211,13 @@ typedef struct
 	int  		first_entity;		// into the circular sv_packet_entities[]
 } client_frame_t;
 
+typedef struct
+{
+	double		time;
+	vec3_t		origin;
+	qboolean		nointerp;			// dead or EF_NOINTERP
+} sv_lagrecord_t;
+
 typedef struct sv_client_s
 {
 	cl_state_t	state;
@@ -257,6 +271,11 @@ typedef struct sv_client_s
 	client_frame_t	*frames;			// updates can be delta'd from here
 	event_state_t	events;			// delta-updated events cycle
 
+	sv_lagrecord_t	lagrecords[SV_LAGRECORD_BACKUP];	// player positions, see SV_RecordLagHistory
+	int		numlagrecords;		// ring index is numlagrecords & SV_LAGRECORD_MASK
+	double		lagnointerp;		// time of the newest nointerp record
+	double		lagteleport;		// time of the newest record that jumped from the previous one
+
 	int		challenge;		// challenge of this user, randomly generated
 	int		userid;			// identifying number on server
 	int		extensions;
@@ -298,8 +317,12 @@ typedef struct
 	char		name[32];	// in GoldSrc max name length is 12
 	int		number;	// svc_ number
 	int		size;	// if size == -1, size come from first byte after svcnum
+	int		hook;	// first subscribed callback, see SV_HookUserMessage
 } sv_user_message_t;
 
+// data points to message payload, after svc number and size
+typedef void (*sv_usermsg_hook_t)( const sv_user_message_t *user, const byte *data, int size );
+
 typedef struct
 {
 	edict_t		*ent;
@@ -409,6 +432,7 @@ extern convar_t		sv_unlag;
 extern convar_t		sv_maxunlag;
 extern convar_t		sv_unlagpush;
 extern convar_t		sv_unlagsamples;
+extern convar_t		sv_unlaghistory;
 extern convar_t		rcon_enable;
 extern convar_t		sv_instancedbaseline;
 extern convar_t		sv_background_freeze;
@@ -461,6 +485,11 @@ extern convar_t		sv_cheats;
 extern convar_t		public_server;
 extern convar_t		sv_nat;
 extern convar_t		sv_speedhack_kick;
+extern convar_t		sv_sendthreads;
+extern convar_t		sv_deltaplans;
+extern convar_t		sv_baselinesearch;
+extern convar_t		sv_deltacache;
+extern convar_t		sv_fastfind;
 extern convar_t		sv_pausable;		// allows pause in multiplayer
 extern convar_t		sv_check_errors;
 extern convar_t		sv_reconnect_limit;
@@ -492,6 +521,8 @@ int SV_EventIndex( const char *name );
 int SV_GenericIndex( const char *name );
 int SV_CalcPacketLoss( sv_client_t *cl );
 void SV_ExecuteUserCommand (char *s);
+void SV_ClearClientHash( void );
+void SV_HashClient( sv_client_t *cl );
 void SV_InitOperatorCommands( void );
 void SV_KillOperatorCommands( void );
 void SV_RemoteCommand( netadr_t from, sizebuf_t *msg );
@@ -610,6 +641,10 @@ int SV_FindBestBaselineForStatic( int index, entity_state_t **baseline, entity_s
 void SV_WriteFrameToClient( sv_client_t *client, sizebuf_t *msg );
 void SV_BuildClientFrame( sv_client_t *client );
 void SV_SkipUpdates( void );
+void SV_ShutdownSendWorkers( void );
+void SV_BaselineStats_f( void );
+void SV_DeltaCacheStats_f( void );
+void SV_FreeDeltaCache( void );
 
 //
 // sv_game.c
@@ -620,6 +655,8 @@ void SV_FreeEdicts( void );
 edict_t *SV_AllocEdict( void );
 void SV_FreeEdict( edict_t *pEdict );
 void SV_InitEdict( edict_t *pEdict );
+void SV_InvalidateEntityIndex( void );
+void SV_UpdateEntityIndex( edict_t *ed );
 const char *SV_ClassName( const edict_t *e );
 void SV_CopyTraceToGlobal( trace_t *trace );
 qboolean SV_CheckEdict( const edict_t *e, const char *file, const int line );
@@ -646,6 +683,7 @@ void SV_StartSound( edict_t *ent, int chan, const char *sample, float vol, float
 edict_t *SV_FindGlobalEntity( string_t classname, string_t globalname );
 qboolean SV_CreateStaticEntity( struct sizebuf_s *msg, int index );
 void SV_SendUserReg( sizebuf_t *msg, sv_user_message_t *user );
+qboolean SV_HookUserMessage( const char *name, sv_usermsg_hook_t func );
 int pfnIndexOfEdict( const edict_t *pEdict );
 void SV_UpdateBaseVelocity( edict_t *ent );
 void SV_RestartAmbientSounds( void );
@@ -682,6 +720,7 @@ void SV_ClearGameState( void );
 // sv_pmove.c
 //
 qboolean SV_PlayerIsFrozen( edict_t *pClient );
+void SV_RecordLagHistory( void );
 void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed );
 
 //
@@ -689,6 +728,8 @@ void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed );
 //
 void SV_ClearWorld( void );
 void SV_UnlinkEdict( edict_t *ent );
+int SV_AreaEdicts( const vec3_t mins, const vec3_t maxs, int *list, int maxcount );
+uint SV_AreaGeneration( void );
 void SV_ClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, trace_t *trace );
 void SV_CustomClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, trace_t *trace );
 trace_t SV_TraceHull( edict_t *ent, int hullNum, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end );
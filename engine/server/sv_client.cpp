@@ -439,7 +439,7 @@ static void SV_ConnectClient( netadr_t from )
 	newcl->frames = (client_frame_t *)Z_Calloc( sizeof( client_frame_t ) * SV_UPDATE_BACKUP );
 	newcl->userid = g_userid++;	// create unique userid
 	newcl->state = cs_connected;
-	newcl->extensions = extensions & (NET_EXT_SPLITSIZE);
+	newcl->extensions = extensions & NET_EXT_MASK;
 	Q_strncpy( newcl->useragent, protinfo, MAX_INFO_STRING );
 
 	// reset viewentities (from previous level)
@@ -451,6 +451,14 @@ static void SV_ConnectClient( netadr_t from )
 
 	// initailize netchan
 	Netchan_Setup( NS_SERVER, &newcl->netchan, from, qport, newcl, SV_GetFragmentSize );
+	SV_HashClient( newcl );
+
+	if( FBitSet( newcl->extensions, NET_EXT_COMPRESS ))
+		newcl->netchan.compression = COMPRESS_FAST;
+
+	// only clients that asked for it can split coalesced datagrams
+	NET_WebsocketSetCoalesce( from, FBitSet( newcl->extensions, NET_EXT_WSBATCH ) ? true : false );
+	NET_WebsocketSetUnreliable( NS_SERVER, from, FBitSet( newcl->extensions, NET_EXT_WSUNRELIABLE ) ? true : false );
 	MSG_Init( &newcl->datagram, "Datagram", newcl->datagram_buf, sizeof( newcl->datagram_buf )); // datagram buf
 
 	Q_strncpy( newcl->hashedcdkey, Info_ValueForKey( protinfo, "uuid" ), 32 );
@@ -2611,9 +2619,15 @@ static qboolean SV_EntFire_f( sv_client_t *cl )
 		else if( !Q_stricmp( Cmd_Argv( 2 ), "solid" ) )
 			ent->v.solid = Q_atoi( Cmd_Argv ( 3 ) );
 		else if( !Q_stricmp( Cmd_Argv( 2 ), "rename" ) )
+		{
 			ent->v.targetname = ALLOC_STRING( Cmd_Argv ( 3 ) );
+			SV_UpdateEntityIndex( ent );
+		}
 		else if( !Q_stricmp( Cmd_Argv( 2 ), "settarget" ) )
+		{
 			ent->v.target = ALLOC_STRING( Cmd_Argv ( 3 ) );
+			SV_UpdateEntityIndex( ent );
+		}
 		else if( !Q_stricmp( Cmd_Argv( 2 ), "setmodel" ) )
 			SV_SetModel( ent, Cmd_Argv( 3 ) );
 		else if( !Q_stricmp( Cmd_Argv( 2 ), "set" ) )
@@ -2631,6 +2645,7 @@ static qboolean SV_EntFire_f( sv_client_t *cl )
 			pkvd.szValue = value;
 			pkvd.fHandled = false;
 			svgame.dllFuncs.pfnKeyValue( ent, &pkvd );
+			SV_UpdateEntityIndex( ent );
 
 			if( pkvd.fHandled )
 				SV_ClientPrintf( cl, "value set successfully!\n" );
@@ -2864,6 +2879,7 @@ static qboolean SV_EntCreate_f( sv_client_t *cl )
 	{
 		ent = SV_AllocEdict();
 		ent->v.classname = classname;
+		SV_UpdateEntityIndex( ent );
 		if( svgame.physFuncs.SV_CreateEntity( ent, (char*)STRING( classname ) ) == -1 )
 		{
 			if( ent && !ent->free )
@@ -2919,6 +2935,7 @@ static qboolean SV_EntCreate_f( sv_client_t *cl )
 			pkvd.szKeyName = keyname;
 			pkvd.szValue = value;
 			svgame.dllFuncs.pfnKeyValue( ent, &pkvd );
+			SV_UpdateEntityIndex( ent );
 
 			if( pkvd.fHandled )
 				SV_ClientPrintf( cl, "value \"%s\" set to \"%s\"!\n", pkvd.szKeyName, pkvd.szValue );
@@ -2951,6 +2968,7 @@ static qboolean SV_EntCreate_f( sv_client_t *cl )
 		// but we will not lose anything in this case.
 		Q_strnlwr( newname, newname, sizeof( newname ));
 		ent->v.targetname = ALLOC_STRING( newname );
+		SV_UpdateEntityIndex( ent );
 		SV_EntSendVars( cl, ent );
 	}
 
@@ -2982,6 +3000,7 @@ static qboolean SV_EntCreate_f( sv_client_t *cl )
 			pkvd.szKeyName = keyname;
 			pkvd.szValue = value;
 			svgame.dllFuncs.pfnKeyValue( ent, &pkvd );
+			SV_UpdateEntityIndex( ent );
 
 			if( pkvd.fHandled )
 				SV_ClientPrintf( cl, "value \"%s\" set to \"%s\"!\n", pkvd.szKeyName, pkvd.szValue );
@@ -1033,6 +1033,11 @@ void SV_InitOperatorCommands( void )
 	Cmd_AddCommand( "redirect", Rcon_Redirect_f, "force enable rcon redirection" );
 	Cmd_AddCommand( "logaddress", SV_SetLogAddress_f, "sets address and port for remote logging host" );
 	Cmd_AddCommand( "log", SV_ServerLog_f, "enables logging to file" );
+	Cmd_AddCommand( "baselinestats", SV_BaselineStats_f, "show delta baseline search cost since the last call" );
+	Cmd_AddCommand( "deltacachestats", SV_DeltaCacheStats_f, "show shared entity delta cache hit rate since the last call" );
+#ifdef XASH_64BIT
+	Cmd_AddCommand( "str64stats", SV_PrintStr64Stats_f, "show 64 bit string pool statistics" );
+#endif
 
 	if( host.type == HOST_NORMAL )
 	{
@@ -1071,6 +1076,11 @@ void SV_KillOperatorCommands( void )
 	Cmd_RemoveCommand( "redirect" );
 	Cmd_RemoveCommand( "logaddress" );
 	Cmd_RemoveCommand( "log" );
+	Cmd_RemoveCommand( "baselinestats" );
+	Cmd_RemoveCommand( "deltacachestats" );
+#ifdef XASH_64BIT
+	Cmd_RemoveCommand( "str64stats" );
+#endif
 
 	if( host.type == HOST_NORMAL )
 	{
@@ -17,16 +17,126 @@ GNU General Public License for more details.
 #include "server.h"
 #include "const.h"
 #include "net_encode.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace engine;
+
+#define SV_MAX_SENDTHREADS	16
 
 typedef struct
 {
 	int		num_entities;
+	int		num_ignored;	// visible but didn't fit into the packet
 	entity_state_t	entities[MAX_VISIBLE_PACKET];
 	byte		sended[MAX_EDICTS_BYTES];
 } sv_ents_t;
 
-int	c_fullsend;	// just a debug counter
-int	c_notsend;
+// per-client datagram, built in three steps: game callbacks (serial),
+// entity delta encoding (may run on a worker) and transmit (serial)
+typedef struct
+{
+	sv_client_t	*cl;
+	client_frame_t	*frame;
+	qboolean		send_pings;
+	qboolean		outdated;		// delta request from rolled off entities
+	sizebuf_t		msg;
+	byte		msg_buf[MAX_DATAGRAM];
+} sv_datagram_t;
+
+typedef struct
+{
+	std::thread	*threads[SV_MAX_SENDTHREADS];
+	int		numthreads;
+	std::mutex	lock;
+	std::condition_variable	wake;		// new batch or quit
+	std::condition_variable	done;		// batch finished
+	uint		batch;		// incremented for every batch
+	qboolean		quit;
+
+	sv_datagram_t	*datagrams;	// MAX_CLIENTS
+	int		numdatagrams;
+	std::atomic<int>	nextdatagram;
+	int		pending;		// datagrams not encoded yet
+} sv_sendpool_t;
+
+static sv_sendpool_t	sendpool;
+
+#define SV_BASELINE_CACHE	4096	// baseline choices shared by all clients, per frame
+
+// packet entities the baseline search may look back at,
+// hashed once per packet as the packet is written
+typedef struct
+{
+	uint		signature[MAX_CUSTOM_BASELINES];
+	uint64_t		contents[MAX_CUSTOM_BASELINES];
+	int		numindexed;	// packet entities hashed so far
+} sv_baseline_window_t;
+
+typedef struct
+{
+	uint64_t		key;		// entity, its candidates and their contents
+	int		offset;
+	int		bits;
+	uint		frame;
+} sv_baseline_choice_t;
+
+typedef struct
+{
+	std::mutex	lock;
+	sv_baseline_choice_t	choices[SV_BASELINE_CACHE];
+	uint		frame;
+
+	// accumulated until the next baselinestats
+	std::atomic<uint64_t>	searches;
+	std::atomic<uint64_t>	hits;
+	std::atomic<uint64_t>	probes;		// Delta_TestBaseline calls
+	std::atomic<uint64_t>	skipped;		// candidates rejected by signature
+	std::atomic<uint64_t>	bits;		// estimated size of the chosen deltas
+	std::atomic<uint64_t>	nsec;
+} sv_baselinecache_t;
+
+static sv_baselinecache_t	baselinecache;
+
+#define SV_DELTA_CACHE_SLOTS	16384	// encoded deltas per frame, power of two
+#define SV_DELTA_CACHE_PROBES	8
+#define SV_DELTA_MAX_BYTES	2048	// largest entity delta we expect
+
+typedef struct
+{
+	uint64_t		from;		// state hashes
+	uint64_t		to;
+	uint		encode;		// custom encoder result
+	int		baseline;
+	int		force;
+	int		delta_type;
+	int		offset;		// into the bit store
+	int		numbits;
+	uint		frame;
+} sv_delta_entry_t;
+
+// entity deltas encoded this frame, clients acking the same
+// frame get the bits copied instead of running the encoder
+typedef struct
+{
+	std::mutex	lock;
+	sv_delta_entry_t	*entries;		// SV_DELTA_CACHE_SLOTS
+	byte		*store;
+	int		storesize;	// sv_deltacache in bytes
+	int		storeused;
+	int		peakused;
+	uint		frame;
+
+	// accumulated until the next deltacachestats
+	std::atomic<uint64_t>	lookups;
+	std::atomic<uint64_t>	hits;
+	std::atomic<uint64_t>	bitscopied;
+	std::atomic<uint64_t>	rejected;		// store or probe window full
+} sv_deltacache_t;
+
+static sv_deltacache_t	deltacache;
 
 /*
 =======================
@@ -142,15 +252,13 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 			if( ents->num_entities < ( MAX_VISIBLE_PACKET - 1 ))
 			{
 				ents->num_entities++;	// entity accepted
-				c_fullsend++;		// debug counter
-
 			}
 			else
 			{
 				// visibility list is full
 				// continue counting entities,
 				// so we know how many it's ovreflowed
-				c_notsend++;
+				ents->num_ignored++;
 			}
 		}
 
@@ -173,21 +281,84 @@ Encode a client frame onto the network channel
 
 =============================================================================
 */
+static uint64_t SV_HashMix( uint64_t hash, uint64_t value )
+{
+	hash = ( hash ^ value ) * 0xff51afd7ed558ccdULL;
+	return hash ^ ( hash >> 32 );
+}
+
+static uint64_t SV_HashEntityState( const entity_state_t *state )
+{
+	const byte	*data = (const byte *)state;
+	uint64_t		hash = 0, word;
+	size_t		i;
+
+	for( i = 0; i + 8 <= sizeof( *state ); i += 8 )
+	{
+		memcpy( &word, data + i, 8 );
+		hash = SV_HashMix( hash, word );
+	}
+
+	if( i < sizeof( *state ))
+	{
+		word = 0;
+		memcpy( &word, data + i, sizeof( *state ) - i );
+		hash = SV_HashMix( hash, word );
+	}
+
+	return hash;
+}
+
 /*
 =============
-SV_FindBestBaseline
+SV_BaselineSignature
+
+entities sharing a signature are likely to delta well
+against each other: same kind, model and movement
+=============
+*/
+static uint SV_BaselineSignature( const entity_state_t *state )
+{
+	uint64_t	hash;
+
+	hash = SV_HashMix( state->entityType, state->modelindex );
+	hash = SV_HashMix( hash, ((uint64_t)state->movetype << 32 ) | (uint)state->rendermode );
+
+	return (uint)hash;
+}
+
+static void SV_IndexBaselineWindow( sv_baseline_window_t *window, client_frame_t *frame, int index )
+{
+	entity_state_t	*state;
+	int		i;
+
+	// only the entities the search can reach
+	for( i = Q_max( window->numindexed, index - ( MAX_CUSTOM_BASELINES - 2 )); i <= index; i++ )
+	{
+		state = &svs.packet_entities[(frame->first_entity+i) % svs.num_client_entities];
+		window->signature[i % MAX_CUSTOM_BASELINES] = SV_BaselineSignature( state );
+		window->contents[i % MAX_CUSTOM_BASELINES] = SV_HashEntityState( state );
+	}
+
+	window->numindexed = Q_max( window->numindexed, index + 1 );
+}
+
+/*
+=============
+SV_ScanBaselines
 
 trying to deltas with previous entities
 =============
 */
-static int SV_FindBestBaseline( sv_client_t *cl, int index, entity_state_t **baseline, entity_state_t *to, client_frame_t *frame, qboolean player )
+static int SV_ScanBaselines( int index, entity_state_t **baseline, entity_state_t *to, client_frame_t *frame, qboolean player, int *bits )
 {
 	int	bestBitCount;
 	int	i, bitCount;
-	int	bestfound, j;
+	int	bestfound;
 
-	bestBitCount = j = Delta_TestBaseline( *baseline, to, player, sv.time );
+	bestBitCount = Delta_TestBaseline( *baseline, to, player, sv.time );
 	bestfound = index;
+	baselinecache.probes++;
 
 	// lookup backward for previous 64 states and try to interpret current delta as baseline
 	for( i = index - 1; bestBitCount > 0 && i >= 0 && ( index - i ) < ( MAX_CUSTOM_BASELINES - 1 ); i-- )
@@ -198,6 +369,7 @@ static int SV_FindBestBaseline( sv_client_t *cl, int index, entity_state_t **bas
 		if( to->entityType == test->entityType )
 		{
 			bitCount = Delta_TestBaseline( test, to, player, sv.time );
+			baselinecache.probes++;
 
 			if( bitCount < bestBitCount )
 			{
@@ -210,9 +382,153 @@ static int SV_FindBestBaseline( sv_client_t *cl, int index, entity_state_t **bas
 	// using delta from previous entity as baseline for current
 	if( index != bestfound )
 		*baseline = &svs.packet_entities[(frame->first_entity+bestfound) % svs.num_client_entities];
+
+	*bits = bestBitCount;
 	return index - bestfound;
 }
 
+/*
+=============
+SV_HashedBaselines
+
+only test the previous entities with the same signature,
+clients that see the same entities in the same order
+reuse the choice made for the first of them this frame
+=============
+*/
+static int SV_HashedBaselines( int index, entity_state_t **baseline, entity_state_t *to, client_frame_t *frame, qboolean player, sv_baseline_window_t *window, int *bits )
+{
+	int			candidates[MAX_CUSTOM_BASELINES];
+	int			i, numcandidates = 0;
+	int			bestBitCount, bitCount;
+	int			bestfound = index;
+	sv_baseline_choice_t	*choice;
+	qboolean			hit = false;
+	uint			signature;
+	uint64_t			key;
+
+	SV_IndexBaselineWindow( window, frame, index );
+
+	signature = window->signature[index % MAX_CUSTOM_BASELINES];
+	key = SV_HashMix( window->contents[index % MAX_CUSTOM_BASELINES], player );
+
+	for( i = index - 1; i >= 0 && ( index - i ) < ( MAX_CUSTOM_BASELINES - 1 ); i-- )
+	{
+		if( window->signature[i % MAX_CUSTOM_BASELINES] != signature )
+		{
+			baselinecache.skipped++;
+			continue;
+		}
+
+		candidates[numcandidates++] = i;
+		key = SV_HashMix( SV_HashMix( key, index - i ), window->contents[i % MAX_CUSTOM_BASELINES] );
+	}
+
+	{
+		std::lock_guard<std::mutex> guard( baselinecache.lock );
+
+		choice = &baselinecache.choices[key & ( SV_BASELINE_CACHE - 1 )];
+
+		if( choice->frame == baselinecache.frame && choice->key == key && choice->offset <= index )
+		{
+			bestfound = index - choice->offset;
+			bestBitCount = choice->bits;
+			hit = true;
+		}
+	}
+
+	if( hit )
+	{
+		baselinecache.hits++;
+	}
+	else
+	{
+		bestBitCount = Delta_TestBaseline( *baseline, to, player, sv.time );
+		baselinecache.probes++;
+
+		for( i = 0; bestBitCount > 0 && i < numcandidates; i++ )
+		{
+			entity_state_t	*test = &svs.packet_entities[(frame->first_entity+candidates[i]) % svs.num_client_entities];
+
+			if( to->entityType != test->entityType )
+				continue; // signature collision
+
+			bitCount = Delta_TestBaseline( test, to, player, sv.time );
+			baselinecache.probes++;
+
+			if( bitCount < bestBitCount )
+			{
+				bestBitCount = bitCount;
+				bestfound = candidates[i];
+			}
+		}
+
+		std::lock_guard<std::mutex> guard( baselinecache.lock );
+
+		choice->key = key;
+		choice->offset = index - bestfound;
+		choice->bits = bestBitCount;
+		choice->frame = baselinecache.frame;
+	}
+
+	// using delta from previous entity as baseline for current
+	if( index != bestfound )
+		*baseline = &svs.packet_entities[(frame->first_entity+bestfound) % svs.num_client_entities];
+
+	*bits = bestBitCount;
+	return index - bestfound;
+}
+
+/*
+=============
+SV_FindBestBaseline
+
+pick the previous packet entity that makes the
+cheapest delta, sv_baselinesearch 0 tests all of them
+=============
+*/
+static int SV_FindBestBaseline( int index, entity_state_t **baseline, entity_state_t *to, client_frame_t *frame, qboolean player, sv_baseline_window_t *window )
+{
+	double	start = Sys_DoubleTime();
+	int	offset, bits;
+
+	if( sv_baselinesearch.value )
+		offset = SV_HashedBaselines( index, baseline, to, frame, player, window, &bits );
+	else offset = SV_ScanBaselines( index, baseline, to, frame, player, &bits );
+
+	baselinecache.searches++;
+	baselinecache.bits += bits;
+	baselinecache.nsec += (uint64_t)(( Sys_DoubleTime() - start ) * 1000000000.0 );
+
+	return offset;
+}
+
+/*
+=============
+SV_BaselineStats_f
+
+baseline search cost and the size of what it picked
+=============
+*/
+void SV_BaselineStats_f( void )
+{
+	double	searches = baselinecache.searches.exchange( 0 );
+	double	hits = baselinecache.hits.exchange( 0 );
+	double	probes = baselinecache.probes.exchange( 0 );
+	double	skipped = baselinecache.skipped.exchange( 0 );
+	double	bits = baselinecache.bits.exchange( 0 );
+	double	nsec = baselinecache.nsec.exchange( 0 );
+
+	Con_Printf( "baseline search: %s\n", sv_baselinesearch.value ? "hashed signatures" : "full scan" );
+	Con_Printf( "searches: %.0f, shared between clients: %.1f%%\n", searches, searches ? hits * 100.0 / searches : 0.0 );
+
+	if( !searches ) return;
+
+	Con_Printf( "delta tests per search: %.2f, skipped by signature: %.2f\n", probes / searches, skipped / searches );
+	Con_Printf( "estimated bits per new entity: %.1f\n", bits / searches );
+	Con_Printf( "cpu per search: %.3f usec, total %.3f msec\n", nsec / searches / 1000.0, nsec / 1000000.0 );
+}
+
 /*
 =============
 SV_FindBestBaselineForStatic
@@ -250,21 +566,218 @@ int SV_FindBestBaselineForStatic( int index, entity_state_t **baseline, entity_s
 	return index - bestfound;
 }
 
+/*
+=============
+SV_FreeDeltaCache
+=============
+*/
+void SV_FreeDeltaCache( void )
+{
+	if( deltacache.entries )
+	{
+		Mem_Free( deltacache.entries );
+		deltacache.entries = NULL;
+	}
+
+	if( deltacache.store )
+	{
+		Mem_Free( deltacache.store );
+		deltacache.store = NULL;
+	}
+
+	deltacache.storesize = deltacache.storeused = 0;
+}
+
+/*
+=============
+SV_BeginDeltaCache
+
+drop the deltas of the previous frame,
+must be called before any encoding starts
+=============
+*/
+static void SV_BeginDeltaCache( void )
+{
+	int	size = bound( 0, (int)sv_deltacache.value, 65536 ) * 1024;
+
+	if( size != deltacache.storesize )
+	{
+		SV_FreeDeltaCache();
+
+		if( size )
+		{
+			deltacache.entries = (sv_delta_entry_t *)Mem_Calloc( host.mempool, sizeof( sv_delta_entry_t ) * SV_DELTA_CACHE_SLOTS );
+			deltacache.store = (byte *)Mem_Malloc( host.mempool, size );
+			deltacache.storesize = size;
+		}
+	}
+
+	deltacache.peakused = Q_max( deltacache.peakused, deltacache.storeused );
+	deltacache.storeused = 0;
+	deltacache.frame++;
+}
+
+static qboolean SV_DeltaEntryMatches( const sv_delta_entry_t *entry, const sv_delta_entry_t *key )
+{
+	return entry->from == key->from && entry->to == key->to && entry->encode == key->encode
+		&& entry->baseline == key->baseline && entry->force == key->force && entry->delta_type == key->delta_type;
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity through the per-frame delta cache. the
+custom encoder still runs for every client and its result is
+part of the key, so a game encoding the same states differently
+for someone gets a fresh delta
+=============
+*/
+static void SV_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, int delta_type, int baseline )
+{
+	uint32_t		scratch[SV_DELTA_MAX_BYTES / 4];
+	sv_delta_entry_t	key, *entry;
+	int		i, slot, size;
+	int		offset = -1, numbits = 0;
+	sizebuf_t		buf;
+
+	if( !deltacache.storesize )
+	{
+		MSG_WriteDeltaEntity( from, to, msg, force, delta_type, sv.time, baseline );
+		return;
+	}
+
+	key.encode = Delta_PrepareEntity( from, to, delta_type );
+	key.from = SV_HashEntityState( from );
+	key.to = SV_HashEntityState( to );
+	key.baseline = baseline;
+	key.force = force;
+	key.delta_type = delta_type;
+
+	slot = (int)SV_HashMix( SV_HashMix( SV_HashMix( key.from, key.to ), key.encode ), ( baseline << 2 ) | ( force << 1 ) | delta_type );
+	deltacache.lookups++;
+
+	{
+		std::lock_guard<std::mutex> guard( deltacache.lock );
+
+		for( i = 0; i < SV_DELTA_CACHE_PROBES; i++ )
+		{
+			entry = &deltacache.entries[( slot + i ) & ( SV_DELTA_CACHE_SLOTS - 1 )];
+
+			if( entry->frame != deltacache.frame )
+				break;
+
+			if( SV_DeltaEntryMatches( entry, &key ))
+			{
+				offset = entry->offset;
+				numbits = entry->numbits;
+				break;
+			}
+		}
+	}
+
+	// stored bits don't move until the next frame
+	if( offset >= 0 )
+	{
+		MSG_WriteBits( msg, deltacache.store + offset, numbits );
+		deltacache.hits++;
+		deltacache.bitscopied += numbits;
+		return;
+	}
+
+	MSG_Init( &buf, "DeltaCache", scratch, sizeof( scratch ));
+	MSG_WritePreparedEntity( from, to, &buf, force, delta_type, sv.time, baseline );
+
+	if( MSG_CheckOverflow( &buf ))
+	{
+		MSG_WriteDeltaEntity( from, to, msg, force, delta_type, sv.time, baseline );
+		return;
+	}
+
+	MSG_WriteBits( msg, MSG_GetData( &buf ), MSG_GetNumBitsWritten( &buf ));
+
+	// keep every entry dword aligned for MSG_WriteBits
+	size = ( MSG_GetNumBytesWritten( &buf ) + 3 ) & ~3;
+
+	std::lock_guard<std::mutex> guard( deltacache.lock );
+
+	if( deltacache.storeused + size > deltacache.storesize )
+	{
+		deltacache.rejected++;
+		return;
+	}
+
+	for( i = 0; i < SV_DELTA_CACHE_PROBES; i++ )
+	{
+		entry = &deltacache.entries[( slot + i ) & ( SV_DELTA_CACHE_SLOTS - 1 )];
+
+		if( entry->frame == deltacache.frame )
+		{
+			// another client just stored it
+			if( SV_DeltaEntryMatches( entry, &key ))
+				return;
+			continue;
+		}
+
+		*entry = key;
+		entry->offset = deltacache.storeused;
+		entry->numbits = MSG_GetNumBitsWritten( &buf );
+		entry->frame = deltacache.frame;
+
+		memcpy( deltacache.store + deltacache.storeused, scratch, size );
+		deltacache.storeused += size;
+		return;
+	}
+
+	deltacache.rejected++;
+}
+
+/*
+=============
+SV_DeltaCacheStats_f
+=============
+*/
+void SV_DeltaCacheStats_f( void )
+{
+	double	lookups = deltacache.lookups.exchange( 0 );
+	double	hits = deltacache.hits.exchange( 0 );
+	double	bitscopied = deltacache.bitscopied.exchange( 0 );
+	double	rejected = deltacache.rejected.exchange( 0 );
+
+	if( !deltacache.storesize )
+	{
+		Con_Printf( "delta cache is disabled, set sv_deltacache to its size in kilobytes\n" );
+		return;
+	}
+
+	Con_Printf( "delta cache: %i kb, peak usage %i kb\n", deltacache.storesize / 1024, deltacache.peakused / 1024 );
+	Con_Printf( "lookups: %.0f, hits: %.1f%%\n", lookups, lookups ? hits * 100.0 / lookups : 0.0 );
+	Con_Printf( "bytes copied instead of encoded: %.0f\n", bitscopied / 8.0 );
+	Con_Printf( "deltas not stored, cache full: %.0f\n", rejected );
+
+	deltacache.peakused = 0;
+}
+
 /*
 =============
 SV_EmitPacketEntities
 
 Writes a delta update of an entity_state_t list to the message->
+returns true if client requested delta from out of date entities
 =============
 */
-static void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg )
+static qboolean SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg )
 {
 	entity_state_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		i, oldnum, newnum;
 	qboolean		player;
+	qboolean		outdated = false;
 	int		oldmax;
 	client_frame_t	*from;
+	sv_baseline_window_t	window;
+
+	window.numindexed = 0;
 
 	// this is the frame that we are going to delta update from
 	if( cl->delta_sequence != -1 )
@@ -275,7 +788,7 @@ static void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_
 		// the snapshot's entities may still have rolled off the buffer, though
 		if( from->first_entity <= ( svs.next_client_entities - svs.num_client_entities ))
 		{
-			Con_DPrintf( S_WARN "%s: delta request from out of date entities.\n", cl->name );
+			outdated = true;
 			MSG_BeginServerCmd( msg, svc_packetentities );
 			MSG_WriteUBitLong( msg, to->num_entities - 1, MAX_VISIBLE_PACKET_BITS );
 
@@ -332,7 +845,7 @@ static void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_
 			// delta update from old position
 			// because the force parm is false, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity( oldent, newent, msg, false, player, sv.time, 0 );
+			SV_WriteDeltaEntity( oldent, newent, msg, false, player, 0 );
 			oldindex++;
 			newindex++;
 			continue;
@@ -347,7 +860,7 @@ static void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_
 			// trying to reduce message by select optimal baseline
 			if( !sv_instancedbaseline.value || !sv.num_instanced || sv.last_valid_baseline > newnum )
 			{
-				offset = SV_FindBestBaseline( cl, newindex, &baseline, newent, to, player );
+				offset = SV_FindBestBaseline( newindex, &baseline, newent, to, player, &window );
 			}
 			else
 			{
@@ -363,7 +876,7 @@ static void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_
 			}
 
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity( baseline, newent, msg, true, player, sv.time, offset );
+			SV_WriteDeltaEntity( baseline, newent, msg, true, player, offset );
 			newindex++;
 			continue;
 		}
@@ -385,6 +898,8 @@ static void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_
 	}
 
 	MSG_WriteUBitLong( msg, LAST_EDICT, MAX_ENTITY_BITS ); // end of packetentities
+
+	return outdated;
 }
 
 /*
@@ -632,33 +1147,38 @@ static void SV_WriteClientdataToMessage( sv_client_t *cl, sizebuf_t *msg )
 ==================
 SV_WriteEntitiesToClient
 
+calls the game to collect visible entities and
+copies them into the shared packet_entities ring.
+must be run serially
 ==================
 */
-static void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
+static void SV_WriteEntitiesToClient( sv_datagram_t *dg )
 {
+	sv_client_t	*cl = dg->cl;
 	client_frame_t	*frame;
 	entity_state_t	*state;
 	static sv_ents_t	frame_ents;
-	int		i, send_pings;
+	int		i;
 
 	frame = &cl->frames[cl->netchan.outgoing_sequence & SV_UPDATE_MASK];
-	send_pings = SV_ShouldUpdatePing( cl );
+	dg->frame = frame;
+	dg->send_pings = SV_ShouldUpdatePing( cl );
 
 	memset( frame_ents.sended, 0, sizeof( frame_ents.sended ));
 	ClearBits( sv.hostflags, SVF_MERGE_VISIBILITY );
 
 	// clear everything in this snapshot
-	frame_ents.num_entities = c_fullsend = c_notsend = 0;
+	frame_ents.num_entities = frame_ents.num_ignored = 0;
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
 	SV_AddEntitiesToPacket( cl->pViewEntity, cl->edict, frame, &frame_ents, true );
 
-	if( c_notsend != cl->ignored_ents )
+	if( frame_ents.num_ignored != cl->ignored_ents )
 	{
-		if( c_notsend > 0 )
-			Con_Printf( S_ERROR "Too many entities in visible packet list. Ignored %d entities\n", c_notsend );
-		cl->ignored_ents = c_notsend;
+		if( frame_ents.num_ignored > 0 )
+			Con_Printf( S_ERROR "Too many entities in visible packet list. Ignored %d entities\n", frame_ents.num_ignored );
+		cl->ignored_ents = frame_ents.num_ignored;
 	}
 
 	// if there were portals visible, there may be out of order entities
@@ -688,10 +1208,6 @@ static void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
 		svs.next_client_entities++;
 		frame->num_entities++;
 	}
-
-	SV_EmitPacketEntities( cl, frame, msg );
-	SV_EmitEvents( cl, frame, msg );
-	if( send_pings ) SV_EmitPings( msg );
 }
 
 /*
@@ -703,23 +1219,55 @@ FRAME UPDATES
 */
 /*
 =======================
-SV_SendClientDatagram
+SV_BeginClientDatagram
+
+everything that calls into the game dll
 =======================
 */
-static void SV_SendClientDatagram( sv_client_t *cl )
+static void SV_BeginClientDatagram( sv_datagram_t *dg, sv_client_t *cl )
 {
-	byte	msg_buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
+	dg->cl = cl;
+	dg->outdated = false;
 
-	memset( msg_buf, 0, sizeof( msg_buf ));
-	MSG_Init( &msg, "Datagram", msg_buf, sizeof( msg_buf ));
+	memset( dg->msg_buf, 0, sizeof( dg->msg_buf ));
+	MSG_Init( &dg->msg, "Datagram", dg->msg_buf, sizeof( dg->msg_buf ));
 
 	// always send servertime at new frame
-	MSG_BeginServerCmd( &msg, svc_time );
-	MSG_WriteFloat( &msg, sv.time );
+	MSG_BeginServerCmd( &dg->msg, svc_time );
+	MSG_WriteFloat( &dg->msg, sv.time );
+
+	SV_WriteClientdataToMessage( cl, &dg->msg );
+	SV_WriteEntitiesToClient( dg );
+}
+
+/*
+=======================
+SV_EncodeClientDatagram
+
+delta encodes the frame gathered by SV_BeginClientDatagram.
+touches only the client itself and data that is read-only
+until all the datagrams are encoded, so it may run on a worker
+=======================
+*/
+static void SV_EncodeClientDatagram( sv_datagram_t *dg )
+{
+	dg->outdated = SV_EmitPacketEntities( dg->cl, dg->frame, &dg->msg );
+	SV_EmitEvents( dg->cl, dg->frame, &dg->msg );
+	if( dg->send_pings ) SV_EmitPings( &dg->msg );
+}
+
+/*
+=======================
+SV_FinishClientDatagram
+=======================
+*/
+static void SV_FinishClientDatagram( sv_datagram_t *dg )
+{
+	sv_client_t	*cl = dg->cl;
+	sizebuf_t		*msg = &dg->msg;
 
-	SV_WriteClientdataToMessage( cl, &msg );
-	SV_WriteEntitiesToClient( cl, &msg );
+	if( dg->outdated )
+		Con_DPrintf( S_WARN "%s: delta request from out of date entities.\n", cl->name );
 
 	// copy the accumulated multicast datagram
 	// for this client out to the message
@@ -729,22 +1277,206 @@ static void SV_SendClientDatagram( sv_client_t *cl )
 	}
 	else
 	{
-		if( MSG_GetNumBytesWritten( &cl->datagram ) < MSG_GetNumBytesLeft( &msg ))
-			MSG_WriteBits( &msg, MSG_GetData( &cl->datagram ), MSG_GetNumBitsWritten( &cl->datagram ));
+		if( MSG_GetNumBytesWritten( &cl->datagram ) < MSG_GetNumBytesLeft( msg ))
+			MSG_WriteBits( msg, MSG_GetData( &cl->datagram ), MSG_GetNumBitsWritten( &cl->datagram ));
 		else Con_DPrintf( S_WARN "Ignoring unreliable datagram for %s, would overflow on msg\n", cl->name );
 	}
 
 	MSG_Clear( &cl->datagram );
 
-	if( MSG_CheckOverflow( &msg ))
+	if( MSG_CheckOverflow( msg ))
 	{
 		// must have room left for the packet header
-		Con_Printf( S_ERROR "%s overflowed for %s\n", MSG_GetName( &msg ), cl->name );
-		MSG_Clear( &msg );
+		Con_Printf( S_ERROR "%s overflowed for %s\n", MSG_GetName( msg ), cl->name );
+		MSG_Clear( msg );
 	}
 
 	// send the datagram
-	Netchan_TransmitBits( &cl->netchan, MSG_GetNumBitsWritten( &msg ), MSG_GetData( &msg ));
+	Netchan_TransmitBits( &cl->netchan, MSG_GetNumBitsWritten( msg ), MSG_GetData( msg ));
+}
+
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+static void SV_SendClientDatagram( sv_client_t *cl )
+{
+	static sv_datagram_t	dg;
+
+	SV_BeginClientDatagram( &dg, cl );
+	SV_EncodeClientDatagram( &dg );
+	SV_FinishClientDatagram( &dg );
+}
+
+/*
+=======================
+SV_RunSendJobs
+
+encode queued datagrams until there is nothing left
+=======================
+*/
+static void SV_RunSendJobs( void )
+{
+	int	i, count = 0;
+
+	while(( i = sendpool.nextdatagram++ ) < sendpool.numdatagrams )
+	{
+		SV_EncodeClientDatagram( &sendpool.datagrams[i] );
+		count++;
+	}
+
+	if( count )
+	{
+		std::lock_guard<std::mutex> guard( sendpool.lock );
+
+		sendpool.pending -= count;
+		if( sendpool.pending <= 0 )
+			sendpool.done.notify_all();
+	}
+}
+
+/*
+=======================
+SV_SendWorker
+=======================
+*/
+static void SV_SendWorker( void )
+{
+	uint	batch;
+
+	{
+		std::lock_guard<std::mutex> guard( sendpool.lock );
+		batch = sendpool.batch;
+	}
+
+	while( 1 )
+	{
+		{
+			std::unique_lock<std::mutex> guard( sendpool.lock );
+
+			sendpool.wake.wait( guard, [&batch]{ return sendpool.quit || sendpool.batch != batch; });
+			if( sendpool.quit ) return;
+			batch = sendpool.batch;
+		}
+
+		SV_RunSendJobs();
+	}
+}
+
+/*
+=======================
+SV_ShutdownSendWorkers
+=======================
+*/
+void SV_ShutdownSendWorkers( void )
+{
+	int	i;
+
+	if( sendpool.numthreads )
+	{
+		{
+			std::lock_guard<std::mutex> guard( sendpool.lock );
+			sendpool.quit = true;
+		}
+
+		sendpool.wake.notify_all();
+
+		for( i = 0; i < sendpool.numthreads; i++ )
+		{
+			sendpool.threads[i]->join();
+			delete sendpool.threads[i];
+			sendpool.threads[i] = NULL;
+		}
+
+		sendpool.numthreads = 0;
+		sendpool.quit = false;
+	}
+
+	if( sendpool.datagrams )
+	{
+		Mem_Free( sendpool.datagrams );
+		sendpool.datagrams = NULL;
+	}
+}
+
+/*
+=======================
+SV_StartSendWorkers
+
+(re)spawn the pool to match sv_sendthreads,
+returns false if datagrams must be encoded serially
+=======================
+*/
+static qboolean SV_StartSendWorkers( void )
+{
+	int	i, numthreads;
+
+	numthreads = bound( 0, (int)sv_sendthreads.value, SV_MAX_SENDTHREADS );
+
+	if( numthreads != sendpool.numthreads )
+	{
+		SV_ShutdownSendWorkers();
+
+		if( !numthreads )
+			return false;
+
+		sendpool.datagrams = (sv_datagram_t *)Mem_Malloc( host.mempool, sizeof( sv_datagram_t ) * MAX_CLIENTS );
+		sendpool.nextdatagram = MAX_CLIENTS; // nothing to claim yet
+
+		for( i = 0; i < numthreads; i++ )
+			sendpool.threads[i] = new std::thread( SV_SendWorker );
+		sendpool.numthreads = numthreads;
+	}
+
+	return sendpool.numthreads != 0;
+}
+
+/*
+=======================
+SV_EncodeDatagrams
+
+run SV_EncodeClientDatagram for all queued clients
+on the worker pool, the main thread helps too
+=======================
+*/
+static void SV_EncodeDatagrams( void )
+{
+	sv_client_t	*cl;
+	int		i;
+
+	if( !sendpool.numdatagrams )
+		return;
+
+	// refresh the ping cache now so SV_EmitPings only reads it
+	for( i = 0, cl = svs.clients; i < svs.maxclients; i++, cl++ )
+	{
+		if( cl->state == cs_spawned )
+			SV_GetPlayerStats( cl, NULL, NULL );
+	}
+
+	Delta_SetThreaded( true );
+
+	{
+		std::lock_guard<std::mutex> guard( sendpool.lock );
+
+		sendpool.nextdatagram = 0;
+		sendpool.pending = sendpool.numdatagrams;
+		sendpool.batch++;
+	}
+
+	sendpool.wake.notify_all();
+	SV_RunSendJobs();
+
+	{
+		std::unique_lock<std::mutex> guard( sendpool.lock );
+		sendpool.done.wait( guard, []{ return sendpool.pending <= 0; });
+	}
+
+	// late workers must not claim the next batch while it's gathered
+	sendpool.nextdatagram = MAX_CLIENTS;
+
+	Delta_SetThreaded( false );
 }
 
 /*
@@ -843,12 +1575,20 @@ void SV_SendClientMessages( void )
 	int          i;
 	double       updaterate_time;
 	double       time_until_next_message;
+	qboolean     parallel;
 
 	if( sv.state == ss_dead )
 		return;
 
 	SV_UpdateToReliableMessages ();
 
+	Delta_SetPlans( sv_deltaplans.value != 0.0f );
+	baselinecache.frame++; // previous choices are stale
+	SV_BeginDeltaCache();
+	SV_RecordLagHistory();
+	parallel = SV_StartSendWorkers();
+	sendpool.numdatagrams = 0;
+
 	// send a message to each connected client
 	for( i = 0, sv.current_client = svs.clients; i < svs.maxclients; i++, sv.current_client++ )
 	{
@@ -917,14 +1657,27 @@ void SV_SendClientMessages( void )
 			ClearBits( cl->flags, FCL_SEND_NET_MESSAGE );
 
 			// NOTE: we should send frame even if server is not simulated to prevent overflow
-			if( cl->state == cs_spawned )
-				SV_SendClientDatagram( cl );
-			else Netchan_TransmitBits( &cl->netchan, 0, NULL ); // just update reliable
+			if( cl->state != cs_spawned )
+				Netchan_TransmitBits( &cl->netchan, 0, NULL ); // just update reliable
+			else if( parallel )
+				SV_BeginClientDatagram( &sendpool.datagrams[sendpool.numdatagrams++], cl );
+			else SV_SendClientDatagram( cl );
 		}
 	}
 
 	// reset current client
 	sv.current_client = NULL;
+
+	if( !parallel || !sendpool.numdatagrams )
+		return;
+
+	// all the game callbacks are done and the packet_entities ring
+	// won't change until the next frame, encode the deltas in parallel
+	SV_EncodeDatagrams();
+
+	for( i = 0; i < sendpool.numdatagrams; i++ )
+		SV_FinishClientDatagram( &sendpool.datagrams[i] );
+	sendpool.numdatagrams = 0;
 }
 
 /*
@@ -27,40 +27,137 @@ GNU General Public License for more details.
 
 using namespace engine;
 
-static void Sky_HookGmsg(const std::string& name, void* memory, size_t size)
+// user message subscriptions, resolved to message index at registration
+#define MAX_USERMSG_HOOKS	32
+
+typedef struct
+{
+	char		name[32];
+	sv_usermsg_hook_t	func;
+	int		next;	// next hook of the same message, 1-based
+} sv_usermsg_hook_entry_t;
+
+static struct
+{
+	sv_usermsg_hook_entry_t	hooks[MAX_USERMSG_HOOKS];
+	int			count;
+} sv_msghooks;
+
+/*
+=============
+SV_AttachUserMessageHooks
+
+link hooks subscribed by name to registered message
+=============
+*/
+static void SV_AttachUserMessageHooks( sv_user_message_t *user )
 {
-	if (name == "DeathMsg")
+	int	i;
+
+	user->hook = 0;
+
+	for( i = sv_msghooks.count - 1; i >= 0; i-- )
 	{
-		auto msg = sky::BitBuffer();
-		msg.write(memory, size + 3);
-		msg.toStart();
-		auto msg_index = msg.read<uint8_t>();
-		auto _size = msg.read<uint16_t>();
-		assert(size == _size);
-		auto killer_index = msg.read<uint8_t>();
-		auto victim_index = msg.read<uint8_t>();
-		auto weapon = sky::bitbuffer_helpers::ReadString(msg);
+		if( Q_strcmp( sv_msghooks.hooks[i].name, user->name ))
+			continue;
 
-		if (killer_index == 0)
-			return;
+		sv_msghooks.hooks[i].next = user->hook;
+		user->hook = i + 1;
+	}
+}
 
-		if (killer_index == victim_index)
-			return;
+/*
+=============
+SV_HookUserMessage
 
-		auto killer = svs.clients + killer_index - 1;
-		auto victim = svs.clients + victim_index - 1;
+call func for every sent user message with this name
+=============
+*/
+qboolean SV_HookUserMessage( const char *name, sv_usermsg_hook_t func )
+{
+	sv_usermsg_hook_entry_t	*hook;
+	int			i;
 
-		bool killer_is_bot = FBitSet(killer->edict->v.flags, FL_FAKECLIENT);
-		bool victim_is_bot = FBitSet(victim->edict->v.flags, FL_FAKECLIENT);
+	for( i = 0; i < sv_msghooks.count; i++ )
+	{
+		if( sv_msghooks.hooks[i].func == func && !Q_strcmp( sv_msghooks.hooks[i].name, name ))
+			return true; // already subscribed
+	}
+
+	if( sv_msghooks.count == MAX_USERMSG_HOOKS || Q_strlen( name ) >= sizeof( hook->name ))
+	{
+		Con_Printf( S_ERROR "%s: can't hook %s\n", __func__, name );
+		return false;
+	}
 
-		sky::Emit(sky::FragEvent{
-			.killer_name = killer->name,
-			.victim_name = victim->name,
-			.weapon = weapon,
-			.killer_is_bot = killer_is_bot,
-			.victim_is_bot = victim_is_bot
-		});
+	hook = &sv_msghooks.hooks[sv_msghooks.count++];
+	Q_strncpy( hook->name, name, sizeof( hook->name ));
+	hook->func = func;
+
+	// message may be registered already
+	for( i = 1; i < MAX_USER_MESSAGES && svgame.msg[i].name[0]; i++ )
+	{
+		if( !Q_strcmp( svgame.msg[i].name, name ))
+		{
+			SV_AttachUserMessageHooks( &svgame.msg[i] );
+			break;
+		}
 	}
+
+	return true;
+}
+
+/*
+=============
+SV_CallUserMessageHooks
+=============
+*/
+static void SV_CallUserMessageHooks( const sv_user_message_t *user, const byte *data, int size )
+{
+	int	i;
+
+	for( i = user->hook; i; i = sv_msghooks.hooks[i - 1].next )
+		sv_msghooks.hooks[i - 1].func( user, data, size );
+}
+
+/*
+=============
+Sky_DeathMsg
+
+DeathMsg: byte killer, byte victim, string weapon
+=============
+*/
+static void Sky_DeathMsg( const sv_user_message_t *user, const byte *data, int size )
+{
+	int	killer_index, victim_index;
+
+	if( size < 2 )
+		return;
+
+	killer_index = data[0];
+	victim_index = data[1];
+
+	if( killer_index == 0 || killer_index == victim_index )
+		return;
+
+	if( killer_index > svs.maxclients || victim_index < 1 || victim_index > svs.maxclients )
+		return;
+
+	auto weapon = (const char *)data + 2;
+	auto weapon_end = (const char *)memchr( weapon, 0, size - 2 );
+	auto killer = svs.clients + killer_index - 1;
+	auto victim = svs.clients + victim_index - 1;
+
+	bool killer_is_bot = FBitSet(killer->edict->v.flags, FL_FAKECLIENT);
+	bool victim_is_bot = FBitSet(victim->edict->v.flags, FL_FAKECLIENT);
+
+	sky::Emit(sky::FragEvent{
+		.killer_name = killer->name,
+		.victim_name = victim->name,
+		.weapon = std::string(weapon, weapon_end ? weapon_end : weapon + size - 2),
+		.killer_is_bot = killer_is_bot,
+		.victim_is_bot = victim_is_bot
+	});
 }
 
 
@@ -75,6 +172,45 @@ static byte fatphs[MAX_MAP_LEAFS/8];
 static byte clientpvs[MAX_MAP_LEAFS/8];	// for find client in PVS
 static vec3_t viewPoint[MAX_CLIENTS];
 
+// (field, value) -> edicts index for SV_FindEntityByString
+#define ENTINDEX_HASHSIZE	4096	// must be power of two
+
+enum
+{
+	ENTINDEX_CLASSNAME = 0,
+	ENTINDEX_TARGETNAME,
+	ENTINDEX_TARGET,
+	ENTINDEX_GLOBALNAME,
+	ENTINDEX_FIELDS
+};
+
+static const int entindex_offsets[ENTINDEX_FIELDS] =
+{
+	offsetof( entvars_t, classname ),
+	offsetof( entvars_t, targetname ),
+	offsetof( entvars_t, target ),
+	offsetof( entvars_t, globalname ),
+};
+
+static struct
+{
+	qboolean	valid;
+	int	head[ENTINDEX_FIELDS][ENTINDEX_HASHSIZE];	// lowest edict in the chain
+	int	next[ENTINDEX_FIELDS][MAX_EDICTS];	// 0 is end of the chain
+	string_t	key[ENTINDEX_FIELDS][MAX_EDICTS];	// value seen when the edict was last linked
+	int	bucket[ENTINDEX_FIELDS][MAX_EDICTS];	// -1 if not linked
+} sv_entindex;
+
+// results of the last area query for pfnFindEntityInSphere
+static struct
+{
+	vec3_t	origin;
+	float	radius;
+	uint	areagen;
+	int	numentities;	// -1 if empty
+	int	entities[MAX_EDICTS];
+} sv_spherecache = { { 0 }, 0.0f, 0, -1 };
+
 // exports
 typedef void (__cdecl *LINK_ENTITY_FUNC)( entvars_t *pev );
 typedef void (__stdcall *GIVEFNPTRSTODLL)( enginefuncs_t* engfuncs, globalvars_t *pGlobals );
@@ -482,8 +618,7 @@ static int SV_Multicast( int dest, const vec3_t origin, const edict_t *ent, qboo
 	case MSG_PAS:
 		if( origin == NULL ) return false;
 		// NOTE: GoldSource not using PHS for singleplayer
-		Mod_FatPVS( origin, FATPHS_RADIUS, fatphs, world.fatbytes, false, ( svs.maxclients == 1 ));
-		mask = fatphs; // using the FatPVS like a PHS
+		mask = Mod_GetFatPHSForPoint( origin, fatphs, ( svs.maxclients == 1 )); // using the FatPVS like a PHS
 		break;
 	case MSG_PVS_R:
 		reliable = true;
@@ -1123,6 +1258,12 @@ void SV_InitEdict( edict_t *pEdict )
 	pEdict->v.controller[2] = 0x7F;
 	pEdict->v.controller[3] = 0x7F;
 	pEdict->free = false;
+
+	// put into the unlinked entities list
+	if( !pEdict->area.prev )
+		SV_UnlinkEdict( pEdict );
+
+	SV_UpdateEntityIndex( pEdict );
 }
 
 /*
@@ -1160,6 +1301,11 @@ void SV_FreeEdict( edict_t *pEdict )
 	VectorClear( pEdict->v.angles );
 	VectorClear( pEdict->v.origin );
 	pEdict->free = true;
+
+	// drop from the unlinked entities list
+	SV_UnlinkEdict( pEdict );
+
+	SV_UpdateEntityIndex( pEdict );
 }
 
 /*
@@ -1235,6 +1381,7 @@ static edict_t* SV_AllocPrivateData( edict_t *ent, string_t className )
 
 	ent->v.classname = className;
 	ent->v.pContainingEntity = ent; // re-link
+	SV_UpdateEntityIndex( ent );
 
 	// allocate edict private memory (passed by dlls)
 	SpawnEdict = SV_GetEntityClass( pszClassName );
@@ -1300,6 +1447,8 @@ void SV_FreeEdicts( void )
 		if( ent->free ) continue;
 		SV_FreeEdict( ent );
 	}
+
+	SV_InvalidateEntityIndex();
 }
 
 /*
@@ -1596,6 +1745,190 @@ static void GAME_EXPORT pfnChangePitch( edict_t* ent )
 	ent->v.angles[PITCH] = SV_AngleMod( ent->v.idealpitch, ent->v.angles[PITCH], ent->v.pitch_speed );
 }
 
+/*
+=========
+SV_InvalidateEntityIndex
+
+force SV_FindEntityByString to rebuild the index
+=========
+*/
+void SV_InvalidateEntityIndex( void )
+{
+	sv_entindex.valid = false;
+}
+
+/*
+=========
+SV_UnlinkEntityIndex
+
+=========
+*/
+static void SV_UnlinkEntityIndex( int field, int e )
+{
+	int	*link;
+
+	if( sv_entindex.bucket[field][e] < 0 )
+		return;
+
+	for( link = &sv_entindex.head[field][sv_entindex.bucket[field][e]]; *link != 0; link = &sv_entindex.next[field][*link] )
+	{
+		if( *link == e )
+		{
+			*link = sv_entindex.next[field][e];
+			break;
+		}
+	}
+
+	sv_entindex.bucket[field][e] = -1;
+	sv_entindex.key[field][e] = 0;
+}
+
+/*
+=========
+SV_LinkEntityIndex
+
+keeps the chain sorted by edict number
+=========
+*/
+static void SV_LinkEntityIndex( int field, int e )
+{
+	edict_t		*ed = EDICT_NUM( e );
+	const char	*t;
+	string_t		str;
+	uint		hash;
+	int		*link;
+
+	str = ed->free ? 0 : *(string_t *)((byte *)&ed->v + entindex_offsets[field] );
+	sv_entindex.key[field][e] = str;
+	if( !str ) return;
+
+	t = STRING( str );
+	if( !t || t == svgame.globals->pStringBase )
+		return;
+
+	hash = COM_HashKey( t, ENTINDEX_HASHSIZE );
+
+	for( link = &sv_entindex.head[field][hash]; *link != 0 && *link < e; link = &sv_entindex.next[field][*link] );
+
+	sv_entindex.next[field][e] = *link;
+	*link = e;
+	sv_entindex.bucket[field][e] = hash;
+}
+
+/*
+=========
+SV_EntityIndexIsStale
+
+game can write entvars directly, catch any
+value that differs from the one it was indexed with
+=========
+*/
+static qboolean SV_EntityIndexIsStale( int field )
+{
+	edict_t	*ed;
+	int	e;
+
+	for( e = 1; e < svgame.numEntities; e++ )
+	{
+		ed = EDICT_NUM( e );
+
+		if( sv_entindex.key[field][e] != ( ed->free ? 0 : *(string_t *)((byte *)&ed->v + entindex_offsets[field] )))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+=========
+SV_UpdateEntityIndex
+
+relink the edict after the engine changed
+its names, allocated or freed it
+=========
+*/
+void SV_UpdateEntityIndex( edict_t *ed )
+{
+	int	e, i;
+
+	if( !sv_entindex.valid )
+		return; // rebuilt on the next search anyway
+
+	e = NUM_FOR_EDICT( ed );
+
+	for( i = 0; i < ENTINDEX_FIELDS; i++ )
+	{
+		if( sv_entindex.key[i][e] == ( ed->free ? 0 : *(string_t *)((byte *)&ed->v + entindex_offsets[i] )))
+			continue;
+
+		SV_UnlinkEntityIndex( i, e );
+		SV_LinkEntityIndex( i, e );
+	}
+}
+
+/*
+=========
+SV_BuildEntityIndex
+
+=========
+*/
+static void SV_BuildEntityIndex( void )
+{
+	int	e, i;
+
+	memset( sv_entindex.head, 0, sizeof( sv_entindex.head ));
+	memset( sv_entindex.key, 0, sizeof( sv_entindex.key ));
+	memset( sv_entindex.bucket, 0xFF, sizeof( sv_entindex.bucket ));
+
+	// walk backwards so chains are sorted by edict number
+	for( e = svgame.numEntities - 1; e > 0; e-- )
+	{
+		for( i = 0; i < ENTINDEX_FIELDS; i++ )
+			SV_LinkEntityIndex( i, e );
+	}
+
+	sv_entindex.valid = true;
+}
+
+/*
+=========
+SV_FindEntityByIndex
+
+same as linear search in SV_FindEntityByString,
+but walks only the edicts with the same value hash.
+Comparing the stored keys is much cheaper than
+comparing the strings, so it's done on every search
+=========
+*/
+static edict_t *SV_FindEntityByIndex( int start, int field, const char *pszValue )
+{
+	const char	*t;
+	string_t		str;
+	edict_t		*ed;
+	int		e;
+
+	if( !sv_entindex.valid || SV_EntityIndexIsStale( field ))
+		SV_BuildEntityIndex();
+
+	for( e = sv_entindex.head[field][COM_HashKey( pszValue, ENTINDEX_HASHSIZE )]; e != 0; e = sv_entindex.next[field][e] )
+	{
+		ed = EDICT_NUM( e );
+		str = sv_entindex.key[field][e];
+
+		if( e <= start ) continue;
+		if( !SV_IsValidEdict( ed )) continue;
+
+		if( e <= svs.maxclients && !SV_ClientFromEdict( ed, ( svs.maxclients != 1 )))
+			continue;
+
+		t = STRING( str );
+		if( t != NULL && t != svgame.globals->pStringBase && !Q_strcmp( t, pszValue ))
+			return ed;
+	}
+
+	return svgame.edicts;
+}
+
 /*
 =========
 SV_FindEntityByString
@@ -1626,6 +1959,15 @@ static edict_t *GAME_EXPORT SV_FindEntityByString( edict_t *pStartEdict, const c
 		return svgame.edicts;
 	}
 
+	if( sv_fastfind.value )
+	{
+		for( index = 0; index < ENTINDEX_FIELDS; index++ )
+		{
+			if( desc->fieldOffset == entindex_offsets[index] )
+				return SV_FindEntityByIndex( e, index, pszValue );
+		}
+	}
+
 	for( e++; e < svgame.numEntities; e++ )
 	{
 		ed = EDICT_NUM( e );
@@ -1693,23 +2035,117 @@ static int GAME_EXPORT pfnGetEntityIllum( edict_t* pEnt )
 
 /*
 =================
-pfnFindEntityInSphere
+SV_EntityInSphere
 
-find the entity in sphere
 =================
 */
-static edict_t *GAME_EXPORT pfnFindEntityInSphere( edict_t *pStartEdict, const float *org, float flRadius )
+static qboolean SV_EntityInSphere( edict_t *ent, const float *org, float radiusSquared )
 {
 	float	distSquared;
-	int	j, e = 0;
 	float	eorg;
+	int	j;
+
+	distSquared = 0.0f;
+
+	for( j = 0; j < 3 && distSquared <= radiusSquared; j++ )
+	{
+		if( org[j] < ent->v.absmin[j] )
+			eorg = org[j] - ent->v.absmin[j];
+		else if( org[j] > ent->v.absmax[j] )
+			eorg = org[j] - ent->v.absmax[j];
+		else eorg = 0.0f;
+
+		distSquared += eorg * eorg;
+	}
+
+	return distSquared < radiusSquared;
+}
+
+/*
+=================
+SV_FindEntityInSphereArea
+
+games call pfnFindEntityInSphere in a loop with the
+same sphere, so the area query is kept until any
+entity was linked or unlinked
+=================
+*/
+static edict_t *SV_FindEntityInSphereArea( int start, const float *org, float flRadius )
+{
+	int	lo, hi, mid, e;
 	edict_t	*ent;
 
+	if( sv_spherecache.numentities < 0 || sv_spherecache.areagen != SV_AreaGeneration()
+		|| sv_spherecache.radius != flRadius || !VectorCompare( sv_spherecache.origin, org ))
+	{
+		vec3_t	mins, maxs;
+		float	r = fabs( flRadius );
+
+		VectorSet( mins, org[0] - r, org[1] - r, org[2] - r );
+		VectorSet( maxs, org[0] + r, org[1] + r, org[2] + r );
+
+		sv_spherecache.numentities = SV_AreaEdicts( mins, maxs, sv_spherecache.entities, MAX_EDICTS );
+		sv_spherecache.areagen = SV_AreaGeneration();
+		sv_spherecache.radius = flRadius;
+		VectorCopy( org, sv_spherecache.origin );
+	}
+
+	// find the first entity after the start
+	lo = 0;
+	hi = sv_spherecache.numentities;
+
+	while( lo < hi )
+	{
+		mid = ( lo + hi ) >> 1;
+		if( sv_spherecache.entities[mid] <= start )
+			lo = mid + 1;
+		else hi = mid;
+	}
+
 	flRadius *= flRadius;
 
+	for( ; lo < sv_spherecache.numentities; lo++ )
+	{
+		e = sv_spherecache.entities[lo];
+		if( e >= svgame.numEntities )
+			break;
+
+		ent = EDICT_NUM( e );
+
+		if( !SV_IsValidEdict( ent ))
+			continue;
+
+		// ignore clients that not in a game
+		if( e <= svs.maxclients && !SV_ClientFromEdict( ent, true ))
+			continue;
+
+		if( SV_EntityInSphere( ent, org, flRadius ))
+			return ent;
+	}
+
+	return svgame.edicts;
+}
+
+/*
+=================
+pfnFindEntityInSphere
+
+find the entity in sphere
+=================
+*/
+static edict_t *GAME_EXPORT pfnFindEntityInSphere( edict_t *pStartEdict, const float *org, float flRadius )
+{
+	int	e = 0;
+	edict_t	*ent;
+
 	if( SV_IsValidEdict( pStartEdict ))
 		e = NUM_FOR_EDICT( pStartEdict );
 
+	if( sv_fastfind.value )
+		return SV_FindEntityInSphereArea( e, org, flRadius );
+
+	flRadius *= flRadius;
+
 	for( e++; e < svgame.numEntities; e++ )
 	{
 		ent = EDICT_NUM( e );
@@ -1721,20 +2157,7 @@ static edict_t *GAME_EXPORT pfnFindEntityInSphere( edict_t *pStartEdict, const f
 		if( e <= svs.maxclients && !SV_ClientFromEdict( ent, true ))
 			continue;
 
-		distSquared = 0.0f;
-
-		for( j = 0; j < 3 && distSquared <= flRadius; j++ )
-		{
-			if( org[j] < ent->v.absmin[j] )
-				eorg = org[j] - ent->v.absmin[j];
-			else if( org[j] > ent->v.absmax[j] )
-				eorg = org[j] - ent->v.absmax[j];
-			else eorg = 0.0f;
-
-			distSquared += eorg * eorg;
-		}
-
-		if( distSquared < flRadius )
+		if( SV_EntityInSphere( ent, org, flRadius ))
 			return ent;
 	}
 
@@ -2764,7 +3187,14 @@ static void GAME_EXPORT pfnMessageEnd( void )
 	if( !VectorIsNull( svgame.msg_org )) org = svgame.msg_org;
 	svgame.msg_dest = bound( MSG_BROADCAST, svgame.msg_dest, MSG_SPEC );
 
-	Sky_HookGmsg(svgame.msg_name, sv.multicast.pData, (size_t)svgame.msg_realsize);
+	if( svgame.msg_index > 0 && svgame.msg[svgame.msg_index].hook )
+	{
+		// payload follows svc byte and optional size word
+		int	offset = svgame.msg_size_index != -1 ? svgame.msg_size_index + 2 : 1;
+
+		SV_CallUserMessageHooks( &svgame.msg[svgame.msg_index], sv.multicast.pData + offset, svgame.msg_realsize );
+	}
+
 	SV_Multicast( svgame.msg_dest, org, svgame.msg_ent, true, false );
 
 	if( svgame.msg_trace ) Con_Printf( "^3%s()\n", __FUNCTION__ );
@@ -3011,6 +3441,16 @@ static void *GAME_EXPORT pfnPvEntPrivateData( edict_t *pEdict )
 
 
 #ifdef XASH_64BIT
+#define STR64_HASH_INITIAL	4096	// must be power of two
+#define STR64_HASH_MAXLOAD	2	// grow when count * 2 > size
+
+// open addressing hash index over string offsets
+typedef struct str64hash_s
+{
+	uint offset;	// offset from pstringarray, 0 is empty slot
+	uint hash;
+} str64hash_t;
+
 static struct str64_s
 {
 	size_t maxstringarray;
@@ -3026,7 +3466,153 @@ static struct str64_s
 	size_t numdups;
 	size_t numoverflows;
 	size_t totalalloc;
+
+	// dedup index
+	str64hash_t *hashtable;
+	uint hashsize;
+	uint hashcount;
+	size_t numlookups;
+	size_t numprobes;
+	size_t maxprobe;
+	size_t numrehashes;
 } str64;
+
+/*
+==================
+SV_Str64Hash
+
+case sensitive djb2
+==================
+*/
+static uint SV_Str64Hash( const char *string )
+{
+	uint hash = 5381;
+	byte c;
+
+	while(( c = *string++ ))
+		hash = ( hash << 5 ) + hash + c;
+
+	return hash;
+}
+
+/*
+==================
+SV_Str64ClearHash
+
+drop all indexed strings, called when pool range is reset
+==================
+*/
+static void SV_Str64ClearHash( void )
+{
+	if( str64.hashtable )
+		memset( str64.hashtable, 0, sizeof( *str64.hashtable ) * str64.hashsize );
+	str64.hashcount = 0;
+}
+
+/*
+==================
+SV_Str64InsertHash
+
+insert without growing, caller must ensure there is free space
+==================
+*/
+static void SV_Str64InsertHash( str64hash_t *table, uint size, uint offset, uint hash )
+{
+	uint i = hash & ( size - 1 );
+
+	while( table[i].offset )
+		i = ( i + 1 ) & ( size - 1 );
+
+	table[i].offset = offset;
+	table[i].hash = hash;
+}
+
+/*
+==================
+SV_Str64GrowHash
+
+double the table size and rehash all live entries
+==================
+*/
+static void SV_Str64GrowHash( void )
+{
+	uint newsize = str64.hashsize ? str64.hashsize * 2 : STR64_HASH_INITIAL;
+	str64hash_t *newtable = Mem_Calloc( host.mempool, sizeof( *newtable ) * newsize );
+	uint i;
+
+	for( i = 0; i < str64.hashsize; i++ )
+	{
+		if( str64.hashtable[i].offset )
+			SV_Str64InsertHash( newtable, newsize, str64.hashtable[i].offset, str64.hashtable[i].hash );
+	}
+
+	if( str64.hashtable )
+	{
+		Mem_Free( str64.hashtable );
+		str64.numrehashes++;
+	}
+
+	str64.hashtable = newtable;
+	str64.hashsize = newsize;
+}
+
+/*
+==================
+SV_Str64FindHash
+
+returns string in the current pool range or NULL
+==================
+*/
+static char *SV_Str64FindHash( const char *szValue, uint hash )
+{
+	size_t probes = 1;
+	uint i;
+
+	if( !str64.hashcount )
+		return NULL;
+
+	str64.numlookups++;
+
+	for( i = hash & ( str64.hashsize - 1 ); str64.hashtable[i].offset; i = ( i + 1 ) & ( str64.hashsize - 1 ), probes++ )
+	{
+		char *s = str64.pstringarray + str64.hashtable[i].offset;
+
+		if( str64.hashtable[i].hash != hash )
+			continue;
+
+		// must be inside of the range linear search used to walk
+		if( s <= str64.poldstringbase || s >= str64.plast )
+			continue;
+
+		if( !Q_strcmp( s, szValue ))
+			break;
+	}
+
+	str64.numprobes += probes;
+	if( probes > str64.maxprobe )
+		str64.maxprobe = probes;
+
+	if( !str64.hashtable[i].offset )
+		return NULL;
+
+	return str64.pstringarray + str64.hashtable[i].offset;
+}
+
+/*
+==================
+SV_Str64AddHash
+
+index newly allocated string
+==================
+*/
+static void SV_Str64AddHash( const char *newString )
+{
+	if(( str64.hashcount + 1 ) * STR64_HASH_MAXLOAD > str64.hashsize )
+		SV_Str64GrowHash();
+
+	SV_Str64InsertHash( str64.hashtable, str64.hashsize, newString - str64.pstringarray, SV_Str64Hash( newString ));
+	str64.hashcount++;
+}
 #endif
 
 /*
@@ -3045,6 +3631,7 @@ void SV_EmptyStringPool( void )
 	{
 		str64.pstringbase = str64.poldstringbase = str64.pstringarraystatic;
 		str64.plast = str64.pstringbase + 1;
+		SV_Str64ClearHash();
 	}
 #else
 	Mem_EmptyPool( svgame.stringspool );
@@ -3169,6 +3756,12 @@ static void SV_AllocStringPool( void )
 	str64.pstringbase = str64.poldstringbase = ptr;
 	str64.plast = (byte*)ptr + 1;
 	svgame.globals->pStringBase = ptr;
+
+	if( !str64.allowdup )
+	{
+		SV_Str64GrowHash();
+		str64.numlookups = str64.numprobes = str64.maxprobe = str64.numrehashes = 0;
+	}
 #else
 	svgame.stringspool = Mem_AllocPool( "Server Strings" );
 	svgame.globals->pStringBase = "";
@@ -3186,6 +3779,13 @@ static void SV_FreeStringPool( void )
 	else
 #endif
 		Mem_Free( str64.staticstringarray );
+
+	if( str64.hashtable )
+	{
+		Mem_Free( str64.hashtable );
+		str64.hashtable = NULL;
+		str64.hashsize = str64.hashcount = 0;
+	}
 #else
 	Mem_FreePool( &svgame.stringspool );
 #endif
@@ -3280,9 +3880,8 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 
 	if( !str64.allowdup )
 	{
-		for( newString = str64.poldstringbase + 1;
-			newString < str64.plast && ( cmp = Q_strcmp( newString, szValue ) );
-			newString += Q_strlen( newString ) + 1 );
+		newString = SV_Str64FindHash( szValue, SV_Str64Hash( szValue ));
+		if( newString ) cmp = 0;
 	}
 
 	if( cmp )
@@ -3294,6 +3893,7 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 			str64.plast = str64.pstringbase + 1;
 			str64.poldstringbase = str64.pstringbase;
 			str64.numoverflows++;
+			SV_Str64ClearHash();
 		}
 
 		//MsgDev( D_NOTE, "SV_AllocString: %ld %s\n", str64.plast - svgame.globals->pStringBase, szValue );
@@ -3302,6 +3902,9 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 
 		newString = str64.plast;
 		str64.plast += len;
+
+		if( !str64.allowdup )
+			SV_Str64AddHash( newString );
 	}
 	else
 	{
@@ -3333,6 +3936,20 @@ void SV_PrintStr64Stats_f( void )
 	Msg( "maximum array usage: %lu\n", str64.maxalloc );
 	Msg( "overflow counter: %lu\n", str64.numoverflows );
 	Msg( "dup string counter: %lu\n", str64.numdups );
+
+	if( str64.allowdup )
+	{
+		Msg( "deduplication disabled (-str64dup)\n" );
+		return;
+	}
+
+	Msg( "hash table size: %u\n", str64.hashsize );
+	Msg( "hashed strings: %u\n", str64.hashcount );
+	Msg( "load factor: %.3f\n", str64.hashsize ? (double)str64.hashcount / str64.hashsize : 0.0 );
+	Msg( "lookups: %lu\n", str64.numlookups );
+	Msg( "average probe length: %.3f\n", str64.numlookups ? (double)str64.numprobes / str64.numlookups : 0.0 );
+	Msg( "maximum probe length: %lu\n", str64.maxprobe );
+	Msg( "rehash counter: %lu\n", str64.numrehashes );
 }
 #endif
 
@@ -3556,6 +4173,7 @@ static int GAME_EXPORT pfnRegUserMsg( const char *pszName, int iSize )
 	Q_strncpy( svgame.msg[i].name, pszName, sizeof( svgame.msg[i].name ));
 	svgame.msg[i].number = svc_lastmsg + i;
 	svgame.msg[i].size = iSize;
+	SV_AttachUserMessageHooks( &svgame.msg[i] );
 
 	if( sv.state == ss_active )
 	{
@@ -4160,8 +4778,7 @@ void GAME_EXPORT SV_PlaybackEventFull( int flags, const edict_t *pInvoker, word
 	// setup pvs cluster for invoker
 	if( !FBitSet( flags, FEV_GLOBAL ))
 	{
-		Mod_FatPVS( pvspoint, FATPHS_RADIUS, fatphs, world.fatbytes, false, ( svs.maxclients == 1 ));
-		mask = fatphs; // using the FatPVS like a PHS
+		mask = Mod_GetFatPHSForPoint( pvspoint, fatphs, ( svs.maxclients == 1 )); // using the FatPVS like a PHS
 	}
 
 	// process all the clients
@@ -5025,6 +5642,9 @@ static qboolean SV_ParseEdict( char **pfile, edict_t *ent )
 	if( Mem_IsAllocatedExt( host.mempool, classname ))
 		Mem_Free( classname );
 
+	// keyvalues could change the indexed names
+	SV_UpdateEntityIndex( ent );
+
 	return true;
 }
 
@@ -5198,6 +5818,8 @@ qboolean SV_LoadProgs( const char *name )
 	svgame.globals = &gpGlobals;
 	svgame.mempool = Mem_AllocPool( "Server Edicts Zone" );
 
+	SV_HookUserMessage( "DeathMsg", Sky_DeathMsg );
+
 	svgame.hInstance = COM_LoadLibrary( name, true, false );
 	if( !svgame.hInstance )
 	{
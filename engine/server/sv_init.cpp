@@ -431,6 +431,47 @@ static void SV_CreateResourceList( void )
 	}
 }
 
+/*
+================
+SV_PrecompressResources
+
+let the compressed copies be ready
+before clients start downloading
+================
+*/
+static void SV_PrecompressResources( void )
+{
+	resource_t	*res;
+	int	i;
+
+	Netchan_PrecompressReset();
+
+	for( i = 0; i < sv.num_resources; i++ )
+	{
+		res = &sv.resources[i];
+
+		if( res->nDownloadSize <= 0 )
+			continue;
+
+		switch( res->type )
+		{
+		case t_sound:
+			if( res->szFileName[0] != '!' )
+				Netchan_Precompress( va( DEFAULT_SOUNDPATH "%s", res->szFileName ));
+			break;
+		case t_model:
+			if( res->szFileName[0] != '*' )
+				Netchan_Precompress( res->szFileName );
+			break;
+		case t_generic:
+		case t_eventscript:
+			Netchan_Precompress( res->szFileName );
+			break;
+		default: break;
+		}
+	}
+}
+
 /*
 ================
 SV_WriteVoiceCodec
@@ -621,6 +662,9 @@ void SV_ActivateServer( int runPhysics )
 	// collect all info from precached resources
 	SV_CreateResourceList();
 
+	if( sv_allow_download.value )
+		SV_PrecompressResources();
+
 	// check and count all files that marked by user as unmodified (typically is a player models etc)
 	SV_TransferConsistencyInfo();
 
@@ -811,6 +855,7 @@ static void SV_SetupClients( void )
 #endif
 
 	svs.clients = Z_Realloc( svs.clients, sizeof( sv_client_t ) * svs.maxclients );
+	SV_ClearClientHash();
 	svs.num_client_entities = svs.maxclients * SV_UPDATE_BACKUP * NUM_PACKET_ENTITIES;
 	svs.packet_entities = Z_Realloc( svs.packet_entities, sizeof( entity_state_t ) * svs.num_client_entities );
 	Con_Reportf( "%s alloced by server packet entities\n", Q_memprint( sizeof( entity_state_t ) * svs.num_client_entities ));
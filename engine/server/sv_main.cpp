@@ -29,6 +29,7 @@ CVAR_DEFINE_AUTO( sv_unlag, "1", 0, "allow lag compensation on server-side" );
 CVAR_DEFINE_AUTO( sv_maxunlag, "0.5", 0, "max latency value which can be interpolated (by default ping should not exceed 500 units)" );
 CVAR_DEFINE_AUTO( sv_unlagpush, "0.0", 0, "interpolation bias for unlag time" );
 CVAR_DEFINE_AUTO( sv_unlagsamples, "1", 0, "max samples to interpolate" );
+CVAR_DEFINE_AUTO( sv_unlaghistory, "1", 0, "rewind players from a per-player position history shared by all commands of a packet (0 walks the client frames for every command)" );
 CVAR_DEFINE_AUTO( rcon_password, "", FCVAR_PROTECTED | FCVAR_PRIVILEGED, "remote connect password" );
 CVAR_DEFINE_AUTO( rcon_enable, "1", FCVAR_PROTECTED, "enable accepting remote commands on server" );
 CVAR_DEFINE_AUTO( sv_filterban, "1", 0, "filter banned users" );
@@ -63,6 +64,13 @@ CVAR_DEFINE_AUTO( sv_trace_messages, "0", FCVAR_LATCH, "enable server usermessag
 CVAR_DEFINE_AUTO( sv_master_response_timeout, "4", FCVAR_ARCHIVE, "master server heartbeat response timeout in seconds" );
 CVAR_DEFINE_AUTO( sv_autosave, "1", FCVAR_ARCHIVE|FCVAR_SERVER|FCVAR_PRIVILEGED, "enable autosaving" );
 CVAR_DEFINE_AUTO( sv_speedhack_kick, "10", FCVAR_ARCHIVE, "number of speedhack warns before automatic kick (0 to disable)" );
+CVAR_DEFINE_AUTO( sv_fastfind, "1", 0, "use spatial and name indexes for game entity lookups (0 to scan all edicts)" );
+CVAR_DEFINE_AUTO( sv_sendthreads, "0", FCVAR_ARCHIVE, "worker threads encoding client snapshots (0 to encode on main thread)" );
+CVAR_DEFINE_AUTO( sv_baselinesearch, "1", 0, "only test similar entities as delta baselines and share the choice between clients (0 tests all of them)" );
+CVAR_DEFINE_AUTO( sv_deltacache, "1024", 0, "kilobytes of entity deltas encoded once per frame and copied to every client that needs them (0 disables)" );
+CVAR_DEFINE_AUTO( sv_deltaplans, "1", 0, "encode deltas with precompiled field plans (0 walks the delta field list)" );
+static CVAR_DEFINE_AUTO( sv_oobrate, "20", FCVAR_ARCHIVE, "packets per second accepted from address without connected client (0 is unlimited)" );
+static CVAR_DEFINE_AUTO( sv_oobburst, "40", FCVAR_ARCHIVE, "packets accepted at once from address without connected client" );
 
 // game-related cvars
 CVAR_DEFINE_AUTO( mapcyclefile, "mapcycle.txt", 0, "name of multiplayer map cycle configuration file" );
@@ -451,6 +459,186 @@ void SV_ProcessFile( sv_client_t *cl, const char *filename )
 	if( bError ) Con_Printf( S_ERROR "parsing custom decal from %s\n", cl->name );
 }
 
+// base address -> client slots, 1-based chains
+#define CLIENT_HASHSIZE	256	// must be power of two
+#define SOURCE_HASHSIZE	4096	// must be power of two
+
+static struct
+{
+	byte		head[CLIENT_HASHSIZE];
+	byte		next[MAX_CLIENTS];
+	short		bucket[MAX_CLIENTS];	// -1 if not linked
+} sv_clienthash;
+
+// token buckets of addresses without connected client
+typedef struct
+{
+	netadr_t		adr;
+	float		tokens;
+	double		time;
+} sv_source_t;
+
+static sv_source_t	sv_sources[SOURCE_HASHSIZE];
+
+/*
+=================
+SV_AddressHashKey
+
+hash of base address, port is ignored
+=================
+*/
+static uint SV_AddressHashKey( const netadr_t *adr )
+{
+	const byte	*data;
+	size_t		i, size;
+	uint		hash = 2166136261u;
+
+	if( adr->type6 == NA_IP6 )
+	{
+		data = adr->ip6;
+		size = sizeof( adr->ip6 );
+	}
+	else if( adr->type == NA_IP )
+	{
+		data = adr->ip;
+		size = sizeof( adr->ip );
+	}
+	else return 0; // loopback
+
+	for( i = 0; i < size; i++ )
+		hash = ( hash ^ data[i] ) * 16777619u;
+
+	return hash ^ ( hash >> 16 );
+}
+
+/*
+=================
+SV_ClearClientHash
+=================
+*/
+void SV_ClearClientHash( void )
+{
+	memset( sv_clienthash.head, 0, sizeof( sv_clienthash.head ));
+	memset( sv_clienthash.next, 0, sizeof( sv_clienthash.next ));
+	memset( sv_clienthash.bucket, -1, sizeof( sv_clienthash.bucket ));
+}
+
+/*
+=================
+SV_UnhashClient
+=================
+*/
+static void SV_UnhashClient( int index )
+{
+	byte	*link;
+	int	bucket = sv_clienthash.bucket[index];
+
+	if( bucket < 0 )
+		return;
+
+	for( link = &sv_clienthash.head[bucket]; *link; link = &sv_clienthash.next[*link - 1] )
+	{
+		if( *link == index + 1 )
+		{
+			*link = sv_clienthash.next[index];
+			break;
+		}
+	}
+
+	sv_clienthash.next[index] = 0;
+	sv_clienthash.bucket[index] = -1;
+}
+
+/*
+=================
+SV_HashClient
+
+must be called after client netchan address is set
+=================
+*/
+void SV_HashClient( sv_client_t *cl )
+{
+	int	index = cl - svs.clients;
+	int	bucket = SV_AddressHashKey( &cl->netchan.remote_address ) & ( CLIENT_HASHSIZE - 1 );
+
+	SV_UnhashClient( index );
+
+	sv_clienthash.next[index] = sv_clienthash.head[bucket];
+	sv_clienthash.head[bucket] = index + 1;
+	sv_clienthash.bucket[index] = bucket;
+}
+
+/*
+=================
+SV_ClientForAddress
+
+finds client that owns sequenced packet, qport -1 matches any client from this address.
+stale links of freed or reused slots are skipped
+=================
+*/
+static sv_client_t *SV_ClientForAddress( netadr_t from, int qport )
+{
+	int	bucket = SV_AddressHashKey( &from ) & ( CLIENT_HASHSIZE - 1 );
+	int	i;
+
+	for( i = sv_clienthash.head[bucket]; i; i = sv_clienthash.next[i - 1] )
+	{
+		sv_client_t	*cl = &svs.clients[i - 1];
+
+		if( i > svs.maxclients )
+			continue;
+
+		if( cl->state == cs_free || FBitSet( cl->flags, FCL_FAKECLIENT ))
+			continue;
+
+		if( !NET_CompareBaseAdr( from, cl->netchan.remote_address ))
+			continue;
+
+		if( qport != -1 && cl->netchan.qport != qport )
+			continue;
+
+		return cl;
+	}
+
+	return NULL;
+}
+
+/*
+=================
+SV_CheckSourceRate
+
+token bucket for addresses without connected client,
+returns false if packet must be dropped
+=================
+*/
+static qboolean SV_CheckSourceRate( netadr_t from )
+{
+	sv_source_t	*src;
+
+	if( sv_oobrate.value <= 0.0f || from.type == NA_LOOPBACK )
+		return true;
+
+	src = &sv_sources[SV_AddressHashKey( &from ) & ( SOURCE_HASHSIZE - 1 )];
+
+	// new or evicted address starts with full bucket
+	if( !NET_CompareBaseAdr( from, src->adr ) || src->time > host.realtime )
+	{
+		src->adr = from;
+		src->tokens = Q_max( sv_oobburst.value, 1.0f );
+		src->time = host.realtime;
+	}
+
+	src->tokens += ( host.realtime - src->time ) * sv_oobrate.value;
+	src->tokens = Q_min( src->tokens, Q_max( sv_oobburst.value, 1.0f ));
+	src->time = host.realtime;
+
+	if( src->tokens < 1.0f )
+		return false;
+
+	src->tokens -= 1.0f;
+	return true;
+}
+
 /*
 =================
 SV_ReadPackets
@@ -459,16 +647,21 @@ SV_ReadPackets
 static void SV_ReadPackets( void )
 {
 	sv_client_t	*cl;
-	int		i, qport;
+	int		qport;
 	size_t		curSize;
+	byte		*packet;
 
-	while( NET_GetPacket( NS_SERVER, &net_from, net_message_buffer, &curSize ))
+	// packet may point straight into the receive ring, it's valid until next NET_GetPacketEx
+	while( NET_GetPacketEx( NS_SERVER, &net_from, net_message_buffer, &packet, &curSize ))
 	{
-		MSG_Init( &net_message, "ClientPacket", net_message_buffer, curSize );
+		MSG_Init( &net_message, "ClientPacket", packet, curSize );
 
 		// check for connectionless packet (0xffffffff) first
 		if( MSG_GetMaxBytes( &net_message ) >= 4 && *(int *)net_message.pData == -1 )
 		{
+			if( svs.initialized && !SV_ClientForAddress( net_from, -1 ) && !SV_CheckSourceRate( net_from ))
+				continue;
+
 			if( !svs.initialized )
 			{
 				char	*args;
@@ -497,24 +690,38 @@ static void SV_ReadPackets( void )
 		qport = (int)MSG_ReadShort( &net_message ) & 0xffff;
 
 		// check for packets from connected clients
-		for( i = 0, sv.current_client = svs.clients; i < svs.maxclients; i++, sv.current_client++ )
+		if(( cl = SV_ClientForAddress( net_from, qport )) == NULL )
 		{
-			cl = sv.current_client;
+			SV_CheckSourceRate( net_from ); // garbage, charge the sender
+			continue;
+		}
 
-			if( cl->state == cs_free || FBitSet( cl->flags, FCL_FAKECLIENT ))
-				continue;
+		sv.current_client = cl;
 
-			if( !NET_CompareBaseAdr( net_from, cl->netchan.remote_address ))
-				continue;
+		if( cl->netchan.remote_address.port != net_from.port )
+			cl->netchan.remote_address.port = net_from.port;
 
-			if( cl->netchan.qport != qport )
-				continue;
+		if( Netchan_Process( &cl->netchan, &net_message ))
+		{
+			if(( svs.maxclients == 1 && !host_limitlocal.value ) || ( cl->state != cs_spawned ))
+				SetBits( cl->flags, FCL_SEND_NET_MESSAGE ); // reply at end of frame
 
-			if( cl->netchan.remote_address.port != net_from.port )
-				cl->netchan.remote_address.port = net_from.port;
+			// this is a valid, sequenced packet, so process it
+			if( cl->frames != NULL && cl->state != cs_zombie )
+			{
+				SV_ExecuteClientMessage( cl, &net_message );
+				svgame.globals->frametime = sv.frametime;
+				svgame.globals->time = sv.time;
+			}
+		}
 
-			if( Netchan_Process( &cl->netchan, &net_message ))
+		// fragmentation/reassembly sending takes priority over all game messages, want this in the future?
+		if( Netchan_IncomingReady( &cl->netchan ))
+		{
+			if( Netchan_CopyNormalFragments( &cl->netchan, &net_message, &curSize ))
 			{
+				MSG_Init( &net_message, "ClientPacket", net_message_buffer, curSize );
+
 				if(( svs.maxclients == 1 && !host_limitlocal.value ) || ( cl->state != cs_spawned ))
 					SetBits( cl->flags, FCL_SEND_NET_MESSAGE ); // reply at end of frame
 
@@ -527,35 +734,11 @@ static void SV_ReadPackets( void )
 				}
 			}
 
-			// fragmentation/reassembly sending takes priority over all game messages, want this in the future?
-			if( Netchan_IncomingReady( &cl->netchan ))
+			if( Netchan_CopyFileFragments( &cl->netchan, &net_message ))
 			{
-				if( Netchan_CopyNormalFragments( &cl->netchan, &net_message, &curSize ))
-				{
-					MSG_Init( &net_message, "ClientPacket", net_message_buffer, curSize );
-
-					if(( svs.maxclients == 1 && !host_limitlocal.value ) || ( cl->state != cs_spawned ))
-						SetBits( cl->flags, FCL_SEND_NET_MESSAGE ); // reply at end of frame
-
-					// this is a valid, sequenced packet, so process it
-					if( cl->frames != NULL && cl->state != cs_zombie )
-					{
-						SV_ExecuteClientMessage( cl, &net_message );
-						svgame.globals->frametime = sv.frametime;
-						svgame.globals->time = sv.time;
-					}
-				}
-
-				if( Netchan_CopyFileFragments( &cl->netchan, &net_message ))
-				{
-					SV_ProcessFile( cl, cl->netchan.incomingfilename );
-				}
+				SV_ProcessFile( cl, cl->netchan.incomingfilename );
 			}
-			break;
 		}
-
-		if( i != svs.maxclients )
-			continue;
 	}
 
 	sv.current_client = NULL;
@@ -598,6 +781,7 @@ static void SV_CheckTimeouts( void )
 		if( cl->state == cs_zombie )
 		{
 			cl->state = cs_free; // can now be reused
+			SV_UnhashClient( cl - svs.clients );
 			continue;
 		}
 
@@ -608,6 +792,7 @@ static void SV_CheckTimeouts( void )
 				SV_BroadcastPrintf( NULL, "%s timed out\n", cl->name );
 				SV_DropClient( cl, false );
 				cl->state = cs_free; // don't bother with zombie state
+				SV_UnhashClient( cl - svs.clients );
 			}
 		}
 	}
@@ -751,11 +936,11 @@ static void SV_UpdateStatusLine( void )
 
 /*
 ==================
-Host_ServerFrame
+SV_Frame
 
 ==================
 */
-void Host_ServerFrame( void )
+static void SV_Frame( void )
 {
 	// update dedicated server status line in console
 	SV_UpdateStatusLine ();
@@ -798,6 +983,23 @@ void Host_ServerFrame( void )
 	NET_MasterHeartbeat ();
 }
 
+/*
+==================
+Host_ServerFrame
+
+==================
+*/
+void Host_ServerFrame( void )
+{
+	SV_Frame ();
+
+	// send datagrams that were batched during the frame
+	NET_FlushSendQueue( NS_SERVER );
+
+	// compress downloads in background
+	Netchan_PrecompressFrame();
+}
+
 /*
 ==================
 Host_SetServerState
@@ -1010,6 +1212,7 @@ void SV_Init( void )
 	Cvar_RegisterVariable( &sv_maxunlag );
 	Cvar_RegisterVariable( &sv_unlagpush );
 	Cvar_RegisterVariable( &sv_unlagsamples );
+	Cvar_RegisterVariable( &sv_unlaghistory );
 	Cvar_RegisterVariable( &sv_allow_upload );
 	Cvar_RegisterVariable( &sv_allow_download );
 	Cvar_RegisterVariable( &sv_allow_dlfile );
@@ -1053,6 +1256,13 @@ void SV_Init( void )
 	Cvar_RegisterVariable( &sv_enttools_maxfire );
 
 	Cvar_RegisterVariable( &sv_speedhack_kick );
+	Cvar_RegisterVariable( &sv_sendthreads );
+	Cvar_RegisterVariable( &sv_deltaplans );
+	Cvar_RegisterVariable( &sv_baselinesearch );
+	Cvar_RegisterVariable( &sv_deltacache );
+	Cvar_RegisterVariable( &sv_oobrate );
+	Cvar_RegisterVariable( &sv_oobburst );
+	Cvar_RegisterVariable( &sv_fastfind );
 
 	Cvar_RegisterVariable( &sv_allow_joystick );
 	Cvar_RegisterVariable( &sv_allow_mouse );
@@ -1134,6 +1344,9 @@ void SV_FinalMessage( const char *message, qboolean reconnect )
 	for( i = 0, cl = svs.clients; i < svs.maxclients; i++, cl++ )
 		if( cl->state >= cs_connected && !FBitSet( cl->flags, FCL_FAKECLIENT ))
 			Netchan_TransmitBits( &cl->netchan, MSG_GetNumBitsWritten( &msg ), MSG_GetData( &msg ));
+
+	// don't wait for the end of the frame
+	NET_FlushSendQueue( NS_SERVER );
 }
 
 /*
@@ -1210,6 +1423,8 @@ void SV_Shutdown( const char *finalmsg )
 	memset( &sv, 0, sizeof( sv ));
 
 	SV_FreeClients();
+	SV_ShutdownSendWorkers();
+	SV_FreeDeltaCache();
 	svs.maxclients = 0;
 
 	// release all models
@@ -21,6 +21,19 @@ GNU General Public License for more details.
 #include "studio.h"
 
 static qboolean has_update = false;
+static int lagframe; // bumped each time the lag history is written
+
+// rewound positions are the same for every command
+// in a client packet, so they are only computed once
+static struct
+{
+	sv_client_t	*cl;
+	double		target;
+	int		frame;
+	int		count;
+	int		index[MAX_CLIENTS];
+	vec3_t		origin[MAX_CLIENTS];
+} unlagcache;
 static void SV_GetTrueOrigin( sv_client_t *cl, int edictnum, vec3_t origin );
 
 qboolean SV_PlayerIsFrozen( edict_t *pClient )
@@ -706,6 +719,189 @@ static qboolean SV_UnlagCheckTeleport( vec3_t old_pos, vec3_t new_pos )
 	return false;
 }
 
+/*
+===========
+SV_RecordLagHistory
+
+store every player's position each server frame. The newest
+record follows the frames and is only kept once it's
+SV_LAGRECORD_INTERVAL past the previous one, so the ring spans
+the same time whatever the server framerate is
+===========
+*/
+void SV_RecordLagHistory( void )
+{
+	sv_lagrecord_t	*rec, *prev;
+	sv_client_t	*check;
+	edict_t		*ent;
+	int		i;
+
+	lagframe++;
+
+	if( svs.maxclients <= 1 )
+		return;
+
+	for( i = 0, check = svs.clients; i < svs.maxclients; i++, check++ )
+	{
+		// don't keep stale records around while disabled
+		if( check->state != cs_spawned || !sv_unlaghistory.value )
+		{
+			check->numlagrecords = 0;
+			continue;
+		}
+
+		ent = check->edict;
+		rec = check->numlagrecords ? &check->lagrecords[(check->numlagrecords - 1) & SV_LAGRECORD_MASK] : NULL;
+		prev = check->numlagrecords > 1 ? &check->lagrecords[(check->numlagrecords - 2) & SV_LAGRECORD_MASK] : NULL;
+
+		// keep the newest record if it's far enough from the previous one
+		// or it's the first, otherwise move it to this frame
+		if( !rec || ( rec->time != host.realtime && ( !prev || rec->time - prev->time >= SV_LAGRECORD_INTERVAL )))
+		{
+			prev = rec;
+			rec = &check->lagrecords[check->numlagrecords++ & SV_LAGRECORD_MASK];
+		}
+
+		rec->time = host.realtime;
+		VectorCopy( ent->v.origin, rec->origin );
+		rec->nointerp = ( ent->v.health <= 0 || FBitSet( ent->v.effects, EF_NOINTERP ));
+
+		if( rec->nointerp )
+			check->lagnointerp = rec->time;
+
+		if( prev && SV_UnlagCheckTeleport( prev->origin, rec->origin ))
+			check->lagteleport = rec->time;
+	}
+}
+
+/*
+===========
+SV_FindLagRecord
+
+newest record that isn't newer than time
+===========
+*/
+static const sv_lagrecord_t *SV_FindLagRecord( const sv_client_t *check, double time, const sv_lagrecord_t **next )
+{
+	int	lo, hi, mid;
+
+	*next = NULL;
+
+	if( !check->numlagrecords )
+		return NULL;
+
+	hi = check->numlagrecords - 1;
+	lo = Q_max( 0, check->numlagrecords - SV_LAGRECORD_BACKUP );
+
+	// history doesn't reach back that far
+	if( check->lagrecords[lo & SV_LAGRECORD_MASK].time > time )
+		return NULL;
+
+	while( lo < hi )
+	{
+		mid = ( lo + hi + 1 ) >> 1;
+
+		if( check->lagrecords[mid & SV_LAGRECORD_MASK].time <= time )
+			lo = mid;
+		else hi = mid - 1;
+	}
+
+	if( lo + 1 < check->numlagrecords )
+		*next = &check->lagrecords[(lo + 1) & SV_LAGRECORD_MASK];
+
+	return &check->lagrecords[lo & SV_LAGRECORD_MASK];
+}
+
+/*
+===========
+SV_ComputeLagPositions
+
+fill the cache with every player position at finalpush,
+same rules as the client frame walk below
+===========
+*/
+static void SV_ComputeLagPositions( sv_client_t *cl, double finalpush )
+{
+	const sv_lagrecord_t	*rec, *next;
+	sv_client_t		*check;
+	float			lerpFrac;
+	vec3_t			delta;
+	int			i;
+
+	unlagcache.cl = cl;
+	unlagcache.target = finalpush;
+	unlagcache.frame = lagframe;
+	unlagcache.count = 0;
+
+	for( i = 0, check = svs.clients; i < svs.maxclients; i++, check++ )
+	{
+		if( check->state != cs_spawned || check == cl )
+			continue;
+
+		rec = SV_FindLagRecord( check, finalpush, &next );
+
+		if( !rec || finalpush - rec->time > 1.0f )
+			continue;
+
+		// died or teleported since then
+		if( check->lagnointerp >= rec->time || check->lagteleport > rec->time )
+			continue;
+
+		if( !next || next->time == rec->time )
+		{
+			VectorCopy( rec->origin, unlagcache.origin[unlagcache.count] );
+		}
+		else
+		{
+			lerpFrac = ( finalpush - rec->time ) / ( next->time - rec->time );
+			lerpFrac = bound( 0.0f, lerpFrac, 1.0f );
+
+			VectorSubtract( next->origin, rec->origin, delta );
+			VectorMA( rec->origin, lerpFrac, delta, unlagcache.origin[unlagcache.count] );
+		}
+
+		unlagcache.index[unlagcache.count++] = i;
+	}
+}
+
+/*
+===========
+SV_SetupMoveHistory
+
+move players to where cl saw them, from the lag history
+===========
+*/
+static void SV_SetupMoveHistory( sv_client_t *cl, double finalpush )
+{
+	sv_client_t	*check;
+	sv_interp_t	*lerp;
+	float		*curpos;
+	int		i;
+
+	if( unlagcache.cl != cl || unlagcache.frame != lagframe || unlagcache.target != finalpush )
+		SV_ComputeLagPositions( cl, finalpush );
+
+	for( i = 0; i < unlagcache.count; i++ )
+	{
+		check = &svs.clients[unlagcache.index[i]];
+		lerp = &svgame.interp[unlagcache.index[i]];
+		curpos = unlagcache.origin[i];
+
+		if( !lerp->active )
+			continue;
+
+		VectorCopy( curpos, lerp->curpos );
+		VectorCopy( curpos, lerp->newpos );
+
+		if( !VectorCompare( curpos, check->edict->v.origin ))
+		{
+			VectorCopy( curpos, check->edict->v.origin );
+			SV_LinkEdict( check->edict, false );
+			lerp->moving = true;
+		}
+	}
+}
+
 static void SV_SetupMoveInterpolant( sv_client_t *cl )
 {
 	int		i, j, clientnum;
@@ -756,6 +952,12 @@ static void SV_SetupMoveInterpolant( sv_client_t *cl )
 	finalpush = ( host.realtime - latency - lerp_msec ) + sv_unlagpush.value;
 	if( finalpush > host.realtime ) finalpush = host.realtime; // pushed too much ?
 
+	if( sv_unlaghistory.value )
+	{
+		SV_SetupMoveHistory( cl, finalpush );
+		return;
+	}
+
 	frame = frame2 = NULL;
 
 	for( i = 0; i < SV_UPDATE_BACKUP; i++, frame2 = frame )
@@ -371,6 +371,14 @@ static int	iTouchLinkSemaphore = 0;	// prevent recursion when SV_TouchLinks is a
 areanode_t	sv_areanodes[AREA_NODES];
 static int	sv_numareanodes;
 
+// areanode_t is shared with physic interface, so non-solid entities
+// are kept in engine-side lists to make them visible for SV_AreaEdicts.
+// entities that are not linked at all wait in the loose list
+static link_t	sv_nonsolid_edicts[AREA_NODES];
+static link_t	sv_loose_edicts;
+static link_t	sv_nonsolid_links[MAX_EDICTS];
+static uint	sv_areagen;	// bumped on every link change
+
 /*
 ===============
 SV_CreateAreaNode
@@ -385,6 +393,7 @@ static areanode_t *SV_CreateAreaNode( int depth, vec3_t mins, vec3_t maxs )
 	vec3_t		mins1, maxs1;
 	vec3_t		mins2, maxs2;
 
+	ClearLink( &sv_nonsolid_edicts[sv_numareanodes] );
 	anode = &sv_areanodes[sv_numareanodes++];
 
 	ClearLink( &anode->trigger_edicts );
@@ -436,10 +445,22 @@ void SV_ClearWorld( void )
 	}
 
 	memset( sv_areanodes, 0, sizeof( sv_areanodes ));
+	memset( sv_nonsolid_links, 0, sizeof( sv_nonsolid_links ));
+	ClearLink( &sv_loose_edicts );
 	iTouchLinkSemaphore = 0;
 	sv_numareanodes = 0;
+	sv_areagen++;
 
 	SV_CreateAreaNode( 0, sv.worldmodel->mins, sv.worldmodel->maxs );
+
+	// edicts kept from the previous level (clients) are linked nowhere now
+	for( i = 1; i < svgame.numEntities; i++ )
+	{
+		edict_t	*ent = svgame.edicts + i;
+
+		ent->area.prev = ent->area.next = NULL;
+		SV_UnlinkEdict( ent );
+	}
 }
 
 /*
@@ -449,12 +470,135 @@ SV_UnlinkEdict
 */
 void SV_UnlinkEdict( edict_t *ent )
 {
-	// not linked in anywhere
-	if( !ent->area.prev ) return;
+	link_t	*l = &sv_nonsolid_links[NUM_FOR_EDICT( ent )];
+
+	if( l->prev )
+	{
+		RemoveLink( l );
+		l->prev = l->next = NULL;
+	}
+
+	if( ent->area.prev )
+	{
+		RemoveLink( &ent->area );
+		ent->area.prev = NULL;
+		ent->area.next = NULL;
+	}
+
+	// still in use, keep it visible for SV_AreaEdicts
+	if( !ent->free && ent != svgame.edicts && sv_loose_edicts.next )
+		InsertLinkBefore( l, &sv_loose_edicts );
+	sv_areagen++;
+}
+
+/*
+===============
+SV_AreaNodeForBox
+
+find the first node that the box crosses
+===============
+*/
+static int SV_AreaNodeForBox( const vec3_t absmin, const vec3_t absmax )
+{
+	areanode_t	*node = sv_areanodes;
+
+	while( 1 )
+	{
+		if( node->axis == -1 ) break;
+		if( absmin[node->axis] > node->dist )
+			node = node->children[0];
+		else if( absmax[node->axis] < node->dist )
+			node = node->children[1];
+		else break; // crosses the node
+	}
+
+	return node - sv_areanodes;
+}
+
+/*
+===============
+SV_AreaEdictsList
+===============
+*/
+static int SV_AreaEdictsList( link_t *head, qboolean nonsolid, const vec3_t mins, const vec3_t maxs, int *list, int count, int maxcount )
+{
+	link_t	*l;
+	edict_t	*ent;
+
+	for( l = head->next; l != head && count < maxcount; l = l->next )
+	{
+		if( nonsolid ) ent = EDICT_NUM( l - sv_nonsolid_links );
+		else ent = EDICT_FROM_AREA( l );
+
+		if( !BoundsIntersect( mins, maxs, ent->v.absmin, ent->v.absmax ))
+			continue;
+
+		list[count++] = NUM_FOR_EDICT( ent );
+	}
+
+	return count;
+}
+
+/*
+===============
+SV_AreaEdicts_r
+===============
+*/
+static int SV_AreaEdicts_r( areanode_t *node, const vec3_t mins, const vec3_t maxs, int *list, int count, int maxcount )
+{
+	count = SV_AreaEdictsList( &node->solid_edicts, false, mins, maxs, list, count, maxcount );
+	count = SV_AreaEdictsList( &node->trigger_edicts, false, mins, maxs, list, count, maxcount );
+	count = SV_AreaEdictsList( &node->portal_edicts, false, mins, maxs, list, count, maxcount );
+	count = SV_AreaEdictsList( &sv_nonsolid_edicts[node - sv_areanodes], true, mins, maxs, list, count, maxcount );
+
+	// recurse down both sides
+	if( node->axis == -1 ) return count;
+
+	if( maxs[node->axis] > node->dist )
+		count = SV_AreaEdicts_r( node->children[0], mins, maxs, list, count, maxcount );
+	if( mins[node->axis] < node->dist )
+		count = SV_AreaEdicts_r( node->children[1], mins, maxs, list, count, maxcount );
+
+	return count;
+}
+
+static int SV_EdictNumbers( const void *a, const void *b )
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+===============
+SV_AreaEdicts
+
+collect numbers of all the entities in use (linked or not)
+which absbox touches the box, sorted in ascending order
+===============
+*/
+int SV_AreaEdicts( const vec3_t mins, const vec3_t maxs, int *list, int maxcount )
+{
+	int	count;
+
+	if( !sv_numareanodes )
+		return 0;
 
-	RemoveLink( &ent->area );
-	ent->area.prev = NULL;
-	ent->area.next = NULL;
+	count = SV_AreaEdicts_r( sv_areanodes, mins, maxs, list, 0, maxcount );
+	count = SV_AreaEdictsList( &sv_loose_edicts, true, mins, maxs, list, count, maxcount );
+	qsort( list, count, sizeof( *list ), SV_EdictNumbers );
+
+	return count;
+}
+
+/*
+===============
+SV_AreaGeneration
+
+changes each time when any entity was linked or unlinked
+===============
+*/
+uint SV_AreaGeneration( void )
+{
+	return sv_areagen;
 }
 
 /*
@@ -595,8 +739,10 @@ void GAME_EXPORT SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
 {
 	areanode_t	*node;
 	int		headnode;
+	int		nodenum;
+	link_t		*loose;
 
-	if( ent->area.prev ) SV_UnlinkEdict( ent );	// unlink from old position
+	SV_UnlinkEdict( ent );	// unlink from old position
 	if( ent == svgame.edicts ) return;		// don't add the world
 	if( !SV_IsValidEdict( ent )) return;		// never add freed ents
 
@@ -627,21 +773,23 @@ void GAME_EXPORT SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
 		}
 	}
 
-	// ignore non-solid bodies
-	if( ent->v.solid == SOLID_NOT && ent->v.skin >= CONTENTS_EMPTY )
-		return;
-
 	// find the first node that the ent's box crosses
-	node = sv_areanodes;
+	nodenum = SV_AreaNodeForBox( ent->v.absmin, ent->v.absmax );
+	node = &sv_areanodes[nodenum];
 
-	while( 1 )
+	// pull it from the loose list
+	loose = &sv_nonsolid_links[NUM_FOR_EDICT( ent )];
+	if( loose->prev )
 	{
-		if( node->axis == -1 ) break;
-		if( ent->v.absmin[node->axis] > node->dist )
-			node = node->children[0];
-		else if( ent->v.absmax[node->axis] < node->dist )
-			node = node->children[1];
-		else break; // crosses the node
+		RemoveLink( loose );
+		loose->prev = loose->next = NULL;
+	}
+
+	// non-solid bodies are only visible for SV_AreaEdicts
+	if( ent->v.solid == SOLID_NOT && ent->v.skin >= CONTENTS_EMPTY )
+	{
+		InsertLinkBefore( loose, &sv_nonsolid_edicts[nodenum] );
+		return;
 	}
 
 	// link it in
@@ -300,6 +300,229 @@ void FS_CreatePath( char *path )
 	}
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+merged case-insensitive index of files in all pak and pk3 archives,
+so lookups don't binary search every archive in search path.
+plain directories and wads are still asked directly: directories can
+change at runtime and wad lump lookups are done by type and short name
+
+=============================================================================
+*/
+#define FS_INDEX_MIN_HASH	1024
+
+typedef struct fs_indexentry_s
+{
+	const char		*name;	// points to archive own directory
+	searchpath_t		*search;
+	int			pack_ind;
+	uint			hash;
+	struct fs_indexentry_s	*next;
+} fs_indexentry_t;
+
+typedef struct fs_indexblock_s
+{
+	searchpath_t		*search;
+	struct fs_indexblock_s	*next;
+	int			numentries;
+	fs_indexentry_t		entries[1]; // flexible
+} fs_indexblock_t;
+
+static struct
+{
+	fs_indexentry_t	**hash;
+	uint		hashsize;
+	uint		numentries;
+	fs_indexblock_t	*blocks;
+
+	uint		hits;	// found in archive by index
+	uint		misses;	// not in any archive
+} fs_index;
+
+static uint FS_HashFileName( const char *name )
+{
+	uint hash = 5381;
+	byte c;
+
+	while(( c = *name++ ))
+		hash = ( hash << 5 ) + hash + (byte)Q_tolower( c );
+
+	return hash;
+}
+
+/*
+================
+FS_ResizeFileIndex
+
+entries with same name must keep their priority order
+================
+*/
+static void FS_ResizeFileIndex( uint hashsize )
+{
+	fs_indexentry_t **hash = (fs_indexentry_t **)Mem_Calloc( fs_mempool, sizeof( *hash ) * hashsize );
+	fs_indexentry_t **tails = (fs_indexentry_t **)Mem_Calloc( fs_mempool, sizeof( *tails ) * hashsize );
+	fs_indexentry_t *e, *next;
+	uint i, j;
+
+	for( i = 0; i < fs_index.hashsize; i++ )
+	{
+		for( e = fs_index.hash[i]; e; e = next )
+		{
+			next = e->next;
+			e->next = NULL;
+			j = e->hash & ( hashsize - 1 );
+
+			if( tails[j] ) tails[j]->next = e;
+			else hash[j] = e;
+			tails[j] = e;
+		}
+	}
+
+	if( fs_index.hash )
+		Mem_Free( fs_index.hash );
+	Mem_Free( tails );
+
+	fs_index.hash = hash;
+	fs_index.hashsize = hashsize;
+}
+
+/*
+================
+FS_IndexSearchPath
+
+search path was just put at the head of chain
+so its files have priority over anything in index
+================
+*/
+static void FS_IndexSearchPath( searchpath_t *search )
+{
+	fs_indexblock_t *block;
+	uint hashsize;
+	int i, count;
+
+	if( !search->pfnFileName )
+		return;
+
+	for( count = 0; search->pfnFileName( search, count ); count++ );
+
+	hashsize = fs_index.hashsize ? fs_index.hashsize : FS_INDEX_MIN_HASH;
+	while( hashsize < ( fs_index.numentries + count ) / 2 )
+		hashsize <<= 1;
+
+	if( hashsize != fs_index.hashsize )
+		FS_ResizeFileIndex( hashsize );
+
+	block = (fs_indexblock_t *)Mem_Calloc( fs_mempool, sizeof( *block ) + sizeof( fs_indexentry_t ) * Q_max( count - 1, 0 ));
+	block->search = search;
+	block->next = fs_index.blocks;
+	fs_index.blocks = block;
+
+	for( i = 0; i < count; i++ )
+	{
+		fs_indexentry_t *e = &block->entries[block->numentries];
+		fs_indexentry_t **head;
+
+		e->name = search->pfnFileName( search, i );
+		e->hash = FS_HashFileName( e->name );
+		e->search = search;
+		e->pack_ind = i;
+		head = &fs_index.hash[e->hash & ( fs_index.hashsize - 1 )];
+
+		// archive may have duplicates, first one wins like in binary search
+		if( *head && (*head)->search == search && (*head)->hash == e->hash && !Q_stricmp( (*head)->name, e->name ))
+			continue;
+
+		e->next = *head;
+		*head = e;
+		block->numentries++;
+	}
+
+	fs_index.numentries += block->numentries;
+	search->indexed = true;
+}
+
+/*
+================
+FS_PruneFileIndex
+
+remove files of the search paths that are going to be closed
+================
+*/
+static void FS_PruneFileIndex( qboolean all )
+{
+	fs_indexblock_t *block, **prevblock;
+	uint i;
+
+	for( i = 0; i < fs_index.hashsize; i++ )
+	{
+		fs_indexentry_t *e, **prev = &fs_index.hash[i];
+
+		while(( e = *prev ))
+		{
+			if( all || !FBitSet( e->search->flags, FS_STATIC_PATH ))
+				*prev = e->next;
+			else prev = &e->next;
+		}
+	}
+
+	prevblock = &fs_index.blocks;
+
+	while(( block = *prevblock ))
+	{
+		if( all || !FBitSet( block->search->flags, FS_STATIC_PATH ))
+		{
+			*prevblock = block->next;
+			fs_index.numentries -= block->numentries;
+			block->search->indexed = false;
+			Mem_Free( block );
+		}
+		else prevblock = &block->next;
+	}
+
+	if( all && fs_index.hash )
+	{
+		Mem_Free( fs_index.hash );
+		fs_index.hash = NULL;
+		fs_index.hashsize = 0;
+	}
+}
+
+/*
+================
+FS_LookupFileIndex
+
+returns the archive with highest priority having this file
+================
+*/
+static fs_indexentry_t *FS_LookupFileIndex( const char *name, qboolean gamedironly )
+{
+	fs_indexentry_t *e;
+	uint hash;
+
+	if( !fs_index.hashsize )
+		return NULL;
+
+	hash = FS_HashFileName( name );
+
+	for( e = fs_index.hash[hash & ( fs_index.hashsize - 1 )]; e; e = e->next )
+	{
+		if( e->hash != hash || Q_stricmp( e->name, name ))
+			continue;
+
+		if( gamedironly && !FBitSet( e->search->flags, FS_GAMEDIRONLY_SEARCH_FLAGS ))
+			continue;
+
+		fs_index.hits++;
+		return e;
+	}
+
+	fs_index.misses++;
+	return NULL;
+}
+
 searchpath_t *FS_AddArchive_Fullpath( const fs_archive_t *archive, const char *file, int flags )
 {
 	searchpath_t *search;
@@ -317,6 +540,7 @@ searchpath_t *FS_AddArchive_Fullpath( const fs_archive_t *archive, const char *f
 
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
+	FS_IndexSearchPath( search );
 
 	// time to add in search list all the wads from this archive
 	if( archive->load_wads && !FBitSet( flags, FS_SKIP_ARCHIVED_WADS ))
@@ -427,6 +651,7 @@ void FS_ClearSearchPath( void )
 {
 	searchpath_t *cur, **prev;
 
+	FS_PruneFileIndex( false );
 	prev = &fs_searchpaths;
 
 	while( true )
@@ -1582,6 +1807,8 @@ void FS_ShutdownStdio( void )
 	}
 
 	FS_ClearSearchPath(); // release all wad files too
+	FS_ShutdownZip();
+	FS_PruneFileIndex( true );
 	Mem_FreePool( &fs_mempool );
 }
 
@@ -1614,6 +1841,8 @@ void FS_Path_f( void )
 
 		Con_Printf( "\n" );
 	}
+
+	Con_Printf( "File index: %u files, %u hits, %u misses\n", fs_index.numentries, fs_index.hits, fs_index.misses );
 }
 
 /*
@@ -1769,6 +1998,26 @@ file_t *FS_OpenHandle( const char *syspath, int handle, fs_offset_t offset, fs_o
 	return file;
 }
 
+/*
+====================
+FS_OpenMemory
+
+file is a view into memory that outlives it, like archive mapping.
+data is NULL for files decoded by stream callbacks
+====================
+*/
+file_t *FS_OpenMemory( const byte *data, fs_offset_t len )
+{
+	file_t *file = (file_t *)Mem_Calloc( fs_mempool, sizeof( file_t ));
+
+	file->handle = -1;
+	file->mapped = data;
+	file->real_length = len;
+	file->ungetc = EOF;
+
+	return file;
+}
+
 #if !defined( S_ISREG )
 #define S_ISREG( m ) ( FBitSet( m, S_IFMT ) == S_IFREG )
 #endif
@@ -1886,6 +2135,7 @@ and the file index in the package if relevant
 */
 searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly )
 {
+	fs_indexentry_t	*indexed = FS_LookupFileIndex( name, gamedironly );
 	searchpath_t	*search;
 
 	// search through the path, one element at a time
@@ -1896,6 +2146,20 @@ searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t
 		if( gamedironly & !FBitSet( search->flags, FS_GAMEDIRONLY_SEARCH_FLAGS ))
 			continue;
 
+		// indexed archives are already checked, but directories
+		// before them in chain still have the priority
+		if( search->indexed )
+		{
+			if( !indexed || indexed->search != search )
+				continue;
+
+			if( fixedname )
+				Q_strncpy( fixedname, indexed->name, len );
+			if( index )
+				*index = indexed->pack_ind;
+			return search;
+		}
+
 		pack_ind = search->pfnFindFile( search, name, fixedname, len );
 		if( pack_ind >= 0 )
 		{
@@ -2051,6 +2315,9 @@ int FS_Close( file_t *file )
 
 	FS_BackupFileName( file, NULL, 0 );
 
+	if( file->pfnCloseStream )
+		file->pfnCloseStream( file );
+
 	if( file->handle >= 0 )
 		if( close( file->handle ))
 			return EOF;
@@ -2117,6 +2384,28 @@ fs_offset_t FS_Write( file_t *file, const void *data, size_t datasize )
 	return result;
 }
 
+/*
+====================
+FS_ReadRaw
+
+read from the current position bypassing the buffer
+====================
+*/
+static fs_offset_t FS_ReadRaw( file_t *file, void *buffer, fs_offset_t count )
+{
+	if( file->pfnReadStream )
+		return file->pfnReadStream( file, file->position, buffer, count );
+
+	if( file->mapped )
+	{
+		memcpy( buffer, file->mapped + file->position, count );
+		return count;
+	}
+
+	lseek( file->handle, file->offset + file->position, SEEK_SET );
+	return read( file->handle, buffer, count );
+}
+
 /*
 ====================
 FS_Read
@@ -2168,8 +2457,7 @@ fs_offset_t FS_Read( file_t *file, void *buffer, size_t buffersize )
 	{
 		if( count > buffersize )
 			count = buffersize;
-		lseek( file->handle, file->offset + file->position, SEEK_SET );
-		nb = read( file->handle, (byte *)buffer + done, count );
+		nb = FS_ReadRaw( file, (byte *)buffer + done, count );
 
 		if( nb > 0 )
 		{
@@ -2183,8 +2471,7 @@ fs_offset_t FS_Read( file_t *file, void *buffer, size_t buffersize )
 	{
 		if( count > sizeof( file->buff ))
 			count = sizeof( file->buff );
-		lseek( file->handle, file->offset + file->position, SEEK_SET );
-		nb = read( file->handle, file->buff, count );
+		nb = FS_ReadRaw( file, file->buff, count );
 
 		if( nb > 0 )
 		{
@@ -2373,7 +2660,8 @@ int FS_Seek( file_t *file, fs_offset_t offset, int whence )
 	// Purge cached data
 	FS_Purge( file );
 
-	if( lseek( file->handle, file->offset + offset, SEEK_SET ) == -1 )
+	// memory and stream files are positioned on read
+	if( !file->mapped && !file->pfnReadStream && lseek( file->handle, file->offset + offset, SEEK_SET ) == -1 )
 		return -1;
 	file->position = offset;
 
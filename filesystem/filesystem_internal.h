@@ -53,6 +53,10 @@ struct file_s
 						// contents buffer
 	fs_offset_t		buff_ind, buff_len;		// buffer current index and length
 	byte		buff[FILE_BUFF_SIZE];	// intermediate buffer
+	const byte	*mapped;			// contents are read from memory instead of handle
+	void		*stream;			// decoder state for compressed files
+	fs_offset_t	(*pfnReadStream)( file_t *file, fs_offset_t pos, void *buffer, fs_offset_t size );
+	void		(*pfnCloseStream)( file_t *file );
 #ifdef XASH_REDUCE_FD
 	const char *backup_path;
 	fs_offset_t backup_position;
@@ -83,6 +87,7 @@ typedef struct searchpath_s
 	string  filename;
 	int     type;
 	int     flags;
+	qboolean indexed; // contents are in global file index
 
 	union
 	{
@@ -104,6 +109,7 @@ typedef struct searchpath_s
 	int     (*pfnFindFile)( struct searchpath_s *search, const char *path, char *fixedname, size_t len );
 	void    (*pfnSearch)( struct searchpath_s *search, stringlist_t *list, const char *pattern, int caseinsensitive );
 	byte   *(*pfnLoadFile)( struct searchpath_s *search, const char *path, int pack_ind, fs_offset_t *filesize );
+	const char *(*pfnFileName)( struct searchpath_s *search, int pack_ind ); // NULL at end, only for archives that never change
 } searchpath_t;
 
 typedef searchpath_t *(*FS_ADDARCHIVE_FULLPATH)( const char *path, int flags );
@@ -211,6 +217,7 @@ file_t  *FS_OpenReadFile( const char *filename, const char *mode, qboolean gamed
 
 int           FS_SysFileTime( const char *filename );
 file_t       *FS_OpenHandle( const char *syspath, int handle, fs_offset_t offset, fs_offset_t len );
+file_t       *FS_OpenMemory( const byte *data, fs_offset_t len );
 file_t       *FS_SysOpen( const char *filepath, const char *mode );
 searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly );
 qboolean FS_FullPathToRelativePath( char *dst, const char *src, size_t size );
@@ -229,6 +236,7 @@ searchpath_t *FS_AddWad_Fullpath( const char *wadfile, int flags );
 // zip.c
 //
 searchpath_t *FS_AddZip_Fullpath( const char *zipfile, int flags );
+void FS_ShutdownZip( void );
 
 //
 // dir.c
@@ -234,6 +234,20 @@ static int FS_FindFile_PAK( searchpath_t *search, const char *path, char *fixedn
 	return -1;
 }
 
+/*
+===========
+FS_FileName_PAK
+
+===========
+*/
+static const char *FS_FileName_PAK( searchpath_t *search, int pack_ind )
+{
+	if( pack_ind < 0 || pack_ind >= search->pack->numfiles )
+		return NULL;
+
+	return search->pack->files[pack_ind].name;
+}
+
 /*
 ===========
 FS_Search_PAK
@@ -357,6 +371,7 @@ searchpath_t *FS_AddPak_Fullpath( const char *pakfile, int flags )
 	search->pfnFileTime = FS_FileTime_PAK;
 	search->pfnFindFile = FS_FindFile_PAK;
 	search->pfnSearch = FS_Search_PAK;
+	search->pfnFileName = FS_FileName_PAK;
 
 	Con_Reportf( "Adding pakfile: %s (%i files)\n", pakfile, pak->numfiles );
 
@@ -26,9 +26,25 @@ GNU General Public License for more details.
 #include "port.h"
 #include "filesystem_internal.h"
 #include "crtlib.h"
+#include "xash3d_mathlib.h"
 #include "common/com_strings.h"
 #include "miniz.h"
 
+// archives are mapped to memory where it's cheap, XASH_REDUCE_FD
+// targets can't afford keeping them open
+#if ( XASH_LINUX || XASH_ANDROID || XASH_APPLE || XASH_FREEBSD || XASH_NETBSD || XASH_OPENBSD ) && !defined( XASH_REDUCE_FD )
+#define ZIP_MMAP 1
+#include <sys/mman.h>
+#endif
+
+#if defined( _MSC_VER )
+#define ZIP_THREAD_LOCAL __declspec( thread )
+#else
+#define ZIP_THREAD_LOCAL __thread
+#endif
+
+#define ZIP_STREAM_BUFF	(16 * 1024)
+
 #define ZIP_HEADER_LF      (('K'<<8)+('P')+(0x03<<16)+(0x04<<24))
 #define ZIP_HEADER_SPANNED ((0x08<<24)+(0x07<<16)+('K'<<8)+'P')
 
@@ -121,14 +137,35 @@ typedef struct zipfile_s
 	uint16_t flags;
 } zipfile_t;
 
+typedef struct zipmap_s
+{
+	const byte	*data;	// whole archive
+	fs_offset_t	length;
+	int		refcount;	// archive and every file opened from the mapping
+} zipmap_t;
+
 struct zip_s
 {
 	int		handle;
 	int		numfiles;
 	time_t		filetime;
 	zipfile_t	*files;
+	zipmap_t		*map;	// NULL if not mapped
 };
 
+typedef struct zipstream_s
+{
+	z_stream		z;
+	const byte	*mapped;	// compressed data in archive mapping
+	zipmap_t		*map;	// keeps mapping alive after archive is closed
+	int		handle;	// or own handle if archive isn't mapped
+	fs_offset_t	offset;
+	fs_offset_t	compressed_size;
+	fs_offset_t	inpos;	// compressed bytes fed to inflate
+	fs_offset_t	outpos;	// decompressed bytes returned
+	byte		inbuf[ZIP_STREAM_BUFF];
+} zipstream_t;
+
 // #define ENABLE_CRC_CHECK // known to be buggy because of possible libpublic crc32 bug, disabled
 
 #ifdef XASH_REDUCE_FD
@@ -150,6 +187,25 @@ static void FS_EnsureOpenZip( zip_t *zip )
 static void FS_EnsureOpenZip( zip_t *zip ) {}
 #endif
 
+/*
+============
+FS_ReleaseMap_ZIP
+
+unmapped when archive and all files
+opened from it are closed
+============
+*/
+static void FS_ReleaseMap_ZIP( zipmap_t *map )
+{
+	if( --map->refcount > 0 )
+		return;
+
+#if ZIP_MMAP
+	munmap( (void *)map->data, map->length );
+#endif
+	Mem_Free( map );
+}
+
 /*
 ============
 FS_CloseZIP
@@ -162,6 +218,9 @@ static void FS_CloseZIP( zip_t *zip )
 
 	FS_EnsureOpenZip( NULL );
 
+	if( zip->map )
+		FS_ReleaseMap_ZIP( zip->map );
+
 	if( zip->handle >= 0 )
 		close( zip->handle );
 
@@ -382,6 +441,22 @@ static zip_t *FS_LoadZip( const char *zipfile, int *error )
 
 	qsort( zip->files, zip->numfiles, sizeof( *zip->files ), FS_SortZip );
 
+#if ZIP_MMAP
+	if( length > 0 )
+	{
+		void *mapping = mmap( NULL, length, PROT_READ, MAP_SHARED, zip->handle, 0 );
+
+		// it's fine to keep reading through the handle
+		if( mapping != MAP_FAILED )
+		{
+			zip->map = (zipmap_t *)Mem_Calloc( fs_mempool, sizeof( *zip->map ));
+			zip->map->data = (const byte *)mapping;
+			zip->map->length = length;
+			zip->map->refcount = 1;
+		}
+	}
+#endif
+
 #ifdef XASH_REDUCE_FD
 	// will reopen when needed
 	close(zip->handle);
@@ -394,6 +469,197 @@ static zip_t *FS_LoadZip( const char *zipfile, int *error )
 	return zip;
 }
 
+/*
+===========
+FS_MappedData_ZIP
+
+returns file data in archive mapping if it's valid
+===========
+*/
+static const byte *FS_MappedData_ZIP( zip_t *zip, zipfile_t *file )
+{
+	fs_offset_t size = file->flags == ZIP_COMPRESSION_NO_COMPRESSION ? file->size : file->compressed_size;
+
+	if( !zip->map || file->offset < 0 || size < 0 || file->offset + size > zip->map->length )
+		return NULL;
+
+	return zip->map->data + file->offset;
+}
+
+static ZIP_THREAD_LOCAL z_stream zip_inflate;
+static ZIP_THREAD_LOCAL qboolean zip_inflate_initialized;
+
+/*
+===========
+FS_InflateContext_ZIP
+
+inflate state is allocated once per thread
+and reset for every loaded file
+===========
+*/
+static z_stream *FS_InflateContext_ZIP( void )
+{
+	if( zip_inflate_initialized )
+	{
+		if( inflateReset( &zip_inflate ) == Z_OK )
+			return &zip_inflate;
+
+		FS_ShutdownZip();
+	}
+
+	memset( &zip_inflate, 0, sizeof( zip_inflate ));
+
+	if( inflateInit2( &zip_inflate, -MAX_WBITS ) != Z_OK )
+	{
+		Con_Printf( S_ERROR "Zip_LoadFile: inflateInit2 failed\n" );
+		return NULL;
+	}
+
+	zip_inflate_initialized = true;
+	return &zip_inflate;
+}
+
+/*
+===========
+FS_ShutdownZip
+
+releases inflate state of calling thread
+===========
+*/
+void FS_ShutdownZip( void )
+{
+	if( !zip_inflate_initialized )
+		return;
+
+	inflateEnd( &zip_inflate );
+	zip_inflate_initialized = false;
+}
+
+/*
+===========
+FS_InflateStream_ZIP
+
+===========
+*/
+static fs_offset_t FS_InflateStream_ZIP( zipstream_t *s, byte *out, fs_offset_t size )
+{
+	fs_offset_t	done;
+	int		zlib_result;
+
+	s->z.next_out = out;
+	s->z.avail_out = size;
+
+	while( s->z.avail_out )
+	{
+		fs_offset_t remaining = s->compressed_size - s->inpos;
+
+		// with all input fed inflate still has to flush its window
+		if( !s->z.avail_in && remaining > 0 )
+		{
+			if( s->mapped )
+			{
+				s->z.next_in = (Bytef *)s->mapped + s->inpos;
+				s->z.avail_in = remaining;
+			}
+			else
+			{
+				fs_size_t c;
+
+				if( lseek( s->handle, s->offset + s->inpos, SEEK_SET ) == -1 )
+					break;
+
+				c = read( s->handle, s->inbuf, Q_min( remaining, (fs_offset_t)sizeof( s->inbuf )));
+				if( c <= 0 )
+					break;
+
+				s->z.next_in = s->inbuf;
+				s->z.avail_in = c;
+			}
+
+			s->inpos += s->z.avail_in;
+		}
+
+		zlib_result = inflate( &s->z, Z_NO_FLUSH );
+
+		if( zlib_result == Z_STREAM_END || ( zlib_result == Z_BUF_ERROR && remaining <= 0 ))
+			break;
+
+		if( zlib_result != Z_OK )
+		{
+			Con_Reportf( S_ERROR "%s: error while file decompressing. Zlib return code %d.\n", __FUNCTION__, zlib_result );
+			break;
+		}
+	}
+
+	done = size - s->z.avail_out;
+	s->outpos += done;
+
+	return done;
+}
+
+/*
+===========
+FS_ReadStream_ZIP
+
+===========
+*/
+static fs_offset_t FS_ReadStream_ZIP( file_t *file, fs_offset_t pos, void *buffer, fs_offset_t size )
+{
+	zipstream_t	*s = (zipstream_t *)file->stream;
+	byte		skip[1024];
+
+	// deflate can't go back, start over
+	if( pos < s->outpos )
+	{
+		inflateReset( &s->z );
+		s->z.avail_in = 0;
+		s->inpos = s->outpos = 0;
+	}
+
+	while( s->outpos < pos )
+	{
+		if( FS_InflateStream_ZIP( s, skip, Q_min( pos - s->outpos, (fs_offset_t)sizeof( skip ))) <= 0 )
+			return 0;
+	}
+
+	return FS_InflateStream_ZIP( s, (byte *)buffer, size );
+}
+
+/*
+===========
+FS_CloseStream_ZIP
+
+===========
+*/
+static void FS_CloseStream_ZIP( file_t *file )
+{
+	zipstream_t *s = (zipstream_t *)file->stream;
+
+	inflateEnd( &s->z );
+
+	if( s->handle >= 0 )
+		close( s->handle );
+
+	if( s->map )
+		FS_ReleaseMap_ZIP( s->map );
+
+	Mem_Free( s );
+	file->stream = NULL;
+}
+
+/*
+===========
+FS_CloseView_ZIP
+
+stored file read straight from mapping
+===========
+*/
+static void FS_CloseView_ZIP( file_t *file )
+{
+	FS_ReleaseMap_ZIP( (zipmap_t *)file->stream );
+	file->stream = NULL;
+}
+
 /*
 ===========
 FS_OpenZipFile
@@ -403,17 +669,59 @@ Open a packed file using its package file descriptor
 */
 static file_t *FS_OpenFile_ZIP( searchpath_t *search, const char *filename, const char *mode, int pack_ind )
 {
-	zipfile_t	*pfile;
-	pfile = &search->zip->files[pack_ind];
+	zipfile_t	*pfile = &search->zip->files[pack_ind];
+	const byte	*mapped = FS_MappedData_ZIP( search->zip, pfile );
+	zipstream_t	*s;
+	file_t		*file;
+
+	if( pfile->flags == ZIP_COMPRESSION_NO_COMPRESSION )
+	{
+		if( mapped )
+		{
+			file = FS_OpenMemory( mapped, pfile->size );
+			file->stream = search->zip->map;
+			file->pfnCloseStream = FS_CloseView_ZIP;
+			search->zip->map->refcount++;
+			return file;
+		}
+
+		return FS_OpenHandle( search->filename, search->zip->handle, pfile->offset, pfile->size );
+	}
 
-	// compressed files handled in Zip_LoadFile
-	if( pfile->flags != ZIP_COMPRESSION_NO_COMPRESSION )
+	if( pfile->flags != ZIP_COMPRESSION_DEFLATED )
+	{
+		Con_Printf( S_ERROR "%s: %s compressed with unknown algorithm\n", __FUNCTION__, pfile->name );
+		return NULL;
+	}
+
+	// compressed files are inflated while they're read
+	s = (zipstream_t *)Mem_Calloc( fs_mempool, sizeof( *s ));
+	s->mapped = mapped;
+	s->handle = mapped ? -1 : open( search->filename, O_RDONLY|O_BINARY );
+	s->offset = pfile->offset;
+	s->compressed_size = pfile->compressed_size;
+
+	if(( !mapped && s->handle < 0 ) || inflateInit2( &s->z, -MAX_WBITS ) != Z_OK )
 	{
 		Con_Printf( S_ERROR "%s: can't open compressed file %s\n", __FUNCTION__, pfile->name );
+		if( s->handle >= 0 )
+			close( s->handle );
+		Mem_Free( s );
 		return NULL;
 	}
 
-	return FS_OpenHandle( search->filename, search->zip->handle, pfile->offset, pfile->size );
+	if( mapped )
+	{
+		s->map = search->zip->map;
+		s->map->refcount++;
+	}
+
+	file = FS_OpenMemory( NULL, pfile->size );
+	file->stream = s;
+	file->pfnReadStream = FS_ReadStream_ZIP;
+	file->pfnCloseStream = FS_CloseStream_ZIP;
+
+	return file;
 }
 
 /*
@@ -425,9 +733,10 @@ FS_LoadZIPFile
 static byte *FS_LoadZIPFile( searchpath_t *search, const char *path, int pack_ind, fs_offset_t *sizeptr )
 {
 	zipfile_t *file;
+	const byte	*mapped;
 	byte		*compressed_buffer = NULL, *decompressed_buffer = NULL;
 	int		zlib_result = 0;
-	z_stream	decompress_stream;
+	z_stream	*decompress_stream;
 	size_t      c;
 #ifdef ENABLE_CRC_CHECK
 	dword		test_crc, final_crc;
@@ -436,125 +745,98 @@ static byte *FS_LoadZIPFile( searchpath_t *search, const char *path, int pack_in
 	if( sizeptr ) *sizeptr = 0;
 
 	file = &search->zip->files[pack_ind];
+	mapped = FS_MappedData_ZIP( search->zip, file );
 
-	FS_EnsureOpenZip( search->zip );
-
-	if( lseek( search->zip->handle, file->offset, SEEK_SET ) == -1 )
+	if( file->flags != ZIP_COMPRESSION_NO_COMPRESSION && file->flags != ZIP_COMPRESSION_DEFLATED )
+	{
+		Con_Reportf( S_ERROR "Zip_LoadFile: %s : file compressed with unknown algorithm.\n", file->name );
 		return NULL;
+	}
 
-	/*if( read( search->zip->handle, &header, sizeof( header ) ) < 0 )
-		return NULL;
+	decompressed_buffer = Mem_Malloc( fs_mempool, file->size + 1 );
+	decompressed_buffer[file->size] = '\0';
 
-	if( header.signature != ZIP_HEADER_LF )
+	// read data unless it's already in memory
+	if( !mapped )
 	{
-		Con_Reportf( S_ERROR "Zip_LoadFile: %s signature error\n", file->name );
-		return NULL;
-	}*/
+		fs_offset_t size = file->flags == ZIP_COMPRESSION_NO_COMPRESSION ? file->size : file->compressed_size;
 
-	if( file->flags == ZIP_COMPRESSION_NO_COMPRESSION )
-	{
-		decompressed_buffer = Mem_Malloc( fs_mempool, file->size + 1 );
-		decompressed_buffer[file->size] = '\0';
+		FS_EnsureOpenZip( search->zip );
 
-		c = read( search->zip->handle, decompressed_buffer, file->size );
-		if( c != file->size )
+		if( lseek( search->zip->handle, file->offset, SEEK_SET ) == -1 )
 		{
-			Con_Reportf( S_ERROR "Zip_LoadFile: %s size doesn't match\n", file->name );
+			Mem_Free( decompressed_buffer );
 			return NULL;
 		}
 
-#ifdef ENABLE_CRC_CHECK
-		CRC32_Init( &test_crc );
-		CRC32_ProcessBuffer( &test_crc, decompressed_buffer, file->size );
+		// stored files are read straight to the output
+		if( file->flags != ZIP_COMPRESSION_NO_COMPRESSION )
+			compressed_buffer = Mem_Malloc( fs_mempool, file->compressed_size + 1 );
 
-		final_crc = CRC32_Final( test_crc );
+		c = read( search->zip->handle, compressed_buffer ? compressed_buffer : decompressed_buffer, size );
+		FS_EnsureOpenZip( NULL );
 
-		if( final_crc != file->crc32 )
+		if( c != size )
 		{
-			Con_Reportf( S_ERROR "Zip_LoadFile: %s file crc32 mismatch\n", file->name );
+			Con_Reportf( S_ERROR "Zip_LoadFile: %s size doesn't match\n", file->name );
+			if( compressed_buffer )
+				Mem_Free( compressed_buffer );
 			Mem_Free( decompressed_buffer );
 			return NULL;
 		}
-#endif // ENABLE_CRC_CHECK
 
-		if( sizeptr ) *sizeptr = file->size;
-
-		FS_EnsureOpenZip( NULL );
-		return decompressed_buffer;
+		mapped = compressed_buffer;
 	}
-	else if( file->flags == ZIP_COMPRESSION_DEFLATED )
+	else if( file->flags == ZIP_COMPRESSION_NO_COMPRESSION )
 	{
-		compressed_buffer = Mem_Malloc( fs_mempool, file->compressed_size + 1 );
-		decompressed_buffer = Mem_Malloc( fs_mempool, file->size + 1 );
-		decompressed_buffer[file->size] = '\0';
-
-		c = read( search->zip->handle, compressed_buffer, file->compressed_size );
-		if( c != file->compressed_size )
-		{
-			Con_Reportf( S_ERROR "Zip_LoadFile: %s compressed size doesn't match\n", file->name );
-			return NULL;
-		}
-
-		memset( &decompress_stream, 0, sizeof( decompress_stream ) );
-
-		decompress_stream.total_in = decompress_stream.avail_in = file->compressed_size;
-		decompress_stream.next_in = (Bytef *)compressed_buffer;
-		decompress_stream.total_out = decompress_stream.avail_out = file->size;
-		decompress_stream.next_out = (Bytef *)decompressed_buffer;
-
-		decompress_stream.zalloc = Z_NULL;
-		decompress_stream.zfree = Z_NULL;
-		decompress_stream.opaque = Z_NULL;
+		memcpy( decompressed_buffer, mapped, file->size );
+	}
 
-		if( inflateInit2( &decompress_stream, -MAX_WBITS ) != Z_OK )
+	if( file->flags == ZIP_COMPRESSION_DEFLATED )
+	{
+		if(( decompress_stream = FS_InflateContext_ZIP( )) == NULL )
 		{
-			Con_Printf( S_ERROR "Zip_LoadFile: inflateInit2 failed\n" );
-			Mem_Free( compressed_buffer );
+			if( compressed_buffer )
+				Mem_Free( compressed_buffer );
 			Mem_Free( decompressed_buffer );
 			return NULL;
 		}
 
-		zlib_result = inflate( &decompress_stream, Z_NO_FLUSH );
-		inflateEnd( &decompress_stream );
-
-		if( zlib_result == Z_OK || zlib_result == Z_STREAM_END )
-		{
-			Mem_Free( compressed_buffer ); // finaly free compressed buffer
-#if ENABLE_CRC_CHECK
-			CRC32_Init( &test_crc );
-			CRC32_ProcessBuffer( &test_crc, decompressed_buffer, file->size );
+		decompress_stream->next_in = (Bytef *)mapped;
+		decompress_stream->avail_in = file->compressed_size;
+		decompress_stream->next_out = (Bytef *)decompressed_buffer;
+		decompress_stream->avail_out = file->size;
 
-			final_crc = CRC32_Final( test_crc );
+		zlib_result = inflate( decompress_stream, Z_FINISH );
 
-			if( final_crc != file->crc32 )
-			{
-				Con_Reportf( S_ERROR "Zip_LoadFile: %s file crc32 mismatch\n", file->name );
-				Mem_Free( decompressed_buffer );
-				return NULL;
-			}
-#endif
-			if( sizeptr ) *sizeptr = file->size;
+		if( compressed_buffer )
+			Mem_Free( compressed_buffer ); // finaly free compressed buffer
 
-			FS_EnsureOpenZip( NULL );
-			return decompressed_buffer;
-		}
-		else
+		if( zlib_result != Z_OK && zlib_result != Z_STREAM_END )
 		{
 			Con_Reportf( S_ERROR "Zip_LoadFile: %s : error while file decompressing. Zlib return code %d.\n", file->name, zlib_result );
-			Mem_Free( compressed_buffer );
 			Mem_Free( decompressed_buffer );
 			return NULL;
 		}
-
 	}
-	else
+
+#ifdef ENABLE_CRC_CHECK
+	CRC32_Init( &test_crc );
+	CRC32_ProcessBuffer( &test_crc, decompressed_buffer, file->size );
+
+	final_crc = CRC32_Final( test_crc );
+
+	if( final_crc != file->crc32 )
 	{
-		Con_Reportf( S_ERROR "Zip_LoadFile: %s : file compressed with unknown algorithm.\n", file->name );
+		Con_Reportf( S_ERROR "Zip_LoadFile: %s file crc32 mismatch\n", file->name );
+		Mem_Free( decompressed_buffer );
 		return NULL;
 	}
+#endif // ENABLE_CRC_CHECK
 
-	FS_EnsureOpenZip( NULL );
-	return NULL;
+	if( sizeptr ) *sizeptr = file->size;
+
+	return decompressed_buffer;
 }
 
 /*
@@ -579,6 +861,20 @@ static void FS_PrintInfo_ZIP( searchpath_t *search, char *dst, size_t size )
 	Q_snprintf( dst, size, "%s (%i files)", search->filename, search->zip->numfiles );
 }
 
+/*
+===========
+FS_FileName_ZIP
+
+===========
+*/
+static const char *FS_FileName_ZIP( searchpath_t *search, int pack_ind )
+{
+	if( pack_ind < 0 || pack_ind >= search->zip->numfiles )
+		return NULL;
+
+	return search->zip->files[pack_ind].name;
+}
+
 /*
 ===========
 FS_FindFile_ZIP
@@ -696,6 +992,7 @@ searchpath_t *FS_AddZip_Fullpath( const char *zipfile, int flags )
 	search->pfnFindFile = FS_FindFile_ZIP;
 	search->pfnSearch = FS_Search_ZIP;
 	search->pfnLoadFile = FS_LoadZIPFile;
+	search->pfnFileName = FS_FileName_ZIP;
 
 	Con_Reportf( "Adding zipfile: %s (%i files)\n", zipfile, zip->numfiles );
 	return search;
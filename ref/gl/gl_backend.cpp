@@ -771,3 +771,43 @@ void SCR_TimeRefresh_f( void )
 	time = (stop - start);
 	gEngfuncs.Con_Printf( "%f seconds (%f fps)\n", time, 128 / time );
 }
+
+/*
+================
+SCR_TimeImdraw_f
+
+timeimdraw [count]
+
+captures one scene and replays its call stream
+================
+*/
+void SCR_TimeImdraw_f( void )
+{
+	int	i, count = 128;
+	double	start, stop;
+	double	time;
+
+	if( ENGINE_GET_PARM( PARM_CONNSTATE ) != ca_active )
+		return;
+
+	if( gEngfuncs.Cmd_Argc() > 1 )
+		count = Q_max( 1, Q_atoi( gEngfuncs.Cmd_Argv( 1 )));
+
+	imdraw::BeginCapture();
+	R_RenderScene();
+	imdraw::EndCapture();
+
+	imdraw::ResetDrawStats();
+	start = gEngfuncs.pfnTime();
+
+	for( i = 0; i < count; i++ )
+		imdraw::ReplayCapture();
+	pglFinish();
+
+	stop = gEngfuncs.pfnTime();
+	time = (stop - start);
+
+	gEngfuncs.Con_Printf( "%u calls, %u draws, %u verts per frame\n", (uint)imdraw::GetCapturedCallCount(),
+		imdraw::GetDrawStats().draw_calls / count, imdraw::GetDrawStats().vertices / count );
+	gEngfuncs.Con_Printf( "%f seconds (%f ms per frame)\n", time, time * 1000.0 / count );
+}
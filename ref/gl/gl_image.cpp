@@ -1150,6 +1150,22 @@ static void GL_CheckTexImageError( gl_texture_t *tex )
 		gEngfuncs.Con_Printf( S_OPENGL_ERROR "%s while uploading %s [%s]\n", GL_ErrorString( err ), tex->name, GL_TargetToString( tex->target ));
 }
 
+/*
+===============
+GL_TextureStorage
+
+declare the whole mip chain before the first upload
+so every level is written only once
+===============
+*/
+static void GL_TextureStorage( gl_texture_t *tex, int mipCount )
+{
+	if( tex->target != GL_TEXTURE_2D || FBitSet( tex->flags, TF_IMG_UPLOADED ))
+		return;
+
+	pglTexStorage2D( tex->target, mipCount, tex->format, tex->width, tex->height );
+}
+
 /*
 ===============
 GL_UploadTexture
@@ -1242,6 +1258,8 @@ static qboolean GL_UploadTexture( gl_texture_t *tex, rgbdata_t *pic )
 		}
 		else if( Q_max( 1, pic->numMips ) > 1 )	// not-compressed DDS
 		{
+			GL_TextureStorage( tex, pic->numMips );
+
 			for( j = 0; j < Q_max( 1, pic->numMips ); j++ )
 			{
 				width = Q_max( 1, ( tex->width >> j ));
@@ -1261,6 +1279,8 @@ static qboolean GL_UploadTexture( gl_texture_t *tex, rgbdata_t *pic )
 		{
 			int mipCount = GL_CalcMipmapCount( tex, ( buf != NULL ));
 
+			GL_TextureStorage( tex, mipCount );
+
 			// NOTE: only single uncompressed textures can be resamples, no mips, no layers, no sides
 			if(( tex->depth == 1 ) && (( pic->width != tex->width ) || ( pic->height != tex->height )))
 				data = GL_ResampleTexture( buf, pic->width, pic->height, tex->width, tex->height, normalMap );
@@ -2305,6 +2325,31 @@ void R_TextureList_f( void )
 	gEngfuncs.Con_Printf( "\n" );
 }
 
+/*
+===============
+R_TextureMemory_f
+===============
+*/
+static void R_TextureMemory_f( void )
+{
+	TextureMemoryStats stats = GetTextureMemoryStats();
+	gl_texture_t	*image;
+	int		i, texCount;
+	size_t		bytes = 0;
+
+	for( i = texCount = 0, image = gl_textures; i < gl_numTextures; i++, image++ )
+	{
+		if( !image->texnum ) continue;
+
+		bytes += image->size;
+		texCount++;
+	}
+
+	gEngfuncs.Con_Printf( "%i textures, %s requested\n", texCount, Q_memprint( bytes ));
+	gEngfuncs.Con_Printf( "%u textures, %u mips, %s resident\n", stats.textures, stats.mips, Q_memprint( stats.bytes ));
+	gEngfuncs.Con_Printf( "%u mip chain reallocations\n", stats.reallocations );
+}
+
 /*
 ===============
 R_InitImages
@@ -2329,6 +2374,7 @@ void R_InitImages( void )
 	R_InitRipples();
 
 	gEngfuncs.Cmd_AddCommand( "texturelist", R_TextureList_f, "display loaded textures list" );
+	gEngfuncs.Cmd_AddCommand( "texturememory", R_TextureMemory_f, "display texture memory totals" );
 }
 
 /*
@@ -2342,6 +2388,7 @@ void R_ShutdownImages( void )
 	int		i;
 
 	gEngfuncs.Cmd_RemoveCommand( "texturelist" );
+	gEngfuncs.Cmd_RemoveCommand( "texturememory" );
 	GL_CleanupAllTextureUnits();
 
 	for( i = 0, tex = gl_textures; i < gl_numTextures; i++, tex++ )
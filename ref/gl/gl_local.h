@@ -312,6 +312,7 @@ void GL_TextureTarget( uint target );
 void GL_Cull( GLenum cull );
 void R_ShowTextures( void );
 void SCR_TimeRefresh_f( void );
+void SCR_TimeImdraw_f( void );
 
 //
 // gl_beams.c
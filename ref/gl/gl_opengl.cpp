@@ -1221,6 +1221,7 @@ static void GL_InitCommands( void )
 
 	gEngfuncs.Cmd_AddCommand( "r_info", R_RenderInfo_f, "display renderer info" );
 	gEngfuncs.Cmd_AddCommand( "timerefresh", SCR_TimeRefresh_f, "turn quickly and print rendering statistcs" );
+	gEngfuncs.Cmd_AddCommand( "timeimdraw", SCR_TimeImdraw_f, "replay a captured scene through imdraw and print timings" );
 }
 
 /*
@@ -1,10 +1,13 @@
 #include "imdraw.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <numeric>
 
 std::optional<skygfx::BackendType> imdraw::BackendType = skygfx::BackendType::OpenGL;
 skygfx::Adapter imdraw::Adapter = skygfx::Adapter::HighPerformance;
 
-//#define USE_SKYGFX_TEXTURE_READING
-
 struct SampledTexture
 {
 	SampledTexture(skygfx::Texture&& _texture) :
@@ -15,24 +18,39 @@ struct SampledTexture
 	skygfx::Texture texture;
 	skygfx::Sampler sampler = skygfx::Sampler::Nearest;
 	skygfx::TextureAddress texaddr = skygfx::TextureAddress::Wrap;
-#ifndef USE_SKYGFX_TEXTURE_READING
-	std::unordered_map<uint32_t, std::vector<uint8_t>> mip_pixels;
-#endif
 	float mipmap_bias = 0.0f;
 };
 
 static glm::vec4 gClearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
 static bool gBegined = false;
 static imdraw::EMatrixMode gMatrixMode = imdraw::EMatrixMode::Projection;
-static std::unordered_map<imdraw::EMatrixMode, glm::mat4> gMatrices;
+static std::array<glm::mat4, 2> gMatrices = { glm::mat4(1.0f), glm::mat4(1.0f) }; // modelview and projection
 
 using TextureId = int;
 
-static std::unordered_map<TextureId, SampledTexture> gTextures;
+constexpr uint32_t MaxTextureUnits = 3;
+
+// indexed by texture id, boxed so batches can keep pointers across growth
+static std::vector<std::unique_ptr<SampledTexture>> gTextures;
 
 static uint32_t mTexturesIndexCount;
 
-static std::unordered_map<uint32_t, TextureId> gCurrentTexture;
+static uint32_t gTextureReallocations = 0;
+
+static std::array<TextureId, MaxTextureUnits> gCurrentTexture = { -1, -1, -1 };
+
+// applied to texcoords on the cpu, the engine only scales detail textures with them
+static std::array<glm::mat4, MaxTextureUnits> gTextureMatrices = { glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f) };
+
+enum StateDirtyBits : uint32_t
+{
+	StateDirtyTexture = 1 << 0,
+	StateDirtyMatrices = 1 << 1,
+	StateDirtyPipeline = 1 << 2, // blend, depth, stencil, bias, cull and alpha test
+	StateDirtyAll = StateDirtyTexture | StateDirtyMatrices | StateDirtyPipeline
+};
+
+static uint32_t gStateDirty = StateDirtyAll;
 
 static skygfx::utils::Scratch::State gState;
 static skygfx::utils::Scratch gScratch;
@@ -57,13 +75,164 @@ static float gAlphaTestThreshold = 0.0f;
 
 static uint32_t gActiveTexture = 0;
 
+struct TextureUnit
+{
+	bool enabled = false;
+	GLint env_mode = GL_MODULATE;
+	GLint rgb_scale = 1;
+};
+
+// only the upper units are looked at, unit 0 is always drawn by the base pass
+static std::array<TextureUnit, MaxTextureUnits> gTextureUnits;
+static std::array<glm::vec2, MaxTextureUnits> gMultiTexCoords = {};
+
 static skygfx::utils::Mesh::Vertex gVertex;
 
+// upper units of the primitive between Begin and End, replayed as extra passes
+static uint32_t gTexturePasses = 0;
+static skygfx::utils::MeshBuilder::Mode gTopology = skygfx::utils::MeshBuilder::Mode::Triangles;
+static std::array<skygfx::utils::Mesh::Vertices, MaxTextureUnits> gTexturePassVertices;
+
+struct ClientArray
+{
+	bool enabled = false;
+	GLint size = 4;
+	GLenum type = GL_FLOAT;
+	GLsizei stride = 0;
+	const uint8_t* pointer = nullptr; // offset into the buffer when buffer != 0
+	GLuint buffer = 0;
+};
+
+static ClientArray gVertexArray;
+static ClientArray gColorArray;
+static std::array<ClientArray, MaxTextureUnits> gTexCoordArrays;
+static uint32_t gClientActiveTexture = 0;
+
+using BufferId = GLuint;
+
+struct BufferStore
+{
+	std::vector<uint8_t> data;
+	GLenum usage = GL_STATIC_DRAW_ARB;
+	uint32_t generation = 0; // bumped on every write so resident meshes notice stale data
+};
+
+static std::unordered_map<BufferId, BufferStore> gBuffers;
+static BufferId gBuffersIndexCount = 1;
+static BufferId gArrayBuffer = 0;
+static BufferId gElementArrayBuffer = 0;
+
+static bool gRecording = false;
+static imdraw::DrawStats gDrawStats;
+
+static std::optional<std::vector<std::function<void()>>> gCapture;
+static std::vector<std::function<void()>> gCapturedFrame;
+
+template <typename F>
+static void Capture(F&& func)
+{
+	if (gCapture.has_value())
+		gCapture->push_back(std::forward<F>(func));
+}
+
+static skygfx::utils::MeshBuilder::Mode GetTopology(GLenum mode)
+{
+	switch (mode)
+	{
+	case GL_POINTS: return skygfx::utils::MeshBuilder::Mode::Points;
+	case GL_LINES: return skygfx::utils::MeshBuilder::Mode::Lines;
+	case GL_LINE_LOOP: return skygfx::utils::MeshBuilder::Mode::LineLoop;
+	case GL_LINE_STRIP: return skygfx::utils::MeshBuilder::Mode::LineStrip;
+	case GL_TRIANGLES: return skygfx::utils::MeshBuilder::Mode::Triangles;
+	case GL_TRIANGLE_STRIP: return skygfx::utils::MeshBuilder::Mode::TriangleStrip;
+	case GL_TRIANGLE_FAN: return skygfx::utils::MeshBuilder::Mode::TriangleFan;
+	case GL_QUADS: return skygfx::utils::MeshBuilder::Mode::Quads;
+//	case GL_QUAD_STRIP: return skygfx::utils::MeshBuilder::Mode::;
+	case GL_POLYGON: return skygfx::utils::MeshBuilder::Mode::Polygon;
+	}
+
+	assert(false);
+	return skygfx::utils::MeshBuilder::Mode::Triangles;
+}
+
+static bool HasTexture(TextureId index)
+{
+	return index >= 0 && (size_t)index < gTextures.size() && gTextures[index] != nullptr;
+}
+
+static SampledTexture& GetTexture(TextureId index)
+{
+	assert(HasTexture(index));
+	return *gTextures[index];
+}
+
+static SampledTexture& GetCurrentTexture()
+{
+	return GetTexture(gCurrentTexture[gActiveTexture]);
+}
+
 void imdraw::Init()
 {
+	if (gRecording)
+		return;
+
 	skygfx::SetAnisotropyLevel(skygfx::AnisotropyLevel::X16);
 }
 
+void imdraw::SetRecording(bool value)
+{
+	assert(!gBegined);
+	gRecording = value;
+}
+
+bool imdraw::IsRecording()
+{
+	return gRecording;
+}
+
+const imdraw::DrawStats& imdraw::GetDrawStats()
+{
+	return gDrawStats;
+}
+
+void imdraw::ResetDrawStats()
+{
+	gDrawStats = {};
+}
+
+void imdraw::BeginCapture()
+{
+	assert(!gBegined);
+	gCapture.emplace();
+}
+
+void imdraw::EndCapture()
+{
+	assert(!gBegined);
+	assert(gCapture.has_value());
+	gCapturedFrame = std::move(gCapture.value());
+	gCapture.reset();
+}
+
+size_t imdraw::GetCapturedCallCount()
+{
+	return gCapturedFrame.size();
+}
+
+void imdraw::ReplayCapture()
+{
+	assert(!gBegined);
+	assert(!gCapture.has_value());
+
+	for (const auto& call : gCapturedFrame)
+	{
+		call();
+	}
+
+	if (!gRecording)
+		gScratch.flush();
+}
+
 void imdraw::pglClearColor(float red, float green, float blue, float alpha)
 {
 	gClearColor = { red, green, blue, alpha };
@@ -71,43 +240,198 @@ void imdraw::pglClearColor(float red, float green, float blue, float alpha)
 
 void imdraw::pglClear(uint32_t mask)
 {
+	if (gRecording)
+		return;
+
 	skygfx::Clear(gClearColor);
 }
 
 static void FillState()
 {
-	const auto& sampled_texture = gTextures.at(gCurrentTexture.at(gActiveTexture));
+	if (gStateDirty & StateDirtyTexture)
+	{
+		// the active unit may be an upper one, the base pass always samples unit 0
+		const auto& sampled_texture = GetTexture(gCurrentTexture[0]);
 
-	gState.texture = (skygfx::Texture*)&sampled_texture.texture;
-	gState.sampler = sampled_texture.sampler;
-	gState.texaddr = sampled_texture.texaddr;
-	gState.mipmap_bias = sampled_texture.mipmap_bias;
+		gState.texture = (skygfx::Texture*)&sampled_texture.texture;
+		gState.sampler = sampled_texture.sampler;
+		gState.texaddr = sampled_texture.texaddr;
+		gState.mipmap_bias = sampled_texture.mipmap_bias;
+	}
 
-	gState.projection_matrix = gMatrices.at(imdraw::EMatrixMode::Projection);
-	gState.view_matrix = gMatrices.at(imdraw::EMatrixMode::ModelView);
+	if (gStateDirty & StateDirtyMatrices)
+	{
+		gState.projection_matrix = gMatrices[(size_t)imdraw::EMatrixMode::Projection];
+		gState.view_matrix = gMatrices[(size_t)imdraw::EMatrixMode::ModelView];
+	}
+
+	if (gStateDirty & StateDirtyPipeline)
+	{
+		gState.blend_mode = gIsBlendEnabled ? std::make_optional(gBlendMode) : std::nullopt;
+		gState.depth_mode = gIsDepthTestEnabled ? std::make_optional(gDepthMode) : std::nullopt;
+		gState.stencil_mode = gStencilEnabled ? std::make_optional(gStencilMode) : std::nullopt;
+		gState.depth_bias = gDepthBiasEnabled ? std::make_optional(gDepthBias) : std::nullopt;
+		gState.cull_mode = gCullEnabled ? gCullMode : skygfx::CullMode::None;
+		gState.alpha_test_threshold = gAlphaTestEnabled ? std::make_optional(gAlphaTestThreshold) : std::nullopt;
+	}
 
-	gState.blend_mode = gIsBlendEnabled ? std::make_optional(gBlendMode) : std::nullopt;
-	gState.depth_mode = gIsDepthTestEnabled ? std::make_optional(gDepthMode) : std::nullopt;
-	gState.stencil_mode = gStencilEnabled ? std::make_optional(gStencilMode) : std::nullopt;
-	gState.depth_bias = gDepthBiasEnabled ? std::make_optional(gDepthBias) : std::nullopt;
-	gState.cull_mode = gCullEnabled ? gCullMode : skygfx::CullMode::None;
-	gState.alpha_test_threshold = gAlphaTestEnabled ? std::make_optional(gAlphaTestThreshold) : std::nullopt;
+	gStateDirty = 0;
+}
+
+static skygfx::BlendMode GetTextureUnitBlendMode(const TextureUnit& unit)
+{
+	switch (unit.env_mode)
+	{
+	case GL_REPLACE: return skygfx::BlendMode(skygfx::Blend::One, skygfx::Blend::Zero);
+	case GL_ADD: return skygfx::BlendMode(skygfx::Blend::One, skygfx::Blend::One);
+	case GL_DECAL: return skygfx::BlendMode(skygfx::Blend::SrcAlpha, skygfx::Blend::InvSrcAlpha);
+	case GL_COMBINE_ARB:
+		// the engine only combines as previous * texture, optionally doubled
+		if (unit.rgb_scale == 2)
+			return skygfx::BlendMode(skygfx::Blend::DstColor, skygfx::Blend::SrcColor);
+		break;
+	}
+
+	return skygfx::BlendMode(skygfx::Blend::DstColor, skygfx::Blend::Zero);
+}
+
+// bit per upper unit that has to be drawn as an extra pass
+static uint32_t GetTexturePasses()
+{
+	uint32_t result = 0;
+
+	for (uint32_t unit = 1; unit < MaxTextureUnits; unit++)
+	{
+		if (!gTextureUnits[unit].enabled)
+			continue;
+
+		if (gRecording ? gCurrentTexture[unit] < 0 : !HasTexture(gCurrentTexture[unit]))
+			continue;
+
+		result |= 1 << unit;
+	}
+
+	return result;
+}
+
+// upper units are emulated by drawing the primitive again with the unit's texture,
+// blended over the previous passes the way its texture environment would combine them
+static skygfx::utils::Scratch::State MakeTexturePassState(uint32_t unit)
+{
+	auto state = gState;
+
+	if (!gRecording)
+	{
+		const auto& sampled_texture = GetTexture(gCurrentTexture[unit]);
+
+		state.texture = (skygfx::Texture*)&sampled_texture.texture;
+		state.sampler = sampled_texture.sampler;
+		state.texaddr = sampled_texture.texaddr;
+		state.mipmap_bias = sampled_texture.mipmap_bias;
+	}
+
+	auto blend_mode = GetTextureUnitBlendMode(gTextureUnits[unit]);
+	blend_mode.color_mask = gBlendMode.color_mask;
+	state.blend_mode = blend_mode;
+
+	if (state.depth_mode.has_value())
+	{
+		// only touch the pixels the base pass has written
+		auto depth_mode = skygfx::DepthMode(skygfx::ComparisonFunc::Equal);
+		depth_mode.write_mask = false;
+		state.depth_mode = depth_mode;
+	}
+
+	state.alpha_test_threshold = std::nullopt;
+	return state;
+}
+
+static glm::vec2 TransformTexCoord(const glm::mat4& matrix, const glm::vec2& texcoord)
+{
+	auto result = matrix * glm::vec4(texcoord.x, texcoord.y, 0.0f, 1.0f);
+	return { result.x, result.y };
 }
 
 static void Begin(skygfx::utils::MeshBuilder::Mode mode)
 {
 	assert(!gBegined);
 	gBegined = true;
+	gDrawStats.draw_calls++;
+	gTexturePasses = GetTexturePasses();
+	gTopology = mode;
+
+	for (uint32_t unit = 1; unit < MaxTextureUnits; unit++)
+	{
+		if (!(gTexturePasses & (1 << unit)))
+			continue;
+
+		gDrawStats.texture_passes++;
+		gTexturePassVertices[unit].clear();
+	}
+
+	if (gRecording)
+		return;
 
 	FillState();
 	gScratch.begin(mode, gState);
 }
 
+static void End()
+{
+	assert(gBegined);
+	gBegined = false;
+
+	if (gRecording)
+		return;
+
+	gScratch.end();
+
+	for (uint32_t unit = 1; unit < MaxTextureUnits; unit++)
+	{
+		if (!(gTexturePasses & (1 << unit)))
+			continue;
+
+		gScratch.begin(gTopology, MakeTexturePassState(unit));
+
+		for (const auto& vertex : gTexturePassVertices[unit])
+		{
+			gScratch.vertex(vertex);
+		}
+
+		gScratch.end();
+	}
+}
+
+static void Vertex()
+{
+	assert(gBegined);
+	gDrawStats.vertices++;
+
+	if (gRecording)
+		return;
+
+	auto base_vertex = gVertex;
+	base_vertex.texcoord = TransformTexCoord(gTextureMatrices[0], gVertex.texcoord);
+	gScratch.vertex(base_vertex);
+
+	for (uint32_t unit = 1; unit < MaxTextureUnits; unit++)
+	{
+		if (!(gTexturePasses & (1 << unit)))
+			continue;
+
+		auto vertex = gVertex;
+		vertex.texcoord = TransformTexCoord(gTextureMatrices[unit], gMultiTexCoords[unit]);
+		vertex.color = { 1.0f, 1.0f, 1.0f, 1.0f };
+		gTexturePassVertices[unit].push_back(vertex);
+	}
+}
+
 //static skygfx::RenderTarget* gTarget;
 
 void imdraw::BeginFrame()
 {
 	assert(!gBegined);
+	ResetDrawStats();
 
 //	gTarget = skygfx::AcquireTransientRenderTarget();
 //	skygfx::SetRenderTarget(*gTarget);
@@ -116,6 +440,10 @@ void imdraw::BeginFrame()
 void imdraw::EndFrame()
 {
 	assert(!gBegined);
+
+	if (gRecording)
+		return;
+
 	gScratch.flush();
 
 //	skygfx::utils::passes::Bloom(gTarget, nullptr, 0.9f);
@@ -165,6 +493,7 @@ static void AlphaFunc(skygfx::ComparisonFunc func, float ref)
 {
 	assert(!gBegined);
 	gAlphaTestThreshold = ref;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 static void BlendFunc(skygfx::Blend sfactor, skygfx::Blend dfactor)
@@ -173,40 +502,58 @@ static void BlendFunc(skygfx::Blend sfactor, skygfx::Blend dfactor)
 	auto prev_color_mask = gBlendMode.color_mask;
 	gBlendMode = skygfx::BlendMode(sfactor, dfactor);
 	gBlendMode.color_mask = prev_color_mask;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglViewport(int32_t x, int32_t y, int32_t width, int32_t height)
 {
+	Capture([=] { pglViewport(x, y, width, height); });
 	assert(!gBegined);
 	gState.viewport = skygfx::Viewport{ { (float)x, (float)y }, { (float)width, (float)height } };
 }
 
 void imdraw::pglMatrixMode(GLenum mode)
 {
-	static const std::unordered_map<GLenum, EMatrixMode> MatrixModeMap = {
-		{ GL_PROJECTION, EMatrixMode::Projection },
-		{ GL_MODELVIEW, EMatrixMode::ModelView },
-		{ GL_TEXTURE, EMatrixMode::Texture },
-	};
-
+	Capture([=] { pglMatrixMode(mode); });
 	assert(!gBegined);
-	gMatrixMode = MatrixModeMap.at(mode);
+
+	if (mode == GL_PROJECTION)
+		gMatrixMode = EMatrixMode::Projection;
+	else if (mode == GL_MODELVIEW)
+		gMatrixMode = EMatrixMode::ModelView;
+	else if (mode == GL_TEXTURE)
+		gMatrixMode = EMatrixMode::Texture;
+	else
+		assert(false);
+}
+
+static glm::mat4& CurrentMatrix()
+{
+	if (gMatrixMode == imdraw::EMatrixMode::Texture)
+		return gTextureMatrices[gActiveTexture];
+
+	gStateDirty |= StateDirtyMatrices;
+	return gMatrices[(size_t)gMatrixMode];
 }
 
 void imdraw::pglLoadMatrixf(const float* m)
 {
+	auto matrix = *(glm::mat4*)m;
+	Capture([=] { pglLoadMatrixf((const float*)&matrix); });
 	assert(!gBegined);
-	gMatrices[gMatrixMode] = *(glm::mat4*)m;
+	CurrentMatrix() = matrix;
 }
 
 void imdraw::pglLoadIdentity()
 {
+	Capture([=] { pglLoadIdentity(); });
 	assert(!gBegined);
-	gMatrices[gMatrixMode] = glm::mat4(1.0f);
+	CurrentMatrix() = glm::mat4(1.0f);
 }
 
 void imdraw::pglOrtho(float left, float right, float bottom, float top, float zNear, float zFar)
 {
+	Capture([=] { pglOrtho(left, right, bottom, top, zNear, zFar); });
 	assert(!gBegined);
 	auto width = right - left;
 	auto height = bottom - top;
@@ -214,14 +561,16 @@ void imdraw::pglOrtho(float left, float right, float bottom, float top, float zN
 		.width = width,
 		.height = height
 	});
-	gMatrices[imdraw::EMatrixMode::Projection] = proj;
-	gMatrices[imdraw::EMatrixMode::ModelView] = view;
+	gMatrices[(size_t)imdraw::EMatrixMode::Projection] = proj;
+	gMatrices[(size_t)imdraw::EMatrixMode::ModelView] = view;
+	gStateDirty |= StateDirtyMatrices;
 }
 
 static void DepthFunc(skygfx::ComparisonFunc func)
 {
 	assert(!gBegined);
 	gDepthMode = func;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglDepthRange(float zNear, float zFar)
@@ -282,6 +631,7 @@ static void CullFace(skygfx::CullMode mode)
 {
 	assert(!gBegined);
 	gCullMode = mode;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglReadPixels(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t format, uint32_t type, void* pixels)
@@ -295,6 +645,7 @@ static void StencilFunc(skygfx::ComparisonFunc func, int32_t ref, uint32_t mask)
 	gStencilMode.func = func;
 	gStencilMode.reference = (uint8_t)ref;
 	gStencilMode.read_mask = (uint8_t)mask;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 static void StencilOp(skygfx::StencilOp fail, skygfx::StencilOp zfail, skygfx::StencilOp zpass)
@@ -303,6 +654,7 @@ static void StencilOp(skygfx::StencilOp fail, skygfx::StencilOp zfail, skygfx::S
 	gStencilMode.fail_op = fail;
 	gStencilMode.depth_fail_op = zfail;
 	gStencilMode.pass_op = zpass;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglPolygonMode(uint32_t face, uint32_t mode)
@@ -312,13 +664,16 @@ void imdraw::pglPolygonMode(uint32_t face, uint32_t mode)
 
 void imdraw::pglPolygonOffset(float factor, float units)
 {
+	Capture([=] { pglPolygonOffset(factor, units); });
 	assert(!gBegined);
 	gDepthBias.factor = factor;
 	gDepthBias.units = units;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglFrontFace(skygfx::FrontFace mode)
 {
+	Capture([=] { pglFrontFace(mode); });
 	assert(!gBegined);
 	gState.front_face = mode;
 }
@@ -341,8 +696,8 @@ const uint8_t* imdraw::pglGetString(uint32_t name)
 	else if (name == GL_EXTENSIONS)
 	{
 		return (uint8_t*)
-		//	"GL_ARB_vertex_buffer_object\n"
-		//	"GL_ARB_multitexture\n"
+			"GL_ARB_vertex_buffer_object\n"
+			"GL_ARB_multitexture\n"
 			"GL_EXT_texture_lod_bias\n"
 			;
 	}
@@ -364,7 +719,7 @@ void imdraw::pglGetIntegerv(uint32_t pname, int32_t* params)
 	}
 	else if (pname == GL_MAX_TEXTURE_UNITS_ARB)
 	{
-		params[0] = 3;
+		params[0] = MaxTextureUnits;
 		return;
 	}
 	assert(false);
@@ -380,7 +735,11 @@ void imdraw::pglTexParameteri(GLenum target, GLenum pname, GLint param)
 	assert(!gBegined);
 	assert(target == GL_TEXTURE_2D);
 
-	auto& sampled_texture = gTextures.at(gCurrentTexture.at(gActiveTexture));
+	if (gRecording)
+		return;
+
+	auto& sampled_texture = GetCurrentTexture();
+	gStateDirty |= StateDirtyTexture;
 
 	if (pname == GL_TEXTURE_MIN_FILTER && (param == GL_NEAREST_MIPMAP_NEAREST || param == GL_NEAREST))
 	{
@@ -422,7 +781,9 @@ void imdraw::pglBindTexture(GLenum target, GLuint texture)
 {
 	assert(!gBegined);
 	assert(target == GL_TEXTURE_2D);
+	Capture([=] { pglBindTexture(target, texture); });
 	gCurrentTexture[gActiveTexture] = texture;
+	gStateDirty |= StateDirtyTexture;
 }
 
 void imdraw::pglGenTextures(GLsizei n, GLuint* textures)
@@ -442,65 +803,141 @@ void imdraw::pglDeleteTextures(GLsizei n, const GLuint* textures)
 	for (int32_t i = 0; i < n; i++)
 	{
 		auto index = textures[i];
-		gTextures.erase(index);
+		if (HasTexture(index))
+			gTextures[index].reset();
+		gStateDirty |= StateDirtyTexture;
 	}
 }
 
 void imdraw::pglTexSubImage2D(uint32_t target, int32_t level, int32_t xoffset, int32_t yoffset, int32_t width, int32_t height, uint32_t format, uint32_t type, const void* pixels)
 {
 	assert(!gBegined);
+
+	if (gRecording)
+		return;
+
+	gScratch.flush();
+	GetCurrentTexture().texture.write(width, height, (void*)pixels, level, xoffset, yoffset);
+}
+
+static size_t GetTextureMemory(const skygfx::Texture& texture)
+{
+	size_t result = 0;
+
+	for (uint32_t i = 0; i < texture.getMipCount(); i++)
+	{
+		auto mip_width = skygfx::GetMipWidth(texture.getWidth(), i);
+		auto mip_height = skygfx::GetMipHeight(texture.getHeight(), i);
+		result += (size_t)mip_width * mip_height * 4;
+	}
+
+	return result;
+}
+
+static void CreateTexture(TextureId index, uint32_t width, uint32_t height, uint32_t mip_count)
+{
+	auto texture = skygfx::Texture(width, height, skygfx::PixelFormat::RGBA8UNorm, mip_count);
+
+	gStateDirty |= StateDirtyTexture;
+
+	if (!HasTexture(index))
+	{
+		if ((size_t)index >= gTextures.size())
+			gTextures.resize(index + 1);
+
+		gTextures[index] = std::make_unique<SampledTexture>(std::move(texture));
+		return;
+	}
+
+	// pending batches may still point at the old texture
 	gScratch.flush();
-	auto index = gCurrentTexture.at(gActiveTexture);
-	gTextures.at(index).texture.write(width, height, (void*)pixels, level, xoffset, yoffset);
+	GetTexture(index).texture = std::move(texture);
+}
+
+void imdraw::pglTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	assert(!gBegined);
+	assert(target == GL_TEXTURE_2D);
+	assert(levels > 0);
+
+	if (gRecording)
+		return;
+
+	auto index = gCurrentTexture[gActiveTexture];
+
+	if (HasTexture(index))
+	{
+		const auto& texture = GetTexture(index).texture;
+
+		if (texture.getWidth() == (uint32_t)width && texture.getHeight() == (uint32_t)height &&
+			texture.getMipCount() == (uint32_t)levels)
+		{
+			return;
+		}
+	}
+
+	CreateTexture(index, width, height, levels);
 }
 
 void imdraw::pglTexImage2D(uint32_t target, int32_t level, int32_t internalformat, int32_t width, int32_t height, int32_t border, uint32_t format, uint32_t type, const void* pixels)
 {
 	assert(!gBegined);
-	auto index = gCurrentTexture.at(gActiveTexture);
 
-	auto _format = skygfx::PixelFormat::RGBA8UNorm;
+	if (gRecording)
+		return;
+
+	auto index = gCurrentTexture[gActiveTexture];
 
-	if (!gTextures.contains(index))
+	if (!HasTexture(index))
 	{
 		assert(level == 0);
-		gTextures.insert({ index, SampledTexture(skygfx::Texture(width, height, _format, level + 1)) });
+		CreateTexture(index, width, height, level + 1);
 	}
 	else
 	{
-		auto& base_sampled_texture = gTextures.at(index);
-		auto& base_texture = base_sampled_texture.texture;
-		if (level >= base_texture.getMipCount())
+		auto& base_texture = GetTexture(index).texture;
+		if ((uint32_t)level >= base_texture.getMipCount())
 		{
+			// the mip chain was not declared with pglTexStorage2D,
+			// grow it by reading the previous levels back from the gpu
 			auto base_width = base_texture.getWidth();
 			auto base_height = base_texture.getHeight();
-			auto new_texture = skygfx::Texture(base_width, base_height, _format, level + 1);
+			auto new_texture = skygfx::Texture(base_width, base_height, skygfx::PixelFormat::RGBA8UNorm, level + 1);
 			for (uint32_t i = 0; i < base_texture.getMipCount(); i++)
 			{
 				auto mip_width = skygfx::GetMipWidth(base_width, i);
 				auto mip_height = skygfx::GetMipHeight(base_height, i);
-#ifndef USE_SKYGFX_TEXTURE_READING
-				const auto& mip_pixels = base_sampled_texture.mip_pixels.at(i);
-#else
 				auto mip_pixels = base_texture.read(i);
-#endif
 				new_texture.write(mip_width, mip_height, (void*)mip_pixels.data(), i);
 			}
+			gScratch.flush();
 			base_texture = std::move(new_texture);
+			gTextureReallocations++;
 		}
 	}
 
 	if (pixels == nullptr)
 		return;
 
-	auto& sampled_texture = gTextures.at(index);
-#ifndef USE_SKYGFX_TEXTURE_READING
-	auto& mip_pixels = sampled_texture.mip_pixels[level];
-	mip_pixels.resize(width * height * 4);
-	memcpy(mip_pixels.data(), pixels, mip_pixels.size());
-#endif
-	sampled_texture.texture.write(width, height, (void*)pixels, level);
+	GetTexture(index).texture.write(width, height, (void*)pixels, level);
+}
+
+imdraw::TextureMemoryStats imdraw::GetTextureMemoryStats()
+{
+	TextureMemoryStats stats;
+
+	for (const auto& sampled_texture : gTextures)
+	{
+		if (sampled_texture == nullptr)
+			continue;
 
+		stats.textures++;
+		stats.mips += sampled_texture->texture.getMipCount();
+		stats.bytes += GetTextureMemory(sampled_texture->texture);
+	}
+
+	stats.reallocations = gTextureReallocations;
+	return stats;
 }
 
 static void ColorMask(bool red, bool green, bool blue, bool alpha)
@@ -510,6 +947,7 @@ static void ColorMask(bool red, bool green, bool blue, bool alpha)
 	gBlendMode.color_mask.green = green;
 	gBlendMode.color_mask.blue = blue;
 	gBlendMode.color_mask.alpha = alpha;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 bool imdraw::IsAlphaTestEnabled()
@@ -520,6 +958,7 @@ bool imdraw::IsAlphaTestEnabled()
 static void SetAlphaTestEnabled(bool value)
 {
 	gAlphaTestEnabled = value;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 static bool IsBlendEnabled()
@@ -530,6 +969,7 @@ static bool IsBlendEnabled()
 static void SetBlendEnabled(bool value)
 {
 	gIsBlendEnabled = value;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 bool imdraw::IsDepthBiasEnabled()
@@ -540,6 +980,7 @@ bool imdraw::IsDepthBiasEnabled()
 static void SetDepthBiasEnabled(bool value)
 {
 	gDepthBiasEnabled = value;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 bool imdraw::IsDepthTestEnabled()
@@ -550,6 +991,7 @@ bool imdraw::IsDepthTestEnabled()
 static void SetDepthTestEnabled(bool value)
 {
 	gIsDepthTestEnabled = value;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 bool imdraw::IsStencilEnabled()
@@ -560,6 +1002,7 @@ bool imdraw::IsStencilEnabled()
 static void SetStencilEnabled(bool value)
 {
 	gStencilEnabled = value;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 bool imdraw::IsCullEnabled()
@@ -570,36 +1013,46 @@ bool imdraw::IsCullEnabled()
 static void SetCullEnabled(bool value)
 {
 	gCullEnabled = value;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglColor4ub(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha)
 {
+	Capture([=] { pglColor4ub(red, green, blue, alpha); });
 	Color4ub(red, green, blue, alpha);
 }
 
 void imdraw::pglColor4ubv(const uint8_t* v)
 {
+	Capture([=, r = v[0], g = v[1], b = v[2], a = v[3]] { pglColor4ub(r, g, b, a); });
 	Color4ubv(v);
 }
 
 void imdraw::pglColor4f(float red, float green, float blue, float alpha)
 {
+	Capture([=] { pglColor4f(red, green, blue, alpha); });
 	Color4f(red, green, blue, alpha);
 }
 
 void imdraw::pglColor3f(float red, float green, float blue)
 {
+	Capture([=] { pglColor3f(red, green, blue); });
 	Color3f(red, green, blue);
 }
 
 void imdraw::pglEnable(uint32_t cap)
 {
+	Capture([=] { pglEnable(cap); });
 	assert(!gBegined);
 
-	if (cap == GL_SCISSOR_TEST || cap == GL_TEXTURE_2D || cap == GL_FOG)
+	if (cap == GL_SCISSOR_TEST || cap == GL_FOG)
 	{
 		/*nothing*/
 	}
+	else if (cap == GL_TEXTURE_2D)
+	{
+		gTextureUnits[gActiveTexture].enabled = true;
+	}
 	else if (cap == GL_BLEND)
 	{
 		SetBlendEnabled(true);
@@ -630,12 +1083,17 @@ void imdraw::pglEnable(uint32_t cap)
 
 void imdraw::pglDisable(uint32_t cap)
 {
+	Capture([=] { pglDisable(cap); });
 	assert(!gBegined);
 
-	if (cap == GL_SCISSOR_TEST || cap == GL_TEXTURE_2D || cap == imdraw::GL_FOG)
+	if (cap == GL_SCISSOR_TEST || cap == imdraw::GL_FOG)
 	{
 		/*nothing*/
 	}
+	else if (cap == GL_TEXTURE_2D)
+	{
+		gTextureUnits[gActiveTexture].enabled = false;
+	}
 	else if (cap == GL_BLEND)
 	{
 		SetBlendEnabled(false);
@@ -664,75 +1122,100 @@ void imdraw::pglDisable(uint32_t cap)
 		assert(false);
 }
 
-void imdraw::pglBlendFunc(uint32_t sfactor, uint32_t dfactor)
+static skygfx::Blend GetBlend(uint32_t factor)
 {
-	const static std::unordered_map<uint32_t, skygfx::Blend> BlendMap = {
-		{ GL_ONE, skygfx::Blend::One },
-		{ GL_ZERO, skygfx::Blend::Zero, },
-		{ GL_SRC_COLOR, skygfx::Blend::SrcColor },
-		{ GL_ONE_MINUS_SRC_COLOR, skygfx::Blend::InvSrcColor },
-		{ GL_SRC_ALPHA, skygfx::Blend::SrcAlpha },
-		{ GL_ONE_MINUS_SRC_ALPHA, skygfx::Blend::InvSrcAlpha },
-		{ GL_DST_COLOR, skygfx::Blend::DstColor },
-		{ GL_ONE_MINUS_DST_COLOR, skygfx::Blend::InvDstColor },
-		{ GL_DST_ALPHA, skygfx::Blend::DstAlpha },
-		{ GL_ONE_MINUS_DST_ALPHA, skygfx::Blend::InvDstAlpha }
-	};
+	switch (factor)
+	{
+	case GL_ONE: return skygfx::Blend::One;
+	case GL_ZERO: return skygfx::Blend::Zero;
+	case GL_SRC_COLOR: return skygfx::Blend::SrcColor;
+	case GL_ONE_MINUS_SRC_COLOR: return skygfx::Blend::InvSrcColor;
+	case GL_SRC_ALPHA: return skygfx::Blend::SrcAlpha;
+	case GL_ONE_MINUS_SRC_ALPHA: return skygfx::Blend::InvSrcAlpha;
+	case GL_DST_COLOR: return skygfx::Blend::DstColor;
+	case GL_ONE_MINUS_DST_COLOR: return skygfx::Blend::InvDstColor;
+	case GL_DST_ALPHA: return skygfx::Blend::DstAlpha;
+	case GL_ONE_MINUS_DST_ALPHA: return skygfx::Blend::InvDstAlpha;
+	}
 
-	auto sf = BlendMap.at(sfactor);
-	auto df = BlendMap.at(dfactor);
+	assert(false);
+	return skygfx::Blend::One;
+}
 
-	BlendFunc(sf, df);
+void imdraw::pglBlendFunc(uint32_t sfactor, uint32_t dfactor)
+{
+	Capture([=] { pglBlendFunc(sfactor, dfactor); });
+	BlendFunc(GetBlend(sfactor), GetBlend(dfactor));
 }
 
-static const std::unordered_map<uint32_t, skygfx::ComparisonFunc> ComparisonFuncMap = {
-	{ GL_ALWAYS, skygfx::ComparisonFunc::Always },
-	{ GL_NEVER, skygfx::ComparisonFunc::Never },
-	{ GL_LESS, skygfx::ComparisonFunc::Less },
-	{ GL_EQUAL, skygfx::ComparisonFunc::Equal },
-	{ GL_NOTEQUAL, skygfx::ComparisonFunc::NotEqual },
-	{ GL_LEQUAL, skygfx::ComparisonFunc::LessEqual },
-	{ GL_GREATER, skygfx::ComparisonFunc::Greater },
-	{ GL_GEQUAL, skygfx::ComparisonFunc::GreaterEqual }
-};
+static skygfx::ComparisonFunc GetComparisonFunc(uint32_t func)
+{
+	switch (func)
+	{
+	case GL_ALWAYS: return skygfx::ComparisonFunc::Always;
+	case GL_NEVER: return skygfx::ComparisonFunc::Never;
+	case GL_LESS: return skygfx::ComparisonFunc::Less;
+	case GL_EQUAL: return skygfx::ComparisonFunc::Equal;
+	case GL_NOTEQUAL: return skygfx::ComparisonFunc::NotEqual;
+	case GL_LEQUAL: return skygfx::ComparisonFunc::LessEqual;
+	case GL_GREATER: return skygfx::ComparisonFunc::Greater;
+	case GL_GEQUAL: return skygfx::ComparisonFunc::GreaterEqual;
+	}
+
+	assert(false);
+	return skygfx::ComparisonFunc::Always;
+}
 
 void imdraw::pglDepthFunc(uint32_t func)
 {
-	DepthFunc(ComparisonFuncMap.at(func));
+	Capture([=] { pglDepthFunc(func); });
+	DepthFunc(GetComparisonFunc(func));
 }
 
 void imdraw::pglAlphaFunc(uint32_t func, float ref)
 {
-	AlphaFunc(ComparisonFuncMap.at(func), ref);
+	Capture([=] { pglAlphaFunc(func, ref); });
+	AlphaFunc(GetComparisonFunc(func), ref);
 }
 
 void imdraw::pglTexEnvf(uint32_t target, uint32_t pname, float param)
 {
-	// nothing
+	pglTexEnvi(target, pname, (int32_t)param);
 }
 
 void imdraw::pglTexEnvi(uint32_t target, uint32_t pname, int32_t param)
 {
-	// nothing
+	Capture([=] { pglTexEnvi(target, pname, param); });
+	assert(!gBegined);
+	assert(target == GL_TEXTURE_ENV);
+
+	// combiner sources and operands are not tracked, see GetTextureUnitBlendMode
+	if (pname == GL_TEXTURE_ENV_MODE)
+		gTextureUnits[gActiveTexture].env_mode = param;
+	else if (pname == GL_RGB_SCALE_ARB)
+		gTextureUnits[gActiveTexture].rgb_scale = param;
 }
 
 void imdraw::pglTranslatef(float x, float y, float z)
 {
+	Capture([=] { pglTranslatef(x, y, z); });
 	assert(!gBegined);
-	gMatrices[gMatrixMode] = glm::translate(gMatrices.at(gMatrixMode), { x, y, z });
+	auto& matrix = CurrentMatrix();
+	matrix = glm::translate(matrix, { x, y, z });
 }
 
 void imdraw::pglScalef(float x, float y, float z)
 {
+	Capture([=] { pglScalef(x, y, z); });
 	assert(!gBegined);
-	gMatrices[gMatrixMode] = glm::scale(gMatrices.at(gMatrixMode), { x, y, z });
+	auto& matrix = CurrentMatrix();
+	matrix = glm::scale(matrix, { x, y, z });
 }
 
 void imdraw::pglEnd()
 {
-	assert(gBegined);
-	gBegined = false;
-	gScratch.end();
+	Capture([=] { pglEnd(); });
+	End();
 }
 
 void imdraw::pglPointSize(float size)
@@ -753,39 +1236,31 @@ void imdraw::pglVertex3fv(const float* v)
 
 void imdraw::pglVertex3f(float x, float y, float z)
 {
+	Capture([=] { pglVertex3f(x, y, z); });
 	assert(gBegined);
 	gVertex.pos = { x, y, z };
-	gScratch.vertex(gVertex);
+	Vertex();
 }
 
 void imdraw::pglTexCoord2f(float s, float t)
 {
+	Capture([=] { pglTexCoord2f(s, t); });
 	assert(gBegined);
 	gVertex.texcoord = { s, t };
 }
 
 void imdraw::pglNormal3fv(const float* v)
 {
+	auto normal = *(glm::vec3*)v;
+	Capture([=] { pglNormal3fv((const float*)&normal); });
 	assert(gBegined);
-	gVertex.normal = *(glm::vec3*)v;
+	gVertex.normal = normal;
 }
 
 void imdraw::pglBegin(uint32_t mode)
 {
-	static const std::unordered_map<uint32_t, skygfx::utils::MeshBuilder::Mode> ModeMap = {
-		{ GL_POINTS, skygfx::utils::MeshBuilder::Mode::Points },
-		{ GL_LINES, skygfx::utils::MeshBuilder::Mode::Lines },
-		{ GL_LINE_LOOP, skygfx::utils::MeshBuilder::Mode::LineLoop },
-		{ GL_LINE_STRIP, skygfx::utils::MeshBuilder::Mode::LineStrip },
-		{ GL_TRIANGLES, skygfx::utils::MeshBuilder::Mode::Triangles },
-		{ GL_TRIANGLE_STRIP, skygfx::utils::MeshBuilder::Mode::TriangleStrip },
-		{ GL_TRIANGLE_FAN, skygfx::utils::MeshBuilder::Mode::TriangleFan },
-		{ GL_QUADS, skygfx::utils::MeshBuilder::Mode::Quads },
-	//	{ GL_QUAD_STRIP, skygfx::utils::MeshBuilder::Mode:: },
-		{ GL_POLYGON, skygfx::utils::MeshBuilder::Mode::Polygon },
-	};
-
-	Begin(ModeMap.at(mode));
+	Capture([=] { pglBegin(mode); });
+	Begin(GetTopology(mode));
 }
 
 void imdraw::pglShadeModel(uint32_t mode)
@@ -796,81 +1271,617 @@ void imdraw::pglShadeModel(uint32_t mode)
 
 void imdraw::pglStencilFunc(uint32_t func, int32_t ref, uint32_t mask)
 {
-	StencilFunc(ComparisonFuncMap.at(func), ref, mask);
+	Capture([=] { pglStencilFunc(func, ref, mask); });
+	StencilFunc(GetComparisonFunc(func), ref, mask);
 }
 
 void imdraw::pglColorMask(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha)
 {
+	Capture([=] { pglColorMask(red, green, blue, alpha); });
 	ColorMask(red, green, blue, alpha);
 }
 
-void imdraw::pglStencilOp(uint32_t fail, uint32_t zfail, uint32_t zpass)
+static skygfx::StencilOp GetStencilOp(uint32_t op)
 {
-	static const std::unordered_map<uint32_t, skygfx::StencilOp> StencilOpMap = {
-		{ GL_KEEP, skygfx::StencilOp::Keep },
-		{ GL_ZERO, skygfx::StencilOp::Zero },
-		{ GL_REPLACE, skygfx::StencilOp::Replace },
-		{ GL_INCR, skygfx::StencilOp::IncrementSaturation },
-		{ GL_DECR, skygfx::StencilOp::DecrementSaturation },
-	//	{ GL_INVERT, skygfx::StencilOp::Invert },
-	//	{ GL_INCR_WRAP, skygfx::StencilOp::Increment },
-	//	{ GL_DECR_WRAP, skygfx::StencilOp::Decrement },
-	};
+	switch (op)
+	{
+	case GL_KEEP: return skygfx::StencilOp::Keep;
+	case GL_ZERO: return skygfx::StencilOp::Zero;
+	case GL_REPLACE: return skygfx::StencilOp::Replace;
+	case GL_INCR: return skygfx::StencilOp::IncrementSaturation;
+	case GL_DECR: return skygfx::StencilOp::DecrementSaturation;
+//	case GL_INVERT: return skygfx::StencilOp::Invert;
+//	case GL_INCR_WRAP: return skygfx::StencilOp::Increment;
+//	case GL_DECR_WRAP: return skygfx::StencilOp::Decrement;
+	}
 
-	StencilOp(StencilOpMap.at(fail), StencilOpMap.at(zfail), StencilOpMap.at(zpass));
+	assert(false);
+	return skygfx::StencilOp::Keep;
+}
+
+void imdraw::pglStencilOp(uint32_t fail, uint32_t zfail, uint32_t zpass)
+{
+	Capture([=] { pglStencilOp(fail, zfail, zpass); });
+	StencilOp(GetStencilOp(fail), GetStencilOp(zfail), GetStencilOp(zpass));
 }
 
 void imdraw::pglStencilMask(uint32_t mask)
 {
+	Capture([=] { pglStencilMask(mask); });
 	assert(!gBegined);
 	gStencilMode.write_mask = (uint8_t)mask;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglDepthMask(bool enabled)
 {
+	Capture([=] { pglDepthMask(enabled); });
 	assert(!gBegined);
 	gDepthMode.write_mask = enabled;
+	gStateDirty |= StateDirtyPipeline;
 }
 
 void imdraw::pglCullFace(GLenum mode)
 {
-	static const std::unordered_map<GLenum, skygfx::CullMode> CullModeMap = {
-		{ GL_NONE, skygfx::CullMode::None },
-		{ GL_BACK, skygfx::CullMode::Back },
-		{ GL_FRONT, skygfx::CullMode::Front },
-	};
+	Capture([=] { pglCullFace(mode); });
 
-	CullFace(CullModeMap.at(mode));
+	if (mode == GL_NONE)
+		CullFace(skygfx::CullMode::None);
+	else if (mode == GL_BACK)
+		CullFace(skygfx::CullMode::Back);
+	else if (mode == GL_FRONT)
+		CullFace(skygfx::CullMode::Front);
+	else
+		assert(false);
 }
 
 void imdraw::pglActiveTextureARB(GLenum value)
 {
+	Capture([=] { pglActiveTextureARB(value); });
 	gActiveTexture = value - GL_TEXTURE0_ARB;
+	assert(gActiveTexture < MaxTextureUnits);
+	gStateDirty |= StateDirtyTexture;
 }
 
 void imdraw::pglClientActiveTextureARB(GLenum value)
+{
+	gClientActiveTexture = value - GL_TEXTURE0_ARB;
+	assert(gClientActiveTexture < MaxTextureUnits);
+}
+
+void imdraw::pglMultiTexCoord2f(GLenum target, GLfloat s, GLfloat t)
+{
+	Capture([=] { pglMultiTexCoord2f(target, s, t); });
+	auto unit = target - GL_TEXTURE0_ARB;
+	assert(unit < MaxTextureUnits);
+
+	// upper units are kept aside for their texture passes
+	if (unit == 0)
+		gVertex.texcoord = { s, t };
+	else
+		gMultiTexCoords[unit] = { s, t };
+}
+
+void imdraw::pglTexGeni(GLenum coord, GLenum pname, GLint param)
 {
 	assert(false);
 }
 
-void imdraw::pglMultiTexCoord2f(GLenum, GLfloat, GLfloat)
+static ClientArray& GetClientArray(GLenum array)
 {
+	if (array == GL_VERTEX_ARRAY)
+		return gVertexArray;
+	else if (array == GL_COLOR_ARRAY)
+		return gColorArray;
+	else if (array == GL_TEXTURE_COORD_ARRAY)
+		return gTexCoordArrays[gClientActiveTexture];
+
 	assert(false);
+	static ClientArray dummy;
+	return dummy;
 }
 
-void imdraw::pglTexGeni(GLenum coord, GLenum pname, GLint param)
+static void ClientArrayPointer(ClientArray& array, GLint size, GLenum type, GLsizei stride, const GLvoid* pointer)
 {
+	assert(!gBegined);
+	array.size = size;
+	array.type = type;
+	array.stride = stride;
+	array.pointer = (const uint8_t*)pointer;
+	array.buffer = gArrayBuffer;
+}
+
+static uint32_t GetTypeSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	case GL_UNSIGNED_INT:
+	case GL_FLOAT:
+		return 4;
+	case GL_DOUBLE:
+		return 8;
+	}
+
 	assert(false);
+	return 0;
 }
 
-void imdraw::pglDisableClientState(GLenum array)
+struct ResolvedArray
+{
+	const uint8_t* data = nullptr;
+	uint32_t stride = 0;
+	GLint size = 0;
+	GLenum type = GL_FLOAT;
+	BufferId buffer = 0;
+	uint32_t generation = 0;
+	uint32_t count = UINT32_MAX; // elements inside the buffer store, unbounded for client memory
+
+	bool operator==(const ResolvedArray&) const = default;
+};
+
+static std::optional<ResolvedArray> ResolveClientArray(const ClientArray& array)
+{
+	if (!array.enabled)
+		return std::nullopt;
+
+	ResolvedArray result;
+	result.data = array.pointer;
+	result.stride = array.stride != 0 ? array.stride : array.size * GetTypeSize(array.type);
+	result.size = array.size;
+	result.type = array.type;
+	result.buffer = array.buffer;
+
+	// pointers captured while a buffer was bound are offsets into that buffer
+	if (array.buffer != 0)
+	{
+		const auto& store = gBuffers.at(array.buffer);
+		auto offset = (size_t)(uintptr_t)array.pointer;
+		auto element_size = (size_t)array.size * GetTypeSize(array.type);
+
+		result.data = store.data.data() + offset;
+		result.generation = store.generation;
+		result.count = offset + element_size <= store.data.size() ?
+			(uint32_t)((store.data.size() - offset - element_size) / result.stride + 1) : 0;
+	}
+
+	return result;
+}
+
+static glm::vec4 FetchClientArray(const ResolvedArray& array, uint32_t index, glm::vec4 value)
+{
+	const auto* src = array.data + (size_t)array.stride * index;
+
+	for (GLint i = 0; i < array.size; i++)
+	{
+		switch (array.type)
+		{
+		case GL_FLOAT:
+			value[i] = ((const float*)src)[i];
+			break;
+		case GL_DOUBLE:
+			value[i] = (float)((const double*)src)[i];
+			break;
+		case GL_UNSIGNED_BYTE:
+			value[i] = float(src[i]) / 255.0f;
+			break;
+		case GL_SHORT:
+			value[i] = (float)((const int16_t*)src)[i];
+			break;
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	return value;
+}
+
+// everything a converted vertex depends on
+struct ArraySource
+{
+	ResolvedArray vertex;
+	std::optional<ResolvedArray> texcoord;
+	std::optional<ResolvedArray> color;
+	glm::vec2 texcoord_value = {}; // used when the array is disabled
+	glm::vec4 color_value = {};
+	glm::vec3 normal = {};
+	glm::mat4 texture_matrix = glm::mat4(1.0f);
+
+	bool operator==(const ArraySource&) const = default;
+};
+
+static std::optional<ArraySource> GetArraySource(uint32_t unit)
+{
+	auto vertex = ResolveClientArray(gVertexArray);
+
+	if (!vertex.has_value())
+		return std::nullopt;
+
+	ArraySource source;
+	source.vertex = vertex.value();
+	source.texcoord = ResolveClientArray(gTexCoordArrays[unit]);
+	source.normal = gVertex.normal;
+	source.texture_matrix = gTextureMatrices[unit];
+
+	if (unit == 0)
+	{
+		source.color = ResolveClientArray(gColorArray);
+		source.texcoord_value = gVertex.texcoord;
+		source.color_value = gVertex.color;
+	}
+	else
+	{
+		// texture passes carry the unit's texture only, the rest comes from blending
+		source.texcoord_value = gMultiTexCoords[unit];
+		source.color_value = { 1.0f, 1.0f, 1.0f, 1.0f };
+	}
+
+	return source;
+}
+
+static skygfx::utils::Mesh::Vertex FetchVertex(const ArraySource& source, uint32_t index)
+{
+	skygfx::utils::Mesh::Vertex vertex;
+
+	auto pos = FetchClientArray(source.vertex, index, { 0.0f, 0.0f, 0.0f, 1.0f });
+	vertex.pos = { pos.x, pos.y, pos.z };
+	vertex.texcoord = source.texcoord_value;
+	vertex.color = source.color_value;
+	vertex.normal = source.normal;
+
+	if (source.texcoord.has_value())
+	{
+		auto texcoord = FetchClientArray(source.texcoord.value(), index, { 0.0f, 0.0f, 0.0f, 1.0f });
+		vertex.texcoord = { texcoord.x, texcoord.y };
+	}
+
+	if (source.color.has_value())
+		vertex.color = FetchClientArray(source.color.value(), index, { 0.0f, 0.0f, 0.0f, 1.0f });
+
+	vertex.texcoord = TransformTexCoord(source.texture_matrix, vertex.texcoord);
+	return vertex;
+}
+
+static bool IsResidentArray(const std::optional<ResolvedArray>& array)
+{
+	return !array.has_value() || (array->buffer != 0 && gBuffers.at(array->buffer).usage == GL_STATIC_DRAW_ARB);
+}
+
+// sources made only of static buffers are converted once and kept on the gpu,
+// a texture matrix changes per draw (detail scale), so those convert their range only
+static bool IsResidentSource(const ArraySource& source)
+{
+	return IsResidentArray(source.vertex) && IsResidentArray(source.texcoord) && IsResidentArray(source.color) &&
+		source.texture_matrix == glm::mat4(1.0f);
+}
+
+static uint32_t GetSourceCount(const ArraySource& source)
+{
+	auto result = source.vertex.count;
+
+	if (source.texcoord.has_value())
+		result = std::min(result, source.texcoord->count);
+
+	if (source.color.has_value())
+		result = std::min(result, source.color->count);
+
+	return result;
+}
+
+// the same arrays with their contents ignored, a rewritten buffer keeps its slot
+static ArraySource GetSourceLayout(ArraySource source)
+{
+	auto strip = [](ResolvedArray& array) {
+		array.data = nullptr;
+		array.generation = 0;
+		array.count = 0;
+	};
+
+	strip(source.vertex);
+
+	if (source.texcoord.has_value())
+		strip(source.texcoord.value());
+
+	if (source.color.has_value())
+		strip(source.color.value());
+
+	return source;
+}
+
+struct ResidentMesh
+{
+	ArraySource source;
+	skygfx::utils::Mesh mesh;
+	uint64_t last_used = 0;
+};
+
+constexpr size_t MaxResidentMeshes = 64;
+
+static std::vector<std::unique_ptr<ResidentMesh>> gResidentMeshes;
+static uint64_t gResidentMeshClock = 0;
+
+static skygfx::utils::Mesh gStreamMesh; // client memory and dynamic buffers, rewritten every draw
+static skygfx::utils::Mesh::Vertices gArrayVertices;
+static std::vector<uint32_t> gArrayElements;
+static std::vector<uint32_t> gArrayIndices;
+
+static ResidentMesh& AcquireResidentMesh(const ArraySource& source)
+{
+	gResidentMeshClock++;
+
+	for (auto& resident : gResidentMeshes)
+	{
+		if (resident->source != source)
+			continue;
+
+		resident->last_used = gResidentMeshClock;
+		gDrawStats.cached_array_draws++;
+		return *resident;
+	}
+
+	auto layout = GetSourceLayout(source);
+	auto it = std::find_if(gResidentMeshes.begin(), gResidentMeshes.end(), [&](const auto& resident) {
+		return GetSourceLayout(resident->source) == layout;
+	});
+
+	if (it == gResidentMeshes.end())
+	{
+		if (gResidentMeshes.size() < MaxResidentMeshes)
+		{
+			gResidentMeshes.push_back(std::make_unique<ResidentMesh>());
+			it = std::prev(gResidentMeshes.end());
+		}
+		else
+		{
+			it = std::min_element(gResidentMeshes.begin(), gResidentMeshes.end(), [](const auto& a, const auto& b) {
+				return a->last_used < b->last_used;
+			});
+		}
+	}
+
+	auto& resident = **it;
+	resident.source = source;
+	resident.last_used = gResidentMeshClock;
+
+	// the whole store is converted, later draws only upload their indices
+	auto count = GetSourceCount(source);
+	gDrawStats.vertices += count;
+
+	if (gRecording)
+		return resident;
+
+	gArrayVertices.clear();
+	gArrayVertices.reserve(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		gArrayVertices.push_back(FetchVertex(source, i));
+	}
+
+	resident.mesh.setVertices(gArrayVertices);
+	return resident;
+}
+
+static void ReleaseResidentMeshes(BufferId buffer)
+{
+	auto uses = [buffer](const std::optional<ResolvedArray>& array) {
+		return array.has_value() && array->buffer == buffer;
+	};
+
+	std::erase_if(gResidentMeshes, [&](const auto& resident) {
+		return uses(resident->source.vertex) || uses(resident->source.texcoord) || uses(resident->source.color);
+	});
+}
+
+// skygfx has no fans, loops, quads or polygons, those are rebuilt as lists
+static skygfx::Topology BuildIndices(GLenum mode, const std::vector<uint32_t>& elements, uint32_t base, std::vector<uint32_t>& indices)
 {
+	indices.clear();
+
+	auto push = [&](size_t i) {
+		indices.push_back(elements[i] - base);
+	};
+
+	auto push_all = [&] {
+		for (size_t i = 0; i < elements.size(); i++)
+		{
+			push(i);
+		}
+	};
+
+	switch (mode)
+	{
+	case GL_POINTS:
+		push_all();
+		return skygfx::Topology::PointList;
+	case GL_LINES:
+		push_all();
+		return skygfx::Topology::LineList;
+	case GL_LINE_STRIP:
+		push_all();
+		return skygfx::Topology::LineStrip;
+	case GL_LINE_LOOP:
+		push_all();
+		if (!elements.empty())
+			push(0);
+		return skygfx::Topology::LineStrip;
+	case GL_TRIANGLES:
+		push_all();
+		return skygfx::Topology::TriangleList;
+	case GL_TRIANGLE_STRIP:
+		push_all();
+		return skygfx::Topology::TriangleStrip;
+	case GL_TRIANGLE_FAN:
+	case GL_POLYGON:
+		for (size_t i = 2; i < elements.size(); i++)
+		{
+			push(0);
+			push(i - 1);
+			push(i);
+		}
+		return skygfx::Topology::TriangleList;
+	case GL_QUADS:
+		for (size_t i = 3; i < elements.size(); i += 4)
+		{
+			push(i - 3);
+			push(i - 2);
+			push(i - 1);
+			push(i - 3);
+			push(i - 1);
+			push(i);
+		}
+		return skygfx::Topology::TriangleList;
+	}
+
 	assert(false);
+	return skygfx::Topology::TriangleList;
+}
+
+static void DrawMesh(const skygfx::utils::Mesh& mesh, const skygfx::utils::Scratch::State& state)
+{
+	skygfx::utils::Commands commands = {
+		skygfx::utils::commands::SetViewport(state.viewport),
+		skygfx::utils::commands::SetBlendMode(state.blend_mode),
+		skygfx::utils::commands::SetDepthMode(state.depth_mode),
+		skygfx::utils::commands::SetStencilMode(state.stencil_mode),
+		skygfx::utils::commands::SetDepthBias(state.depth_bias),
+		skygfx::utils::commands::SetCullMode(state.cull_mode),
+		skygfx::utils::commands::SetFrontFace(state.front_face),
+		skygfx::utils::commands::SetSampler(state.sampler),
+		skygfx::utils::commands::SetTextureAddress(state.texaddr),
+		skygfx::utils::commands::SetMipmapBias(state.mipmap_bias),
+		skygfx::utils::commands::SetColorTexture(state.texture),
+		skygfx::utils::commands::SetProjectionMatrix(state.projection_matrix),
+		skygfx::utils::commands::SetViewMatrix(state.view_matrix),
+		skygfx::utils::commands::SetMesh(&mesh)
+	};
+
+	if (state.alpha_test_threshold.has_value())
+	{
+		commands.push_back(skygfx::utils::commands::SetEffect(skygfx::utils::effects::AlphaTest{
+			.threshold = state.alpha_test_threshold.value()
+		}));
+	}
+
+	commands.push_back(skygfx::utils::commands::Draw());
+	skygfx::utils::ExecuteCommands(commands);
+}
+
+static void DrawArraySource(GLenum mode, const ArraySource& source, const skygfx::utils::Scratch::State& state)
+{
+	if (IsResidentSource(source))
+	{
+		auto& resident = AcquireResidentMesh(source);
+
+		if (gRecording)
+			return;
+
+		assert(*std::max_element(gArrayElements.begin(), gArrayElements.end()) < GetSourceCount(source));
+		resident.mesh.setTopology(BuildIndices(mode, gArrayElements, 0, gArrayIndices));
+		resident.mesh.setIndices(gArrayIndices);
+		DrawMesh(resident.mesh, state);
+		return;
+	}
+
+	// the arrays may change right after the draw, convert just the referenced range
+	auto [min, max] = std::minmax_element(gArrayElements.begin(), gArrayElements.end());
+	auto first = *min;
+	auto count = *max - *min + 1;
+	assert(*max < GetSourceCount(source));
+	gDrawStats.vertices += count;
+
+	if (gRecording)
+		return;
+
+	gArrayVertices.clear();
+	gArrayVertices.reserve(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		gArrayVertices.push_back(FetchVertex(source, first + i));
+	}
+
+	gStreamMesh.setVertices(gArrayVertices);
+	gStreamMesh.setTopology(BuildIndices(mode, gArrayElements, first, gArrayIndices));
+	gStreamMesh.setIndices(gArrayIndices);
+	DrawMesh(gStreamMesh, state);
+}
+
+// draws gArrayElements as one indexed mesh per pass instead of going through the scratch
+static void DrawClientArrays(GLenum mode)
+{
+	auto source = GetArraySource(0);
+
+	if (!source.has_value())
+		return;
+
+	gDrawStats.draw_calls++;
+	gDrawStats.array_draw_calls++;
+	gDrawStats.indices += (uint32_t)gArrayElements.size();
+
+	if (!gRecording)
+	{
+		FillState();
+
+		// keep the order with immediate mode primitives batched so far
+		gScratch.flush();
+	}
+
+	DrawArraySource(mode, source.value(), gState);
+
+	auto passes = GetTexturePasses();
+
+	for (uint32_t unit = 1; unit < MaxTextureUnits; unit++)
+	{
+		if (!(passes & (1 << unit)))
+			continue;
+
+		gDrawStats.texture_passes++;
+		DrawArraySource(mode, GetArraySource(unit).value(), MakeTexturePassState(unit));
+	}
+}
+
+static void DrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices)
+{
+	assert(!gBegined);
+
+	if (count <= 0)
+		return;
+
+	const auto* data = (const uint8_t*)indices;
+
+	if (gElementArrayBuffer != 0)
+		data = gBuffers.at(gElementArrayBuffer).data.data() + (uintptr_t)indices;
+
+	if (type == GL_UNSIGNED_SHORT)
+		gArrayElements.assign((const uint16_t*)data, (const uint16_t*)data + count);
+	else if (type == GL_UNSIGNED_INT)
+		gArrayElements.assign((const uint32_t*)data, (const uint32_t*)data + count);
+	else if (type == GL_UNSIGNED_BYTE)
+		gArrayElements.assign(data, data + count);
+	else
+	{
+		assert(false);
+		return;
+	}
+
+	DrawClientArrays(mode);
+}
+
+void imdraw::pglDisableClientState(GLenum array)
+{
+	GetClientArray(array).enabled = false;
 }
 
 void imdraw::pglEnableClientState(GLenum array)
 {
-	assert(false);
+	GetClientArray(array).enabled = true;
 }
 
 GLboolean imdraw::pglIsTexture(GLuint texture)
@@ -889,7 +1900,11 @@ void imdraw::pglTexParameterf(GLenum target, GLenum pname, GLfloat param)
 	assert(!gBegined);
 	assert(target == GL_TEXTURE_2D);
 
-	auto& sampled_texture = gTextures.at(gCurrentTexture.at(gActiveTexture));
+	if (gRecording)
+		return;
+
+	auto& sampled_texture = GetCurrentTexture();
+	gStateDirty |= StateDirtyTexture;
 
 	if (pname == GL_TEXTURE_LOD_BIAS_EXT)
 	{
@@ -903,27 +1918,28 @@ void imdraw::pglTexParameterf(GLenum target, GLenum pname, GLfloat param)
 
 void imdraw::pglVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid* pointer)
 {
-	assert(false);
+	ClientArrayPointer(gVertexArray, size, type, stride, pointer);
 }
 
 void imdraw::pglTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid* pointer)
 {
-	assert(false);
+	ClientArrayPointer(gTexCoordArrays[gClientActiveTexture], size, type, stride, pointer);
 }
 
 void imdraw::pglColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid* pointer)
 {
-	assert(false);
+	ClientArrayPointer(gColorArray, size, type, stride, pointer);
 }
 
 void imdraw::pglDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid* indices)
 {
-	assert(false);
+	// start and end are only a hint, the range is taken from the indices
+	DrawElements(mode, count, type, indices);
 }
 
 void imdraw::pglDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices)
 {
-	assert(false);
+	DrawElements(mode, count, type, indices);
 }
 
 void imdraw::pglTexSubImage1D(GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLenum type, const GLvoid* pixels)
@@ -951,34 +1967,79 @@ void imdraw::pglTexImage2DMultisample(GLenum target, GLsizei samples, GLenum int
 	assert(false);
 }
 
+static BufferId& GetBufferBinding(GLenum target)
+{
+	if (target == GL_ELEMENT_ARRAY_BUFFER_ARB)
+		return gElementArrayBuffer;
+
+	assert(target == GL_ARRAY_BUFFER_ARB);
+	return gArrayBuffer;
+}
+
 void imdraw::pglGenBuffersARB(GLsizei n, GLuint* buffers)
 {
-	assert(false);
+	for (int32_t i = 0; i < n; i++)
+	{
+		auto index = gBuffersIndexCount;
+		buffers[i] = index;
+		gBuffers[index];
+		gBuffersIndexCount++;
+	}
 }
 
 void imdraw::pglBindBufferARB(GLenum target, GLuint buffer)
 {
-	assert(false);
+	GetBufferBinding(target) = buffer;
 }
 
 void imdraw::pglBufferDataARB(GLenum target, GLsizeiptrARB size, const GLvoid* data, GLenum usage)
 {
-	assert(false);
+	// array draws convert the store into skygfx meshes at draw time,
+	// so it can be rewritten right after a draw that used it
+	auto& buffer = gBuffers.at(GetBufferBinding(target));
+	buffer.data.resize(size);
+	buffer.usage = usage;
+	buffer.generation++;
+
+	if (data != nullptr)
+		memcpy(buffer.data.data(), data, size);
 }
 
 void imdraw::pglBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const GLvoid* data)
 {
-	assert(false);
+	auto& buffer = gBuffers.at(GetBufferBinding(target));
+	assert(offset >= 0 && offset + size <= (GLintptrARB)buffer.data.size());
+	memcpy(buffer.data.data() + offset, data, size);
+	buffer.generation++;
 }
 
 void imdraw::pglDeleteBuffersARB(GLsizei n, const GLuint* buffers)
 {
-	assert(false);
+	for (int32_t i = 0; i < n; i++)
+	{
+		auto index = buffers[i];
+
+		if (gArrayBuffer == index)
+			gArrayBuffer = 0;
+
+		if (gElementArrayBuffer == index)
+			gElementArrayBuffer = 0;
+
+		ReleaseResidentMeshes(index);
+		gBuffers.erase(index);
+	}
 }
 
 void imdraw::pglDrawArrays(GLenum mode, GLint first, GLsizei count)
 {
-	assert(false);
+	assert(!gBegined);
+
+	if (count <= 0)
+		return;
+
+	gArrayElements.resize(count);
+	std::iota(gArrayElements.begin(), gArrayElements.end(), (uint32_t)first);
+	DrawClientArrays(mode);
 }
 
 void imdraw::pglCompressedTexImage3DARB(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const void* data)
@@ -1023,5 +2084,5 @@ void imdraw::pglDebugMessageControlARB(GLenum source, GLenum type, GLenum severi
 
 skygfx::Texture* imdraw::GetTextureByIndex(int index)
 {
-	return &gTextures.at(index).texture;
+	return &GetTexture(index).texture;
 }
@@ -430,7 +430,7 @@ namespace imdraw
 	{
 		ModelView,
 		Projection,
-		Texture // unused
+		Texture // per texture unit, applied to texcoords
 	};
 
 	using Topology = skygfx::utils::MeshBuilder::Mode;
@@ -526,8 +526,43 @@ namespace imdraw
 	extern std::optional<skygfx::BackendType> BackendType;
 	extern skygfx::Adapter Adapter;
 
+	struct DrawStats
+	{
+		uint32_t draw_calls = 0; // immediate and array draws
+		uint32_t array_draw_calls = 0;
+		uint32_t vertices = 0; // immediate vertices and array vertices converted for skygfx
+		uint32_t indices = 0;
+		uint32_t cached_array_draws = 0; // array draws served by an already resident mesh
+		uint32_t texture_passes = 0; // extra passes drawing the upper texture units
+	};
+
 	void Init();
 
+	// headless backend: state and counters are tracked, nothing reaches skygfx
+	void SetRecording(bool value);
+	bool IsRecording();
+
+	// counters since the last BeginFrame or ResetDrawStats
+	const DrawStats& GetDrawStats();
+	void ResetDrawStats();
+
+	// records immediate mode and state calls so a frame can be replayed for timing,
+	// texture uploads and array draws are not captured
+	void BeginCapture();
+	void EndCapture();
+	size_t GetCapturedCallCount();
+	void ReplayCapture();
+
+	struct TextureMemoryStats
+	{
+		uint32_t textures = 0;
+		uint32_t mips = 0;
+		size_t bytes = 0; // resident on the gpu, no cpu copies are kept
+		uint32_t reallocations = 0; // mip chains grown without pglTexStorage2D
+	};
+
+	TextureMemoryStats GetTextureMemoryStats();
+
 	void pglClearColor(float red, float green, float blue, float alpha);
 	void pglClear(uint32_t mask);
 
@@ -587,6 +622,7 @@ namespace imdraw
 	void pglDeleteTextures(GLsizei n, const GLuint* textures);
 	void pglTexSubImage2D(uint32_t target, int32_t level, int32_t xoffset, int32_t yoffset, int32_t width, int32_t height, uint32_t format, uint32_t type, const void* pixels);
 	void pglTexImage2D(uint32_t target, int32_t level, int32_t internalformat, int32_t width, int32_t height, int32_t border, uint32_t format, uint32_t type, const void* pixels);
+	void pglTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
 
 	void pglTexParameteri(GLenum target, GLenum pname, GLint param);
 